@@ -104,6 +104,12 @@
 #endif /* DB_MAX_ELEMENT_SIZE */
 
 
+/* The size of the buffer into which full relation scans read
+   several rows at a time. Set to 0 to read one row at a time. */
+#ifndef DB_SCAN_BUFFER_SIZE
+#define DB_SCAN_BUFFER_SIZE		256
+#endif /* DB_SCAN_BUFFER_SIZE */
+
 /* The maximum size of the LVM bytecode compiled from a
    single database query. */
 #ifndef DB_VM_BYTECODE_SIZE
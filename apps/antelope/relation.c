@@ -88,6 +88,15 @@ static unsigned char * const left_row = row;
 static unsigned char * const right_row = extra_row;
 static unsigned char * const join_row = result_row;
 
+#if DB_SCAN_BUFFER_SIZE > 0
+/* A full scan of scan_rel reads ahead; the buffer holds scan_count
+   rows starting from scan_first. */
+static unsigned char scan_buf[DB_SCAN_BUFFER_SIZE];
+static relation_t *scan_rel;
+static tuple_id_t scan_first;
+static tuple_id_t scan_count;
+#endif
+
 LIST(relations);
 MEMB(relations_memb, relation_t, DB_RELATION_POOL_SIZE);
 MEMB(attributes_memb, attribute_t, DB_ATTRIBUTE_POOL_SIZE);
@@ -542,9 +551,14 @@ relation_insert(relation_t *rel, attribute_value_t *values)
 
   PRINTF(")\n");
 
-  rel->cardinality++;
   rel->next_row++;
-  return storage_put_row(rel, record);
+  result = storage_put_row(rel, record);
+  if(DB_SUCCESS(result)) {
+    /* Inserted rows are synced one by one. The rows of query results
+       are written when their relation is closed. */
+    storage_sync();
+  }
+  return result;
 }
 
 static void
@@ -683,6 +697,9 @@ generate_selection_result(db_handle_t *handle, relation_t *rel, aql_adt_t *adt)
   handle->current_row = 0;
   handle->ncolumns = 0;
   handle->tuple_id = 0;
+#if DB_SCAN_BUFFER_SIZE > 0
+  scan_count = 0;
+#endif
   for(attr = list_head(result_rel->attributes); attr != NULL; attr = attr->next) {
     if(attr->flags & ATTRIBUTE_FLAG_NO_STORE) {
       continue;
@@ -731,6 +748,45 @@ relation_process_remove(void *handle_ptr)
 }
 #endif
 
+#if DB_SCAN_BUFFER_SIZE > 0
+static int
+scan_buffered(db_handle_t *handle)
+{
+  return !(handle->flags & DB_HANDLE_FLAG_SEARCH_INDEX) &&
+    handle->rel == scan_rel &&
+    (tuple_id_t)(handle->tuple_id - scan_first) < scan_count;
+}
+#endif
+
+static db_result_t
+select_get_row(db_handle_t *handle)
+{
+#if DB_SCAN_BUFFER_SIZE > 0
+  relation_t *rel;
+  db_result_t result;
+
+  rel = handle->rel;
+  if(!(handle->flags & DB_HANDLE_FLAG_SEARCH_INDEX) &&
+     rel->row_length <= sizeof(scan_buf)) {
+    if(!scan_buffered(handle)) {
+      /* Read as many of the following rows as fit in the buffer. */
+      scan_rel = rel;
+      scan_first = handle->tuple_id;
+      scan_count = sizeof(scan_buf) / rel->row_length;
+      result = storage_get_rows(rel, scan_first, scan_buf, &scan_count);
+      if(result != DB_OK) {
+        scan_count = 0;
+        return result;
+      }
+    }
+    memcpy(row, &scan_buf[(handle->tuple_id - scan_first) * rel->row_length],
+           rel->row_length);
+    return DB_OK;
+  }
+#endif
+  return storage_get_row(handle->rel, &handle->tuple_id, row);
+}
+
 db_result_t
 relation_process_select(void *handle_ptr)
 {
@@ -753,6 +809,9 @@ relation_process_select(void *handle_ptr)
   attribute_count = handle->result_rel->attribute_count;
   attr_map_end = attr_map + attribute_count;
 
+#if DB_SCAN_BUFFER_SIZE > 0
+next_tuple:
+#endif
   if(handle->flags & DB_HANDLE_FLAG_SEARCH_INDEX) {
     handle->tuple_id = index_get_next(&handle->index_iterator);
     if(handle->tuple_id == INVALID_TUPLE) {
@@ -771,7 +830,7 @@ relation_process_select(void *handle_ptr)
 
   /* Put the tuples fulfilling the given condition into a new relation.
      The tuples may be projected. */
-  result = storage_get_row(handle->rel, &handle->tuple_id, row);
+  result = select_get_row(handle);
   handle->tuple_id++;
   if(DB_ERROR(result)) {
     PRINTF("DB: Failed to get a row in relation %s!\n", handle->rel->name);
@@ -842,6 +901,14 @@ relation_process_select(void *handle_ptr)
     }
   }
 
+#if DB_SCAN_BUFFER_SIZE > 0
+  /* Filter the rest of the rows that were read with this one
+     before yielding. */
+  if(scan_buffered(handle)) {
+    goto next_tuple;
+  }
+#endif
+
   return DB_OK;
 
 end_aggregation:
@@ -406,7 +406,8 @@ storage_get_row(relation_t *rel, tuple_id_t *tuple_id, storage_row_t row)
   int r;
   tuple_id_t nrows;
 
-  if(DB_ERROR(storage_get_row_amount(rel, &nrows))) {
+  nrows = relation_cardinality(rel);
+  if(nrows == INVALID_TUPLE) {
     return DB_STORAGE_ERROR;
   }
 
@@ -437,6 +438,54 @@ storage_get_row(relation_t *rel, tuple_id_t *tuple_id, storage_row_t row)
   return DB_OK;
 }
 
+db_result_t
+storage_get_rows(relation_t *rel, tuple_id_t tuple_id, storage_row_t rows,
+                 tuple_id_t *count)
+{
+  int r;
+  tuple_id_t nrows;
+  tuple_id_t i;
+
+  nrows = relation_cardinality(rel);
+  if(nrows == INVALID_TUPLE) {
+    return DB_STORAGE_ERROR;
+  }
+
+  if(tuple_id >= nrows) {
+    return DB_FINISHED;
+  }
+  if(*count > nrows - tuple_id) {
+    *count = nrows - tuple_id;
+  }
+
+  if(cfs_seek(rel->tuple_storage, (cfs_offset_t)tuple_id * rel->row_length,
+              CFS_SEEK_SET) == (cfs_offset_t)-1) {
+    return DB_STORAGE_ERROR;
+  }
+
+  /* Read all the rows at once, and leave out an incomplete last row. */
+  r = cfs_read(rel->tuple_storage, rows, *count * rel->row_length);
+  if(r < 0) {
+    PRINTF("DB: Reading failed on fd %d\n", rel->tuple_storage);
+    return DB_STORAGE_ERROR;
+  } else if(r == 0) {
+    return DB_FINISHED;
+  } else if(r < rel->row_length) {
+    PRINTF("DB: Incomplete record: %d < %d\n", r, rel->row_length);
+    return DB_STORAGE_ERROR;
+  }
+
+  *count = r / rel->row_length;
+  for(i = 1; i <= *count; i++) {
+    rows[i * rel->row_length - 1] ^= ROW_XOR;
+  }
+
+  PRINTF("DB: Read %lu rows from relation %s\n",
+         (unsigned long)*count, rel->name);
+
+  return DB_OK;
+}
+
 db_result_t
 storage_put_row(relation_t *rel, storage_row_t row)
 {
@@ -486,9 +535,23 @@ storage_put_row(relation_t *rel, storage_row_t row)
 
   *last_byte ^= ROW_XOR;
 
+  if(rel->cardinality != INVALID_TUPLE) {
+    rel->cardinality++;
+  }
+
   return DB_OK;
 }
 
+void
+storage_sync(void)
+{
+#if DB_FEATURE_COFFEE
+  /* The relation files stay open; make the rows written so far
+     survive a reset. */
+  cfs_coffee_sync();
+#endif
+}
+
 db_result_t
 storage_get_row_amount(relation_t *rel, tuple_id_t *amount)
 {
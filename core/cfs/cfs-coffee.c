@@ -58,6 +58,7 @@
 #include "cfs/cfs.h"
 #include "cfs-coffee-arch.h"
 #include "cfs/cfs-coffee.h"
+#include "sys/clock.h"
 
 /* Micro logs enable modifications on storage types that do not support
    in-place updates. This applies primarily to flash memories. */
@@ -90,6 +91,58 @@
 #define COFFEE_EXTENDED_WEAR_LEVELLING	1
 #endif
 
+/*
+ * Keep an index of the file names in RAM, so that opening or removing
+ * a file does not need a scan of the storage. The index maps a hash
+ * of each file name to the first page of the file. It holds at most
+ * COFFEE_INDEX_SIZE files; lookups that miss fall back to a scan
+ * if there are more files than that.
+ */
+#ifndef COFFEE_INDEX_SIZE
+#define COFFEE_INDEX_SIZE	0
+#endif
+
+/*
+ * Keep a map of the active, obsolete and free pages of each sector in
+ * RAM, so that allocation and garbage collection do not need to read
+ * the page headers. The map is built on first use.
+ */
+#ifndef COFFEE_FREE_MAP
+#define COFFEE_FREE_MAP		0
+#endif
+
+/*
+ * Run the garbage collector and the log merges in small steps from a
+ * process, so that writers seldom run into a full file system. The
+ * process starts when a watermark is set with
+ * cfs_coffee_set_gc_watermark(), and it also wakes up every
+ * COFFEE_GC_INTERVAL to merge logs that are about to fill up.
+ */
+#ifndef COFFEE_BACKGROUND_GC
+#define COFFEE_BACKGROUND_GC	0
+#endif
+
+/*
+ * Keep this many pages of the storage in RAM. Small reads, including
+ * those of the page headers, are served from the cached pages, and
+ * small writes to a page are combined into one write. The dirty pages
+ * are written before any header, when a file is closed, when the page
+ * is evicted, and by cfs_coffee_sync(). Headers are written straight
+ * to the storage.
+ */
+#ifndef COFFEE_PAGE_CACHE
+#define COFFEE_PAGE_CACHE	0
+#endif
+
+#ifndef COFFEE_GC_INTERVAL
+#define COFFEE_GC_INTERVAL	(10 * CLOCK_SECOND)
+#endif
+
+#if COFFEE_BACKGROUND_GC
+#include "sys/etimer.h"
+#include "sys/process.h"
+#endif
+
 #if COFFEE_START & (COFFEE_SECTOR_SIZE - 1)
 #error COFFEE_START must point to the first byte in a sector.
 #endif
@@ -112,6 +165,8 @@
 #define GC_GREEDY		0
 /* "Reluctant" garbage collection stops after erasing one sector. */
 #define GC_RELUCTANT		1
+/* A background step erases the first sector that greedy mode would erase. */
+#define GC_STEP			2
 
 /* File descriptor macros. */
 #define FD_VALID(fd)					\
@@ -159,6 +214,8 @@ struct sector_status {
   coffee_page_t active;
   coffee_page_t obsolete;
   coffee_page_t free;
+  /* Pages at the start that belong to an extent from an earlier sector */
+  coffee_page_t carry;
 };
 
 /* The structure of cached file objects. */
@@ -169,6 +226,7 @@ struct file {
   int16_t record_count;
   uint8_t references;
   uint8_t flags;
+  uint8_t eof_hint;
 };
 
 /* The file descriptor structure. */
@@ -188,11 +246,25 @@ struct file_header {
   uint16_t log_records;
   uint16_t log_record_size;
   coffee_page_t max_pages;
-  uint8_t deprecated_eof_hint;
+  uint8_t eof_hint;
   uint8_t flags;
   char name[COFFEE_NAME_LENGTH];
 };
 
+#if COFFEE_INDEX_SIZE > 0
+#define INDEX_UNBUILT		0
+#define INDEX_COMPLETE		1
+#define INDEX_PARTIAL		2
+
+/* The file name index. Entries 0 to count - 1 are in use. */
+struct file_index {
+  coffee_page_t page[COFFEE_INDEX_SIZE];
+  uint8_t hash[COFFEE_INDEX_SIZE];
+  uint16_t count;
+  uint8_t state;
+};
+#endif /* COFFEE_INDEX_SIZE > 0 */
+
 /* This is needed because of a buggy compiler. */
 struct log_param {
   cfs_offset_t offset;
@@ -200,6 +272,18 @@ struct log_param {
   uint16_t size;
 };
 
+#if COFFEE_PAGE_CACHE > 0
+/* A cached page; the bytes from dirty_start to dirty_end are unwritten. */
+struct cache_line {
+  coffee_page_t page;
+  uint16_t used;
+  uint16_t dirty_start;
+  uint16_t dirty_end;
+  uint8_t valid;
+  uint8_t data[COFFEE_PAGE_SIZE];
+};
+#endif
+
 /*
  * The protected memory consists of structures that should not be 
  * overwritten during system checkpointing because they may be used by 
@@ -211,24 +295,243 @@ static struct protected_mem_t {
   struct file_desc coffee_fd_set[COFFEE_FD_SET_SIZE];
   coffee_page_t next_free;
   char gc_wait;
+#if COFFEE_INDEX_SIZE > 0
+  struct file_index file_index;
+#endif
+#if COFFEE_FREE_MAP
+  struct sector_status sector_map[COFFEE_SECTOR_COUNT];
+  char map_valid;
+#endif
+#if COFFEE_PAGE_CACHE > 0
+  struct cache_line page_cache[COFFEE_PAGE_CACHE];
+  uint16_t cache_clock;
+#endif
 } protected_mem;
 static struct file * const coffee_files = protected_mem.coffee_files;
 static struct file_desc * const coffee_fd_set = protected_mem.coffee_fd_set;
 static coffee_page_t * const next_free = &protected_mem.next_free;
 static char * const gc_wait = &protected_mem.gc_wait;
+#if COFFEE_INDEX_SIZE > 0
+static struct file_index * const file_index = &protected_mem.file_index;
+#endif
+#if COFFEE_FREE_MAP
+static struct sector_status * const sector_map = protected_mem.sector_map;
+static char * const map_valid = &protected_mem.map_valid;
+#endif
+#if COFFEE_PAGE_CACHE > 0
+static struct cache_line * const page_cache = protected_mem.page_cache;
+static uint16_t * const cache_clock = &protected_mem.cache_clock;
+#endif
 
+static struct cfs_coffee_gc_stats gc_stats;
+#if COFFEE_BACKGROUND_GC
+static coffee_page_t gc_watermark;
+PROCESS(coffee_gc_process, "Coffee GC");
+#endif
+
+/*---------------------------------------------------------------------------*/
+#if COFFEE_PAGE_CACHE > 0
+#define IO_READ(buf, size, offset)	cache_read((char *)(buf), (size), (offset))
+#define IO_WRITE(buf, size, offset)	cache_write((buf), (size), (offset))
+#define IO_ERASE(sector)		cache_erase(sector)
+
+static struct cache_line *
+cache_find(coffee_page_t page)
+{
+  struct cache_line *line;
+
+  for(line = page_cache; line < &page_cache[COFFEE_PAGE_CACHE]; line++) {
+    if(line->valid && line->page == page) {
+      line->used = ++*cache_clock;
+      return line;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_flush_line(struct cache_line *line)
+{
+  if(line->dirty_end > line->dirty_start) {
+    COFFEE_WRITE(&line->data[line->dirty_start],
+                 line->dirty_end - line->dirty_start,
+                 line->page * COFFEE_PAGE_SIZE + line->dirty_start);
+    line->dirty_start = line->dirty_end = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_flush(void)
+{
+  struct cache_line *line;
+
+  for(line = page_cache; line < &page_cache[COFFEE_PAGE_CACHE]; line++) {
+    if(line->valid) {
+      cache_flush_line(line);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Read a page into the least recently used line. */
+static struct cache_line *
+cache_load(coffee_page_t page)
+{
+  struct cache_line *line, *victim;
+
+  victim = page_cache;
+  for(line = page_cache; line < &page_cache[COFFEE_PAGE_CACHE]; line++) {
+    if(!line->valid) {
+      victim = line;
+      break;
+    }
+    if((uint16_t)(*cache_clock - line->used) >
+       (uint16_t)(*cache_clock - victim->used)) {
+      victim = line;
+    }
+  }
+  if(victim->valid) {
+    cache_flush_line(victim);
+  }
+
+  COFFEE_READ(victim->data, COFFEE_PAGE_SIZE, page * COFFEE_PAGE_SIZE);
+  victim->page = page;
+  victim->valid = 1;
+  victim->dirty_start = victim->dirty_end = 0;
+  victim->used = ++*cache_clock;
+  return victim;
+}
+/*---------------------------------------------------------------------------*/
+/* The number of bytes from offset in whole pages that are not cached. */
+static unsigned
+uncached_pages(unsigned long offset, unsigned size)
+{
+  unsigned n;
+
+  for(n = 0; size - n >= COFFEE_PAGE_SIZE &&
+      cache_find((offset + n) / COFFEE_PAGE_SIZE) == NULL;
+      n += COFFEE_PAGE_SIZE);
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_read(void *buf, unsigned size, unsigned long offset)
+{
+  struct cache_line *line;
+  uint8_t *p;
+  unsigned start, n;
+
+  for(p = buf; size > 0; p += n, offset += n, size -= n) {
+    start = offset % COFFEE_PAGE_SIZE;
+    n = start == 0 ? uncached_pages(offset, size) : 0;
+    if(n > 0) {
+      /* Whole pages that are not cached are read in one transfer. */
+      COFFEE_READ(p, n, offset);
+      continue;
+    }
+    n = COFFEE_PAGE_SIZE - start;
+    if(n > size) {
+      n = size;
+    }
+    line = cache_find(offset / COFFEE_PAGE_SIZE);
+    if(line == NULL) {
+      line = cache_load(offset / COFFEE_PAGE_SIZE);
+    }
+    memcpy(p, &line->data[start], n);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_write(const void *buf, unsigned size, unsigned long offset)
+{
+  struct cache_line *line;
+  const uint8_t *p;
+  unsigned start, n;
+
+  for(p = buf; size > 0; p += n, offset += n, size -= n) {
+    start = offset % COFFEE_PAGE_SIZE;
+    n = start == 0 ? uncached_pages(offset, size) : 0;
+    if(n > 0) {
+      COFFEE_WRITE(p, n, offset);
+      continue;
+    }
+    n = COFFEE_PAGE_SIZE - start;
+    if(n > size) {
+      n = size;
+    }
+    line = cache_find(offset / COFFEE_PAGE_SIZE);
+    if(line == NULL) {
+      line = cache_load(offset / COFFEE_PAGE_SIZE);
+    }
+    memcpy(&line->data[start], p, n);
+
+    /* Only adjacent or overlapping writes are combined. */
+    if(line->dirty_end > line->dirty_start &&
+       (start > line->dirty_end || start + n < line->dirty_start)) {
+      cache_flush_line(line);
+    }
+    if(line->dirty_end == line->dirty_start) {
+      line->dirty_start = start;
+      line->dirty_end = start + n;
+    } else {
+      if(start < line->dirty_start) {
+        line->dirty_start = start;
+      }
+      if(start + n > line->dirty_end) {
+        line->dirty_end = start + n;
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Copy data that is written past the cache into a cached page. */
+static void
+cache_update(const void *buf, unsigned size, unsigned long offset)
+{
+  struct cache_line *line;
+  unsigned start;
+
+  start = offset % COFFEE_PAGE_SIZE;
+  line = cache_find(offset / COFFEE_PAGE_SIZE);
+  if(line != NULL) {
+    memcpy(&line->data[start], buf,
+           size < COFFEE_PAGE_SIZE - start ? size : COFFEE_PAGE_SIZE - start);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_erase(uint16_t sector)
+{
+  struct cache_line *line;
+
+  for(line = page_cache; line < &page_cache[COFFEE_PAGE_CACHE]; line++) {
+    if(line->page / COFFEE_PAGES_PER_SECTOR == sector) {
+      line->valid = 0;
+    }
+  }
+  COFFEE_ERASE(sector);
+}
+#else
+#define IO_READ(buf, size, offset)	COFFEE_READ(buf, size, offset)
+#define IO_WRITE(buf, size, offset)	COFFEE_WRITE(buf, size, offset)
+#define IO_ERASE(sector)		COFFEE_ERASE(sector)
+#endif /* COFFEE_PAGE_CACHE > 0 */
 /*---------------------------------------------------------------------------*/
 static void
 write_header(struct file_header *hdr, coffee_page_t page)
 {
   hdr->flags |= HDR_FLAG_VALID;
+#if COFFEE_PAGE_CACHE > 0
+  /* The data that a header refers to must be on flash before it. */
+  cache_flush();
+  cache_update(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
+#endif
   COFFEE_WRITE(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
 }
 /*---------------------------------------------------------------------------*/
 static void
 read_header(struct file_header *hdr, coffee_page_t page)
 {
-  COFFEE_READ(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
+  IO_READ(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
 #if DEBUG
   if(HDR_ACTIVE(*hdr) && !HDR_VALID(*hdr)) {
     PRINTF("Invalid header at page %u!\n", (unsigned)page);
@@ -242,6 +545,7 @@ absolute_offset(coffee_page_t page, cfs_offset_t offset)
   return page * COFFEE_PAGE_SIZE + sizeof(struct file_header) + offset;
 }
 /*---------------------------------------------------------------------------*/
+#if !COFFEE_FREE_MAP
 static coffee_page_t
 get_sector_status(uint16_t sector, struct sector_status *stats)
 {
@@ -267,6 +571,8 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
 
   sector_start = sector * COFFEE_PAGES_PER_SECTOR;
   sector_end = sector_start + COFFEE_PAGES_PER_SECTOR;
+  stats->carry = skip_pages < COFFEE_PAGES_PER_SECTOR ?
+                 skip_pages : COFFEE_PAGES_PER_SECTOR;
 
   /*
    * Account for pages belonging to a file starting in a previous 
@@ -341,6 +647,7 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
   return (last_pages_are_active || (skip_pages >= COFFEE_PAGES_PER_SECTOR)) ?
 	0 : skip_pages;
 }
+#endif /* !COFFEE_FREE_MAP */
 /*---------------------------------------------------------------------------*/
 static void
 isolate_pages(coffee_page_t start, coffee_page_t skip_pages)
@@ -362,31 +669,139 @@ isolate_pages(coffee_page_t start, coffee_page_t skip_pages)
 
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_FREE_MAP
+#define MAP_ACTIVE		0
+#define MAP_OBSOLETE		1
+#define MAP_RESERVE		2
+#define MAP_REMOVE		3
+
 static void
+map_extent(coffee_page_t page, coffee_page_t count, int op)
+{
+  struct sector_status *stats;
+  coffee_page_t sector_end, n;
+  int first;
+
+  for(first = 1; count > 0 && page < COFFEE_PAGE_COUNT; first = 0) {
+    stats = &sector_map[page / COFFEE_PAGES_PER_SECTOR];
+    sector_end = (page / COFFEE_PAGES_PER_SECTOR + 1) * COFFEE_PAGES_PER_SECTOR;
+    n = sector_end - page < count ? sector_end - page : count;
+    if(!first) {
+      stats->carry = n;
+    }
+
+    switch(op) {
+    case MAP_ACTIVE:
+      stats->active += n;
+      break;
+    case MAP_OBSOLETE:
+      stats->obsolete += n;
+      break;
+    case MAP_RESERVE:
+      stats->free -= n;
+      stats->active += n;
+      break;
+    case MAP_REMOVE:
+      stats->active -= n;
+      stats->obsolete += n;
+      break;
+    }
+
+    page += n;
+    count -= n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+map_build(void)
+{
+  struct file_header hdr;
+  coffee_page_t page, sector_end;
+
+  memset(sector_map, 0, sizeof(protected_mem.sector_map));
+
+  /* Walk the extents like next_file() does. */
+  for(page = 0; page < COFFEE_PAGE_COUNT;) {
+    read_header(&hdr, page);
+    if(HDR_FREE(hdr)) {
+      sector_end = (page / COFFEE_PAGES_PER_SECTOR + 1) *
+        COFFEE_PAGES_PER_SECTOR;
+      sector_map[page / COFFEE_PAGES_PER_SECTOR].free = sector_end - page;
+      page = sector_end;
+    } else if(HDR_ISOLATED(hdr) || hdr.max_pages <= 0) {
+      map_extent(page, 1, MAP_OBSOLETE);
+      page++;
+    } else {
+      map_extent(page, hdr.max_pages,
+                 HDR_ACTIVE(hdr) ? MAP_ACTIVE : MAP_OBSOLETE);
+      page += hdr.max_pages;
+    }
+  }
+  *map_valid = 1;
+}
+#endif /* COFFEE_FREE_MAP */
+/*---------------------------------------------------------------------------*/
+static int
 collect_garbage(int mode)
 {
   uint16_t sector;
   struct sector_status stats;
-  coffee_page_t first_page, isolation_count;
+  coffee_page_t first_page, isolation_count, carry;
+  int erased_previous;
+  int erased;
+
+#if COFFEE_FREE_MAP
+  if(!*map_valid) {
+    map_build();
+  }
+#endif
+  erased = 0;
 
   PRINTF("Coffee: Running the file system garbage collector in %s mode\n",
-	 mode == GC_RELUCTANT ? "reluctant" : "greedy");
+	 mode == GC_RELUCTANT ? "reluctant" :
+	 mode == GC_STEP ? "step" : "greedy");
   /*
    * The garbage collector erases as many sectors as possible. A sector is
    * erasable if there are only free or obsolete pages in it.
    */
+  erased_previous = 0;
   for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
+#if COFFEE_FREE_MAP
+    /*
+     * Like get_sector_status(), isolate the pages in the next sector
+     * of an extent starting here only if the extent ends in that
+     * sector. The map is built again after the collection.
+     */
+    stats = sector_map[sector];
+    isolation_count = 0;
+    if(sector + 1 < COFFEE_SECTOR_COUNT &&
+       sector_map[sector + 1].carry < COFFEE_PAGES_PER_SECTOR) {
+      isolation_count = sector_map[sector + 1].carry;
+    }
+#else
     isolation_count = get_sector_status(sector, &stats);
+#endif
     PRINTF("Coffee: Sector %u has %u active, %u obsolete, and %u free pages.\n",
         sector, (unsigned)stats.active,
 	(unsigned)stats.obsolete, (unsigned)stats.free);
 
     if(stats.active > 0) {
+      erased_previous = 0;
       continue;
     }
 
-    if((mode == GC_RELUCTANT && stats.free == 0) ||
-       (mode == GC_GREEDY && stats.obsolete > 0)) {
+    /*
+     * The sector may start with the end of an obsolete extent whose
+     * header is in the previous sector. If that sector stays, the
+     * extent must stay allocated: its pages here are isolated after
+     * the erase, and a sector that it covers is not worth erasing.
+     */
+    carry = erased_previous ? 0 : stats.carry;
+    erased_previous = 0;
+
+    if(carry < COFFEE_PAGES_PER_SECTOR &&
+       ((mode == GC_RELUCTANT && stats.free == 0) ||
+        (mode != GC_RELUCTANT && stats.obsolete > carry))) {
       first_page = sector * COFFEE_PAGES_PER_SECTOR;
       if(first_page < *next_free) {
         *next_free = first_page;
@@ -396,14 +811,41 @@ collect_garbage(int mode)
         isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, isolation_count);
       }
 
-      COFFEE_ERASE(sector);
+      IO_ERASE(sector);
       PRINTF("Coffee: Erased sector %d!\n", sector);
+      erased_previous = 1;
+      erased++;
 
-      if(mode == GC_RELUCTANT && isolation_count > 0) {
+      if(carry > 0) {
+        isolate_pages(first_page, carry);
+      }
+
+      if(mode == GC_STEP ||
+         (mode == GC_RELUCTANT && isolation_count > 0)) {
         break;
       }
     }
   }
+
+#if COFFEE_FREE_MAP
+  if(erased) {
+    *map_valid = 0;
+  }
+#endif
+  return erased;
+}
+/*---------------------------------------------------------------------------*/
+static void
+note_stall(clock_time_t start, int erased)
+{
+  clock_time_t stall;
+
+  stall = clock_time() - start;
+  gc_stats.stalls++;
+  gc_stats.stall_erases += erased;
+  if(stall > gc_stats.longest_stall) {
+    gc_stats.longest_stall = stall;
+  }
 }
 /*---------------------------------------------------------------------------*/
 static coffee_page_t
@@ -463,18 +905,135 @@ load_file(coffee_page_t start, struct file_header *hdr)
   if(HDR_MODIFIED(*hdr)) {
     file->flags |= COFFEE_FILE_MODIFIED;
   }
+  file->eof_hint = hdr->eof_hint;
   /* We don't know the amount of records yet. */
   file->record_count = -1;
 
   return file;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_INDEX_SIZE > 0
+static uint8_t
+index_hash(const char *name)
+{
+  uint8_t hash;
+  int i;
+
+  /* Only the part of the name that fits in a file header counts. */
+  hash = 0;
+  for(i = 0; i < COFFEE_NAME_LENGTH - 1 && name[i] != '\0'; i++) {
+    hash = (uint8_t)((hash << 3) | (hash >> 5)) ^ name[i];
+  }
+  return hash;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_add(const char *name, coffee_page_t page)
+{
+  if(file_index->state == INDEX_UNBUILT) {
+    /* The file will be found when the index is built. */
+    return;
+  }
+
+  if(file_index->count == COFFEE_INDEX_SIZE) {
+    file_index->state = INDEX_PARTIAL;
+    return;
+  }
+  file_index->hash[file_index->count] = index_hash(name);
+  file_index->page[file_index->count] = page;
+  file_index->count++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_remove(coffee_page_t page)
+{
+  int i;
+
+  for(i = 0; i < file_index->count; i++) {
+    if(file_index->page[i] == page) {
+      file_index->count--;
+      file_index->page[i] = file_index->page[file_index->count];
+      file_index->hash[i] = file_index->hash[file_index->count];
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_build(void)
+{
+  struct file_header hdr;
+  coffee_page_t page;
+
+  file_index->count = 0;
+  file_index->state = INDEX_COMPLETE;
+  for(page = 0; page < COFFEE_PAGE_COUNT; page = next_file(page, &hdr)) {
+    read_header(&hdr, page);
+    if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr)) {
+      index_add(hdr.name, page);
+    }
+  }
+  PRINTF("Coffee: Indexed %u files%s\n", (unsigned)file_index->count,
+         file_index->state == INDEX_PARTIAL ? " (index full)" : "");
+}
+/*---------------------------------------------------------------------------*/
+static struct file *
+index_find(const char *name)
+{
+  struct file_header hdr;
+  uint8_t hash;
+  int i, j;
+
+  /*
+   * The index is built on the first lookup. A partial index is built
+   * again once there is room for more files, since a lookup that
+   * misses would otherwise have to scan the storage.
+   */
+  if(file_index->state == INDEX_UNBUILT ||
+     (file_index->state == INDEX_PARTIAL &&
+      file_index->count < COFFEE_INDEX_SIZE)) {
+    index_build();
+  }
+
+  hash = index_hash(name);
+  for(i = 0; i < file_index->count; i++) {
+    if(file_index->hash[i] != hash) {
+      continue;
+    }
+    /* Different names may have the same hash. */
+    read_header(&hdr, file_index->page[i]);
+    if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr) && strcmp(name, hdr.name) == 0) {
+      for(j = 0; j < COFFEE_MAX_OPEN_FILES; j++) {
+        if(!FILE_FREE(&coffee_files[j]) &&
+           coffee_files[j].page == file_index->page[i]) {
+          return &coffee_files[j];
+        }
+      }
+      return load_file(file_index->page[i], &hdr);
+    }
+  }
+
+  return NULL;
+}
+#endif /* COFFEE_INDEX_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
 static struct file *
 find_file(const char *name)
 {
   int i;
   struct file_header hdr;
   coffee_page_t page;
+
+#if COFFEE_INDEX_SIZE > 0
+  {
+    struct file *file;
+
+    file = index_find(name);
+    if(file != NULL || file_index->state == INDEX_COMPLETE) {
+      return file;
+    }
+  }
+#endif /* COFFEE_INDEX_SIZE > 0 */
   
   /* First check if the file metadata is cached. */
   for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
@@ -499,6 +1058,51 @@ find_file(const char *name)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* The size of the data area of a file. */
+static uint32_t
+file_space(coffee_page_t max_pages)
+{
+  return (uint32_t)max_pages * COFFEE_PAGE_SIZE - sizeof(struct file_header);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The end of file hint in the header has a bit set for every eighth
+ * of the data area that has been written to. Bits are only ever set,
+ * which is what flash memory allows without an erase.
+ */
+static uint8_t
+eof_hint_bit(coffee_page_t max_pages, cfs_offset_t end)
+{
+  uint32_t eighth;
+
+  if(end <= 0) {
+    return 0;
+  }
+  eighth = (uint32_t)(end - 1) * 8 / file_space(max_pages);
+  return 1 << (eighth > 7 ? 7 : eighth);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Mark the eighth that will hold the byte before end. This is done
+ * before the data is written, so that a reset in between never leaves
+ * data after the highest eighth in the hint.
+ */
+static void
+update_eof_hint(struct file *file, cfs_offset_t end)
+{
+  struct file_header hdr;
+  uint8_t bit;
+
+  /* This writes the header at most eight times over the file's life. */
+  bit = eof_hint_bit(file->max_pages, end);
+  if(bit != 0 && !(file->eof_hint & bit)) {
+    read_header(&hdr, file->page);
+    hdr.eof_hint |= bit;
+    write_header(&hdr, file->page);
+    file->eof_hint = hdr.eof_hint;
+  }
+}
+/*---------------------------------------------------------------------------*/
 static cfs_offset_t
 file_end(coffee_page_t start)
 {
@@ -517,8 +1121,19 @@ file_end(coffee_page_t start)
    * are zeroes, then these are skipped from the calculation.
    */
 
-  for(page = hdr.max_pages - 1; page >= 0; page--) {
-    COFFEE_READ(buf, sizeof(buf), (start + page) * COFFEE_PAGE_SIZE);
+  page = hdr.max_pages - 1;
+  if(hdr.eof_hint != 0) {
+    /* Nothing has been written after the highest eighth in the hint. */
+    for(i = 7; !(hdr.eof_hint & (1 << i)); i--);
+    page = (sizeof(hdr) + ((i + 1) * file_space(hdr.max_pages) - 1) / 8) /
+      COFFEE_PAGE_SIZE;
+    if(page > hdr.max_pages - 1) {
+      page = hdr.max_pages - 1;
+    }
+  }
+
+  for(; page >= 0; page--) {
+    IO_READ(buf, sizeof(buf), (start + page) * COFFEE_PAGE_SIZE);
     for(i = COFFEE_PAGE_SIZE - 1; i >= 0; i--) {
       if(buf[i] != 0) {
 	if(page == 0 && i < sizeof(hdr)) {
@@ -533,6 +1148,41 @@ file_end(coffee_page_t start)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_FREE_MAP
+static coffee_page_t
+find_contiguous_pages(coffee_page_t amount)
+{
+  coffee_page_t start, sector_end;
+  uint16_t sector;
+
+  if(!*map_valid) {
+    map_build();
+  }
+
+  /* The free pages of a sector are at its end. A free extent goes on
+     into the following sectors as long as they are entirely free. */
+  start = INVALID_PAGE;
+  for(sector = *next_free / COFFEE_PAGES_PER_SECTOR;
+      sector < COFFEE_SECTOR_COUNT; sector++) {
+    sector_end = (sector + 1) * COFFEE_PAGES_PER_SECTOR;
+    if(sector_map[sector].free == 0) {
+      start = INVALID_PAGE;
+      continue;
+    }
+    if(start == INVALID_PAGE ||
+       sector_map[sector].free < COFFEE_PAGES_PER_SECTOR) {
+      start = sector_end - sector_map[sector].free;
+    }
+    if(sector_end - start >= amount) {
+      if(start == *next_free) {
+        *next_free = start + amount;
+      }
+      return start;
+    }
+  }
+  return INVALID_PAGE;
+}
+#else /* COFFEE_FREE_MAP */
 static coffee_page_t
 find_contiguous_pages(coffee_page_t amount)
 {
@@ -568,6 +1218,7 @@ find_contiguous_pages(coffee_page_t amount)
   }
   return INVALID_PAGE;
 }
+#endif /* COFFEE_FREE_MAP */
 /*---------------------------------------------------------------------------*/
 static int
 remove_by_page(coffee_page_t page, int remove_log, int close_fds,
@@ -575,6 +1226,10 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
 {
   struct file_header hdr;
   int i;
+#if !COFFEE_EXTENDED_WEAR_LEVELLING
+  clock_time_t start;
+  int erased;
+#endif
 
   read_header(&hdr, page);
   if(!HDR_ACTIVE(hdr)) {
@@ -589,6 +1244,14 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
 
   hdr.flags |= HDR_FLAG_OBSOLETE;
   write_header(&hdr, page);
+#if COFFEE_INDEX_SIZE > 0
+  index_remove(page);
+#endif
+#if COFFEE_FREE_MAP
+  if(*map_valid) {
+    map_extent(page, hdr.max_pages, MAP_REMOVE);
+  }
+#endif
 
   *gc_wait = 0;
 
@@ -609,9 +1272,20 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
     }
   }
 
+#if COFFEE_BACKGROUND_GC
+  if(gc_watermark > 0) {
+    /* The process erases the sector if the space is needed. */
+    process_poll(&coffee_gc_process);
+    return 0;
+  }
+#endif
 #if !COFFEE_EXTENDED_WEAR_LEVELLING
   if(gc_allowed) {
-    collect_garbage(GC_RELUCTANT);
+    start = clock_time();
+    erased = collect_garbage(GC_RELUCTANT);
+    if(erased > 0) {
+      note_stall(start, erased);
+    }
   }
 #endif
 
@@ -632,6 +1306,7 @@ reserve(const char *name, coffee_page_t pages,
   struct file_header hdr;
   coffee_page_t page;
   struct file *file;
+  clock_time_t start;
 
   if(!allow_duplicates && find_file(name) != NULL) {
     return NULL;
@@ -642,7 +1317,8 @@ reserve(const char *name, coffee_page_t pages,
     if(*gc_wait) {
       return NULL;
     }
-    collect_garbage(GC_GREEDY);
+    start = clock_time();
+    note_stall(start, collect_garbage(GC_GREEDY));
     page = find_contiguous_pages(pages);
     if(page == INVALID_PAGE) {
       *gc_wait = 1;
@@ -655,6 +1331,14 @@ reserve(const char *name, coffee_page_t pages,
   hdr.max_pages = pages;
   hdr.flags = HDR_FLAG_ALLOCATED | flags;
   write_header(&hdr, page);
+#if COFFEE_INDEX_SIZE > 0
+  if(!(flags & HDR_FLAG_LOG)) {
+    index_add(hdr.name, page);
+  }
+#endif
+#if COFFEE_FREE_MAP
+  map_extent(page, pages, MAP_RESERVE);
+#endif
 
   PRINTF("Coffee: Reserved %u pages starting from %u for file %s\n",
       pages, page, name);
@@ -664,6 +1348,12 @@ reserve(const char *name, coffee_page_t pages,
     file->end = 0;
   }
 
+#if COFFEE_BACKGROUND_GC
+  if(gc_watermark > 0) {
+    process_poll(&coffee_gc_process);
+  }
+#endif
+
   return file;
 }
 /*---------------------------------------------------------------------------*/
@@ -722,7 +1412,7 @@ get_record_index(coffee_page_t log_page, uint16_t search_records,
     }
 
     base -= batch_size * sizeof(indices[0]);
-    COFFEE_READ(&indices, sizeof(indices[0]) * batch_size, base);
+    IO_READ(&indices, sizeof(indices[0]) * batch_size, base);
 
     for(i = batch_size - 1; i >= 0; i--) {
       if(indices[i] - 1 == region) {
@@ -763,7 +1453,7 @@ read_log_page(struct file_header *hdr, int16_t record_count,
   base = absolute_offset(hdr->log_page, log_records * sizeof(region));
   base += (cfs_offset_t)match_index * log_record_size;
   base += lp->offset;
-  COFFEE_READ(lp->buf, lp->size, base);
+  IO_READ(lp->buf, lp->size, base);
 
   return lp->size;
 }
@@ -833,7 +1523,7 @@ merge_log(coffee_page_t file_page, int extend)
       cfs_close(fd);
       return -1;
     } else if(n > 0) {
-      COFFEE_WRITE(buf, n, absolute_offset(new_file->page, offset));
+      IO_WRITE(buf, n, absolute_offset(new_file->page, offset));
       offset += n;
     }
   } while(n != 0);
@@ -856,10 +1546,12 @@ merge_log(coffee_page_t file_page, int extend)
   read_header(&hdr2, new_file->page);
   hdr2.log_record_size = hdr.log_record_size;
   hdr2.log_records = hdr.log_records;
+  hdr2.eof_hint = eof_hint_bit(hdr2.max_pages, offset);
   write_header(&hdr2, new_file->page);
 
   new_file->flags &= ~COFFEE_FILE_MODIFIED;
   new_file->end = offset;
+  new_file->eof_hint = hdr2.eof_hint;
 
   cfs_close(fd);
 
@@ -890,7 +1582,7 @@ find_next_record(struct file *file, coffee_page_t log_page,
       batch_size = log_records - processed >= preferred_batch_size ?
 	preferred_batch_size : log_records - processed;
 
-      COFFEE_READ(&indices, batch_size * sizeof(indices[0]),
+      IO_READ(&indices, batch_size * sizeof(indices[0]),
 		  absolute_offset(log_page, processed * sizeof(indices[0])));
       for(log_record = 0; log_record < batch_size; log_record++) {
 	if(indices[log_record] == 0) {
@@ -917,6 +1609,7 @@ write_log_page(struct file *file, struct log_param *lp)
   uint16_t log_records;
   cfs_offset_t offset;
   struct log_param lp_out;
+  clock_time_t start;
 
   read_header(&hdr, file->page);
 
@@ -931,7 +1624,10 @@ write_log_page(struct file *file, struct log_param *lp)
     if(log_record >= log_records) {
       /* The log is full; merge the log. */
       PRINTF("Coffee: Merging the file %s with its log\n", hdr.name);
-      return merge_log(file->page, 0);
+      start = clock_time();
+      log_record = merge_log(file->page, 0);
+      note_stall(start, 0);
+      return log_record;
     }
   } else {
     /* Create a log structure. */
@@ -954,7 +1650,7 @@ write_log_page(struct file *file, struct log_param *lp)
 
     if((lp->offset > 0 || lp->size != log_record_size) &&
 	read_log_page(&hdr, log_record, &lp_out) < 0) {
-      COFFEE_READ(copy_buf, sizeof(copy_buf),
+      IO_READ(copy_buf, sizeof(copy_buf),
 	  absolute_offset(file->page, offset));
     }
 
@@ -966,11 +1662,11 @@ write_log_page(struct file *file, struct log_param *lp)
      */
     offset = absolute_offset(log_page, 0);
     ++region;
-    COFFEE_WRITE(&region, sizeof(region),
+    IO_WRITE(&region, sizeof(region),
 		 offset + log_record * sizeof(region));
 
     offset += log_records * sizeof(region);
-    COFFEE_WRITE(copy_buf, sizeof(copy_buf),
+    IO_WRITE(copy_buf, sizeof(copy_buf),
 		 offset + log_record * log_record_size);
     file->record_count = log_record + 1;
   }
@@ -1035,6 +1731,7 @@ cfs_close(int fd)
     coffee_fd_set[fd].flags = COFFEE_FD_FREE;
     coffee_fd_set[fd].file->references--;
     coffee_fd_set[fd].file = NULL;
+    cfs_coffee_sync();
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -1113,7 +1810,7 @@ cfs_read(int fd, void *buf, unsigned size)
 
   /* If the file is allocated, read directly in the file. */
   if(!FILE_MODIFIED(file)) {
-    COFFEE_READ(buf, size, absolute_offset(file->page, fdp->offset));
+    IO_READ(buf, size, absolute_offset(file->page, fdp->offset));
     fdp->offset += size;
     return size;
   }
@@ -1135,7 +1832,7 @@ cfs_read(int fd, void *buf, unsigned size)
 
     /* Read from the original file if we cannot find the data in the log. */
     if(r < 0) {
-      COFFEE_READ(buf, lp.size, absolute_offset(file->page, fdp->offset));
+      IO_READ(buf, lp.size, absolute_offset(file->page, fdp->offset));
       r = lp.size;
     }
     fdp->offset += r;
@@ -1151,6 +1848,7 @@ cfs_write(int fd, const void *buf, unsigned size)
 {
   struct file_desc *fdp;
   struct file *file;
+  clock_time_t start;
 #if COFFEE_MICRO_LOGS
   int i;
   struct log_param lp;
@@ -1171,9 +1869,11 @@ cfs_write(int fd, const void *buf, unsigned size)
 #endif
   while(size + fdp->offset + sizeof(struct file_header) >
      (file->max_pages * COFFEE_PAGE_SIZE)) {
+    start = clock_time();
     if(merge_log(file->page, 1) < 0) {
       return -1;
     }
+    note_stall(start, 0);
     file = fdp->file;
     PRINTF("Extended the file at page %u\n", (unsigned)file->page);
   }
@@ -1218,7 +1918,8 @@ cfs_write(int fd, const void *buf, unsigned size)
 
     if(fdp->offset > file->end) {
       /* Update the original file's end with a dummy write. */
-      COFFEE_WRITE(dummy, 1, absolute_offset(file->page, fdp->offset));
+      update_eof_hint(file, fdp->offset + 1);
+      IO_WRITE(dummy, 1, absolute_offset(file->page, fdp->offset));
     }
   } else {
 #endif /* COFFEE_MICRO_LOGS */
@@ -1228,7 +1929,8 @@ cfs_write(int fd, const void *buf, unsigned size)
     }
 #endif /* COFFEE_APPEND_ONLY */
 
-    COFFEE_WRITE(buf, size, absolute_offset(file->page, fdp->offset));
+    update_eof_hint(file, fdp->offset + size);
+    IO_WRITE(buf, size, absolute_offset(file->page, fdp->offset));
     fdp->offset += size;
 #if COFFEE_MICRO_LOGS
   }
@@ -1344,7 +2046,7 @@ cfs_coffee_format(void)
   *next_free = 0;
 
   for(i = 0; i < COFFEE_SECTOR_COUNT; i++) {
-    COFFEE_ERASE(i);
+    IO_ERASE(i);
     PRINTF(".");
   }
 
@@ -1362,3 +2064,140 @@ cfs_coffee_get_protected_mem(unsigned *size)
   *size = sizeof(protected_mem);
   return &protected_mem;
 }
+/*---------------------------------------------------------------------------*/
+void
+cfs_coffee_sync(void)
+{
+#if COFFEE_PAGE_CACHE > 0
+  cache_flush();
+#endif
+}
+/*---------------------------------------------------------------------------*/
+const struct cfs_coffee_gc_stats *
+cfs_coffee_get_gc_stats(void)
+{
+  return &gc_stats;
+}
+/*---------------------------------------------------------------------------*/
+#if COFFEE_BACKGROUND_GC
+static coffee_page_t
+free_pages(void)
+{
+  coffee_page_t free;
+  uint16_t sector;
+#if COFFEE_FREE_MAP
+  if(!*map_valid) {
+    map_build();
+  }
+#else
+  struct sector_status stats;
+#endif
+
+  free = 0;
+  for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
+#if COFFEE_FREE_MAP
+    free += sector_map[sector].free;
+#else
+    get_sector_status(sector, &stats);
+    free += stats.free;
+#endif
+  }
+  return free;
+}
+/*---------------------------------------------------------------------------*/
+#if COFFEE_MICRO_LOGS
+/* Merge the first open file whose log is at least three quarters full. */
+static int
+merge_full_log(void)
+{
+  struct file_header hdr;
+  struct file *file;
+  uint16_t log_record_size;
+  uint16_t log_records;
+
+  for(file = coffee_files; file < &coffee_files[COFFEE_MAX_OPEN_FILES];
+      file++) {
+    if(file->page == INVALID_PAGE || file->references == 0 ||
+       !FILE_MODIFIED(file)) {
+      continue;
+    }
+    read_header(&hdr, file->page);
+    if(!HDR_MODIFIED(hdr)) {
+      continue;
+    }
+    adjust_log_config(&hdr, &log_record_size, &log_records);
+    if(find_next_record(file, hdr.log_page, log_records) <
+       log_records - log_records / 4) {
+      continue;
+    }
+    PRINTF("Coffee: Merging the log of %s in the background\n", hdr.name);
+    return merge_log(file->page, 0) == 0;
+  }
+  return 0;
+}
+#endif /* COFFEE_MICRO_LOGS */
+/*---------------------------------------------------------------------------*/
+/* Do one bounded piece of work; return 1 if there may be more to do. */
+static int
+gc_step(void)
+{
+#if COFFEE_MICRO_LOGS
+  if(merge_full_log()) {
+    gc_stats.background_merges++;
+    return 1;
+  }
+#endif
+  if(gc_watermark > 0 && free_pages() < gc_watermark &&
+     collect_garbage(GC_STEP) > 0) {
+    gc_stats.background_erases++;
+    /* A writer that found no space may try again. */
+    *gc_wait = 0;
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_gc_process, ev, data)
+{
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&et, COFFEE_GC_INTERVAL);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || etimer_expired(&et));
+    if(etimer_expired(&et)) {
+      etimer_reset(&et);
+    }
+    /* Let the other processes run between the erases. */
+    while(gc_step()) {
+      PROCESS_PAUSE();
+    }
+  }
+
+  PROCESS_END();
+}
+#endif /* COFFEE_BACKGROUND_GC */
+/*---------------------------------------------------------------------------*/
+int
+cfs_coffee_set_gc_watermark(unsigned long free_bytes)
+{
+#if COFFEE_BACKGROUND_GC
+  unsigned long pages;
+
+  pages = (free_bytes + COFFEE_PAGE_SIZE - 1) / COFFEE_PAGE_SIZE;
+  if(pages > COFFEE_PAGE_COUNT) {
+    pages = COFFEE_PAGE_COUNT;
+  }
+  gc_watermark = pages;
+  if(gc_watermark > 0) {
+    if(!process_is_running(&coffee_gc_process)) {
+      process_start(&coffee_gc_process, NULL);
+    }
+    process_poll(&coffee_gc_process);
+  }
+  return 0;
+#else
+  return -1;
+#endif
+}
@@ -39,6 +39,7 @@
 #define CFS_COFFEE_H
 
 #include "cfs.h"
+#include "sys/clock.h"
 
 /**
  * Instruct Coffee that the access pattern to this file is adapted to 
@@ -63,6 +64,27 @@
  */
 #define CFS_COFFEE_IO_FIRM_SIZE		0x2
 
+/**
+ * Garbage collection statistics.
+ *
+ * A stall is a garbage collection or a log merge that ran inside a
+ * file system call, so that the caller had to wait for it.
+ *
+ * \sa cfs_coffee_get_gc_stats()
+ */
+struct cfs_coffee_gc_stats {
+  /** Collections and log merges that a caller waited for. */
+  uint16_t stalls;
+  /** Sectors erased while a caller waited. */
+  uint16_t stall_erases;
+  /** Sectors erased by the background process. */
+  uint16_t background_erases;
+  /** Logs merged by the background process. */
+  uint16_t background_merges;
+  /** The longest stall, in clock ticks. */
+  clock_time_t longest_stall;
+};
+
 /**
  * \file
  *	Header for the Coffee file system.
@@ -138,6 +160,37 @@ int cfs_coffee_format(void);
  */
 void *cfs_coffee_get_protected_mem(unsigned *size);
 
+/**
+ * \brief Write the cached data to the storage.
+ *
+ * When COFFEE_PAGE_CACHE is set, the data of cfs_write() may stay in
+ * RAM until the file is closed, until a file header is written, or
+ * until its page is evicted from the cache, and a reset loses it.
+ * Applications that keep files open, such as loggers, call this
+ * function when their data must survive a reset. Without the cache,
+ * it does nothing.
+ */
+void cfs_coffee_sync(void);
+
+/**
+ * \brief Keep free space ready for writers.
+ * \param free_bytes The free space to keep, or 0 to stop.
+ * \return 0 on success, -1 if background collection is not compiled in.
+ *
+ * When COFFEE_BACKGROUND_GC is set, a process erases obsolete sectors
+ * one at a time while the free space is below the watermark, and
+ * merges micro logs before they fill up. Other processes run between
+ * the steps, and writers rarely have to wait for the synchronous
+ * garbage collection.
+ */
+int cfs_coffee_set_gc_watermark(unsigned long free_bytes);
+
+/**
+ * \brief Get the garbage collection statistics.
+ * \return A pointer to the statistics.
+ */
+const struct cfs_coffee_gc_stats *cfs_coffee_get_gc_stats(void);
+
 /** @} */
 /** @} */
 
@@ -48,6 +48,7 @@
 #include "net/netstack.h"
 #include "net/rime.h"
 #include "sys/compower.h"
+#include "sys/ctimer.h"
 #include "sys/pt.h"
 #include "sys/rtimer.h"
 
@@ -89,8 +90,28 @@
 #define WITH_PHASE_OPTIMIZATION 0
 #endif
 
+/* Check the channel more often when the traffic load is high. The
+   rate is advertised to neighbors in the ContikiMAC header. */
+#ifdef CONTIKIMAC_CONF_ADAPTIVE_CYCLE
+#define ADAPTIVE_CYCLE               CONTIKIMAC_CONF_ADAPTIVE_CYCLE
+#else
+#define ADAPTIVE_CYCLE               0
+#endif
+
+#if ADAPTIVE_CYCLE && !WITH_CONTIKIMAC_HEADER
+#error CONTIKIMAC_CONF_ADAPTIVE_CYCLE needs CONTIKIMAC_CONF_WITH_CONTIKIMAC_HEADER
+#endif
+
 #if WITH_CONTIKIMAC_HEADER
+/* The low nibble of the id byte identifies the header. The high
+   nibble carries the channel check rate of the sender, as a shift
+   of NETSTACK_RDC_CHANNEL_CHECK_RATE. Nodes running a ContikiMAC
+   that compares the whole id byte drop the frames of a node with
+   ADAPTIVE_CYCLE whenever it checks faster than the base rate, so
+   all nodes of a network must know about the shift. */
 #define CONTIKIMAC_ID 0x00
+#define CONTIKIMAC_ID_MASK 0x0f
+#define CONTIKIMAC_ID_SHIFT_POS 4
 
 struct hdr {
   uint8_t id;
@@ -116,6 +137,74 @@ struct hdr {
 #define SYNC_CYCLE_STARTS                    1
 #endif
 
+#if ADAPTIVE_CYCLE
+/* At most 2^MAX_CYCLE_SHIFT channel checks per CYCLE_TIME */
+#ifdef CONTIKIMAC_CONF_MAX_CYCLE_SHIFT
+#define MAX_CYCLE_SHIFT                      CONTIKIMAC_CONF_MAX_CYCLE_SHIFT
+#else
+#define MAX_CYCLE_SHIFT                      2
+#endif
+
+/* The load is measured over ADAPT_INTERVAL: the number of packets
+   received plus the longest packet list given to us for sending. */
+#ifdef CONTIKIMAC_CONF_ADAPT_INTERVAL
+#define ADAPT_INTERVAL                       CONTIKIMAC_CONF_ADAPT_INTERVAL
+#else
+#define ADAPT_INTERVAL                       CLOCK_SECOND
+#endif
+
+/* A load of at least ADAPT_UP_LOAD doubles the channel check rate,
+   a load of at most ADAPT_DOWN_LOAD halves it. */
+#ifdef CONTIKIMAC_CONF_ADAPT_UP_LOAD
+#define ADAPT_UP_LOAD                        CONTIKIMAC_CONF_ADAPT_UP_LOAD
+#else
+#define ADAPT_UP_LOAD                        4
+#endif
+
+#ifdef CONTIKIMAC_CONF_ADAPT_DOWN_LOAD
+#define ADAPT_DOWN_LOAD                      CONTIKIMAC_CONF_ADAPT_DOWN_LOAD
+#else
+#define ADAPT_DOWN_LOAD                      1
+#endif
+
+/* Neighbors only hear of a slowdown with our next packet. The rate
+   is therefore lowered in two steps: the lower rate is advertised
+   first, and taken once ADAPT_HOLD_TIME has passed since the higher
+   one was last advertised. Neighbors count on an advertised rate
+   for half that time. */
+#ifdef CONTIKIMAC_CONF_ADAPT_HOLD_TIME
+#define ADAPT_HOLD_TIME                      CONTIKIMAC_CONF_ADAPT_HOLD_TIME
+#else
+#define ADAPT_HOLD_TIME                      (8 * ADAPT_INTERVAL)
+#endif
+
+#if MAX_CYCLE_SHIFT > 15
+#error CONTIKIMAC_CONF_MAX_CYCLE_SHIFT must fit in the ContikiMAC header
+#endif
+
+#if SYNC_CYCLE_STARTS && (NETSTACK_RDC_CHANNEL_CHECK_RATE << MAX_CYCLE_SHIFT) > 255
+#error CONTIKIMAC_CONF_MAX_CYCLE_SHIFT is too large for this channel check rate
+#endif
+
+/* The channel is checked 2^cycle_shift times per CYCLE_TIME. The
+   shift only changes where a CYCLE_TIME starts, so the checks of the
+   base rate stay where neighbors with an old phase expect them. */
+static volatile uint8_t cycle_shift;
+static volatile uint8_t next_cycle_shift;
+static uint8_t load_received;
+static uint8_t load_queued;
+static struct ctimer adapt_timer;
+static uint8_t lower_cycle_shift = MAX_CYCLE_SHIFT;
+/* Expires ADAPT_HOLD_TIME after each shift was last advertised */
+static struct timer advertised[MAX_CYCLE_SHIFT + 1];
+#define CURRENT_CYCLE_TIME                   (CYCLE_TIME >> cycle_shift)
+#define CURRENT_CHECK_RATE                   (NETSTACK_RDC_CHANNEL_CHECK_RATE << cycle_shift)
+#else /* ADAPTIVE_CYCLE */
+#define MAX_CYCLE_SHIFT                      0
+#define CURRENT_CYCLE_TIME                   CYCLE_TIME
+#define CURRENT_CHECK_RATE                   NETSTACK_RDC_CHANNEL_CHECK_RATE
+#endif /* ADAPTIVE_CYCLE */
+
 /* Are we currently receiving a burst? */
 static int we_are_receiving_burst = 0;
 
@@ -251,6 +340,10 @@ static volatile unsigned char radio_is_on = 0;
 static struct compower_activity current_packet;
 #endif /* CONTIKIMAC_CONF_COMPOWER */
 
+#if CONTIKIMAC_STATS
+struct contikimac_stats contikimac_stats;
+#endif /* CONTIKIMAC_STATS */
+
 #if WITH_PHASE_OPTIMIZATION
 
 #include "net/mac/phase.h"
@@ -389,19 +482,32 @@ powercycle(struct rtimer *t, void *ptr)
 #if SYNC_CYCLE_STARTS
     /* Compute cycle start when RTIMER_ARCH_SECOND is not a multiple
        of CHANNEL_CHECK_RATE */
-    if(sync_cycle_phase++ == NETSTACK_RDC_CHANNEL_CHECK_RATE) {
+    if(sync_cycle_phase++ == CURRENT_CHECK_RATE) {
       sync_cycle_phase = 0;
       sync_cycle_start += RTIMER_ARCH_SECOND;
       cycle_start = sync_cycle_start;
+#if ADAPTIVE_CYCLE
+      cycle_shift = next_cycle_shift;
+#endif /* ADAPTIVE_CYCLE */
     } else {
-#if (RTIMER_ARCH_SECOND * NETSTACK_RDC_CHANNEL_CHECK_RATE) > 65535
-      cycle_start = sync_cycle_start + ((unsigned long)(sync_cycle_phase*RTIMER_ARCH_SECOND))/NETSTACK_RDC_CHANNEL_CHECK_RATE;
+#if (RTIMER_ARCH_SECOND * (NETSTACK_RDC_CHANNEL_CHECK_RATE << MAX_CYCLE_SHIFT)) > 65535
+      cycle_start = sync_cycle_start + ((unsigned long)(sync_cycle_phase*RTIMER_ARCH_SECOND))/CURRENT_CHECK_RATE;
 #else
-      cycle_start = sync_cycle_start + (sync_cycle_phase*RTIMER_ARCH_SECOND)/NETSTACK_RDC_CHANNEL_CHECK_RATE;
+      cycle_start = sync_cycle_start + (sync_cycle_phase*RTIMER_ARCH_SECOND)/CURRENT_CHECK_RATE;
 #endif
     }
 #else
-    cycle_start += CYCLE_TIME;
+    cycle_start += CURRENT_CYCLE_TIME;
+#if ADAPTIVE_CYCLE
+    {
+      static uint8_t sub_cycle;
+      if(++sub_cycle >= (1 << cycle_shift)) {
+        /* cycle_start is on a CYCLE_TIME boundary */
+        sub_cycle = 0;
+        cycle_shift = next_cycle_shift;
+      }
+    }
+#endif /* ADAPTIVE_CYCLE */
 #endif
 
     packet_seen = 0;
@@ -485,7 +591,7 @@ powercycle(struct rtimer *t, void *ptr)
       }
     }
 
-    if(RTIMER_CLOCK_LT(RTIMER_NOW() - cycle_start, CYCLE_TIME - CHECK_TIME * 4)) {
+    if(RTIMER_CLOCK_LT(RTIMER_NOW() - cycle_start, CURRENT_CYCLE_TIME - CHECK_TIME * 4)) {
       /* Schedule the next powercycle interrupt, or sleep the mcu
 	 until then.  Sleeping will not exit from this interrupt, so
 	 ensure an occasional wake cycle or foreground processing will
@@ -493,14 +599,14 @@ powercycle(struct rtimer *t, void *ptr)
 #if RDC_CONF_MCU_SLEEP
       static uint8_t sleepcycle;
       if((sleepcycle++ < 16) && !we_are_sending && !radio_is_on) {
-        rtimer_arch_sleep(CYCLE_TIME - (RTIMER_NOW() - cycle_start));
+        rtimer_arch_sleep(CURRENT_CYCLE_TIME - (RTIMER_NOW() - cycle_start));
       } else {
         sleepcycle = 0;
-        schedule_powercycle_fixed(t, CYCLE_TIME + cycle_start);
+        schedule_powercycle_fixed(t, CURRENT_CYCLE_TIME + cycle_start);
         PT_YIELD(&pt);
       }
 #else
-      schedule_powercycle_fixed(t, CYCLE_TIME + cycle_start);
+      schedule_powercycle_fixed(t, CURRENT_CYCLE_TIME + cycle_start);
       PT_YIELD(&pt);
 #endif
     }
@@ -530,6 +636,61 @@ broadcast_rate_drop(void)
 #endif /* CONTIKIMAC_CONF_BROADCAST_RATE_LIMIT */
 }
 /*---------------------------------------------------------------------------*/
+#if ADAPTIVE_CYCLE
+/* Can neighbors still count on a shift of at least shift? */
+static int
+cycle_shift_held(uint8_t shift)
+{
+  for(; shift <= MAX_CYCLE_SHIFT; shift++) {
+    if(!timer_expired(&advertised[shift])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+adapt_cycle(void *ptr)
+{
+  int load;
+
+  load = load_received + load_queued;
+  load_received = 0;
+  load_queued = 0;
+  if(load >= ADAPT_UP_LOAD) {
+    lower_cycle_shift = MAX_CYCLE_SHIFT;
+    if(next_cycle_shift < MAX_CYCLE_SHIFT) {
+      next_cycle_shift++;
+    }
+  } else if(load <= ADAPT_DOWN_LOAD) {
+    if(next_cycle_shift > 0) {
+      lower_cycle_shift = next_cycle_shift - 1;
+      if(!cycle_shift_held(next_cycle_shift)) {
+        next_cycle_shift = lower_cycle_shift;
+      }
+    }
+  }
+  PRINTF("contikimac: load %d, cycle shift %u\n", load, next_cycle_shift);
+  ctimer_reset(&adapt_timer);
+}
+/*---------------------------------------------------------------------------*/
+/* The shift we advertise must hold until the next packet, so it is
+   the lowest of the current, the upcoming and the announced one. We
+   then keep it for ADAPT_HOLD_TIME. */
+static uint8_t
+advertised_cycle_shift(void)
+{
+  uint8_t shift;
+
+  shift = cycle_shift < next_cycle_shift ? cycle_shift : next_cycle_shift;
+  if(lower_cycle_shift < shift) {
+    shift = lower_cycle_shift;
+  }
+  timer_set(&advertised[shift], ADAPT_HOLD_TIME);
+  return shift;
+}
+#endif /* ADAPTIVE_CYCLE */
+/*---------------------------------------------------------------------------*/
 static int
 send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
 	    struct rdc_buf_list *buf_list,
@@ -548,6 +709,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   int ret;
   uint8_t contikimac_was_on;
   uint8_t seqno;
+  rtimer_clock_t strobe_time;
 #if WITH_CONTIKIMAC_HEADER
   struct hdr *chdr;
 #endif /* WITH_CONTIKIMAC_HEADER */
@@ -604,7 +766,11 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
     return MAC_TX_ERR_FATAL;
   }
   chdr = packetbuf_hdrptr();
+#if ADAPTIVE_CYCLE
+  chdr->id = CONTIKIMAC_ID | (advertised_cycle_shift() << CONTIKIMAC_ID_SHIFT_POS);
+#else /* ADAPTIVE_CYCLE */
   chdr->id = CONTIKIMAC_ID;
+#endif /* ADAPTIVE_CYCLE */
   chdr->len = hdrlen;
   
   /* Create the MAC header for the data packet. */
@@ -653,6 +819,16 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   /* Remove the MAC-layer header since it will be recreated next time around. */
   packetbuf_hdr_remove(hdrlen);
 
+  strobe_time = STROBE_TIME;
+#if ADAPTIVE_CYCLE && WITH_PHASE_OPTIMIZATION
+  if(!is_broadcast) {
+    /* A receiver that checks the channel more often needs a shorter
+       strobe to see the packet. */
+    strobe_time = (CYCLE_TIME >> phase_cycle_shift(packetbuf_addr(PACKETBUF_ADDR_RECEIVER))) +
+      2 * CHECK_TIME;
+  }
+#endif /* ADAPTIVE_CYCLE && WITH_PHASE_OPTIMIZATION */
+
   if(!is_broadcast && !is_receiver_awake) {
 #if WITH_PHASE_OPTIMIZATION
     ret = phase_wait(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
@@ -748,7 +924,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   seqno = packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
   for(strobes = 0, collisions = 0;
       got_strobe_ack == 0 && collisions == 0 &&
-      RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + STROBE_TIME); strobes++) {
+      RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + strobe_time); strobes++) {
 
     watchdog_periodic();
 
@@ -812,6 +988,20 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
 
   off();
 
+#if CONTIKIMAC_STATS
+  if(!is_broadcast && !is_receiver_awake) {
+    contikimac_stats.unicasts++;
+    contikimac_stats.strobes += strobes;
+    contikimac_stats.strobe_time += RTIMER_NOW() - t0;
+    if(is_known_receiver) {
+      contikimac_stats.phase_locked++;
+      if(!got_strobe_ack) {
+        contikimac_stats.phase_misses++;
+      }
+    }
+  }
+#endif /* CONTIKIMAC_STATS */
+
   PRINTF("contikimac: send (strobes=%u, len=%u, %s, %s), done\n", strobes,
          packetbuf_totlen(),
          got_strobe_ack ? "ack" : "no ack",
@@ -884,10 +1074,21 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
   if(curr == NULL) {
     return;
   }
+#if ADAPTIVE_CYCLE
+  {
+    uint8_t queued = 0;
+    for(next = buf_list; next != NULL; next = list_item_next(next)) {
+      queued++;
+    }
+    if(queued > load_queued) {
+      load_queued = queued;
+    }
+  }
+#endif /* ADAPTIVE_CYCLE */
   /* Do not send during reception of a burst */
   if(we_are_receiving_burst) {
     /* Prepare the packetbuf for callback */
-    queuebuf_to_packetbuf(curr->buf);
+    queuebuf_to_packetbuf_nocopy(curr->buf);
     /* Return COLLISION so the MAC may try again later */
     mac_call_sent_callback(sent, ptr, MAC_TX_COLLISION, 1);
     return;
@@ -898,7 +1099,7 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
     next = list_item_next(curr);
 
     /* Prepare the packetbuf */
-    queuebuf_to_packetbuf(curr->buf);
+    queuebuf_to_packetbuf_nocopy(curr->buf);
     if(next != NULL) {
       packetbuf_set_attr(PACKETBUF_ATTR_PENDING, 1);
     }
@@ -951,10 +1152,15 @@ input_packet(void)
 #if WITH_CONTIKIMAC_HEADER
     struct hdr *chdr;
     chdr = packetbuf_dataptr();
-    if(chdr->id != CONTIKIMAC_ID) {
+    if((chdr->id & CONTIKIMAC_ID_MASK) != CONTIKIMAC_ID) {
       PRINTF("contikimac: failed to parse hdr (%u)\n", packetbuf_totlen());
       return;
     }
+#if ADAPTIVE_CYCLE && WITH_PHASE_OPTIMIZATION
+    phase_set_cycle_shift(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                          chdr->id >> CONTIKIMAC_ID_SHIFT_POS,
+                          ADAPT_HOLD_TIME / 2);
+#endif /* ADAPTIVE_CYCLE && WITH_PHASE_OPTIMIZATION */
     packetbuf_hdrreduce(sizeof(struct hdr));
     packetbuf_set_datalen(chdr->len);
 #endif /* WITH_CONTIKIMAC_HEADER */
@@ -1002,6 +1208,12 @@ input_packet(void)
                       packetbuf_addr(PACKETBUF_ADDR_SENDER));
       }
 
+#if ADAPTIVE_CYCLE
+      if(load_received < 0xff) {
+        load_received++;
+      }
+#endif /* ADAPTIVE_CYCLE */
+
 #if CONTIKIMAC_CONF_COMPOWER
       /* Accumulate the power consumption for the packet reception. */
       compower_accumulate(&current_packet);
@@ -1042,6 +1254,9 @@ init(void)
   phase_init();
 #endif /* WITH_PHASE_OPTIMIZATION */
 
+#if ADAPTIVE_CYCLE
+  ctimer_set(&adapt_timer, ADAPT_INTERVAL, adapt_cycle, NULL);
+#endif /* ADAPTIVE_CYCLE */
 }
 /*---------------------------------------------------------------------------*/
 static int
@@ -1073,7 +1288,7 @@ turn_off(int keep_radio_on)
 static unsigned short
 duty_cycle(void)
 {
-  return (1ul * CLOCK_SECOND * CYCLE_TIME) / RTIMER_ARCH_SECOND;
+  return (1ul * CLOCK_SECOND * CURRENT_CYCLE_TIME) / RTIMER_ARCH_SECOND;
 }
 /*---------------------------------------------------------------------------*/
 const struct rdc_driver contikimac_driver = {
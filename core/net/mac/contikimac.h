@@ -44,6 +44,25 @@
 #include "net/mac/rdc.h"
 #include "dev/radio.h"
 
+#ifdef CONTIKIMAC_CONF_STATS
+#define CONTIKIMAC_STATS CONTIKIMAC_CONF_STATS
+#else
+#define CONTIKIMAC_STATS 0
+#endif /* CONTIKIMAC_CONF_STATS */
+
+/* Unicast strobe statistics, to compare phase lock settings */
+struct contikimac_stats {
+  uint16_t unicasts;      /* Unicast packets that needed a wake-up strobe */
+  uint16_t phase_locked;  /* Of those, sent to a neighbor with a known phase */
+  uint16_t phase_misses;  /* Phase locked packets that got no ACK */
+  uint32_t strobes;       /* Transmissions in all unicast strobes */
+  uint32_t strobe_time;   /* Radio time in all unicast strobes, in rtimer ticks */
+};
+
+#if CONTIKIMAC_STATS
+extern struct contikimac_stats contikimac_stats;
+#endif /* CONTIKIMAC_STATS */
+
 extern const struct rdc_driver contikimac_driver;
 
 #endif /* CONTIKIMAC_H */
@@ -33,6 +33,12 @@
 /**
  * \file
  *         A Carrier Sense Multiple Access (CSMA) MAC layer
+ *
+ *         Every neighbor has its own packet queue, taken from a small
+ *         pool and found by walking the list of queues. A single timer
+ *         serves the neighbors that have packets in round-robin order,
+ *         one transmission each, so a neighbor with a long queue cannot
+ *         starve the others.
  * \author
  *         Adam Dunkels <adam@sics.se>
  */
@@ -43,6 +49,7 @@
 
 #include "sys/ctimer.h"
 #include "sys/clock.h"
+#include "sys/timer.h"
 
 #include "lib/random.h"
 
@@ -85,30 +92,58 @@ struct qbuf_metadata {
 
 /* Every neighbor has its own packet queue */
 struct neighbor_queue {
+  /* Link in the list of neighbors, in the order they get their turn */
   struct neighbor_queue *next;
   rimeaddr_t addr;
-  struct ctimer transmit_timer;
+  /* The neighbor may not transmit again before this timer expires */
+  struct timer backoff_timer;
   uint8_t transmissions;
   uint8_t collisions, deferrals;
+  /* Set while the head of the queue is with the RDC layer */
+  uint8_t sending;
+#if CSMA_STATS
+  struct csma_stats stats;
+#endif /* CSMA_STATS */
   LIST_STRUCT(queued_packet_list);
 };
 
-/* The maximum number of co-existing neighbor queues */
+#define MAX_QUEUED_PACKETS QUEUEBUF_NUM
+
+/* The maximum number of co-existing neighbor queues. They are kept
+   apart from the shared neighbor table, so that a packet to send
+   never evicts a neighbor that IPv6 or RPL depends on. With one
+   queue per queued packet, a packet is never dropped for want of a
+   queue: an empty queue is reused for a new neighbor. */
 #ifdef CSMA_CONF_MAX_NEIGHBOR_QUEUES
 #define CSMA_MAX_NEIGHBOR_QUEUES CSMA_CONF_MAX_NEIGHBOR_QUEUES
 #else
-#define CSMA_MAX_NEIGHBOR_QUEUES 2
+#define CSMA_MAX_NEIGHBOR_QUEUES MAX_QUEUED_PACKETS
 #endif /* CSMA_CONF_MAX_NEIGHBOR_QUEUES */
 
-#define MAX_QUEUED_PACKETS QUEUEBUF_NUM
+/* The number of packets a single neighbor may hold out of the
+   MAX_QUEUED_PACKETS shared by all neighbors */
+#ifdef CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR
+#define CSMA_MAX_PACKETS_PER_NEIGHBOR CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR
+#else
+#define CSMA_MAX_PACKETS_PER_NEIGHBOR MAX_QUEUED_PACKETS
+#endif /* CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR */
+
 MEMB(neighbor_memb, struct neighbor_queue, CSMA_MAX_NEIGHBOR_QUEUES);
 MEMB(packet_memb, struct rdc_buf_list, MAX_QUEUED_PACKETS);
 MEMB(metadata_memb, struct qbuf_metadata, MAX_QUEUED_PACKETS);
+/* Neighbor queues, in the order they get their turn. Empty queues
+   stay in the list until their entry is needed for another
+   neighbor. */
 LIST(neighbor_list);
+static struct ctimer transmit_timer;
 
 static void packet_sent(void *ptr, int status, int num_transmissions);
-static void transmit_packet_list(void *ptr);
 
+#if CSMA_STATS
+#define CSMA_STATS_ADD(n, x) (n)->stats.x++
+#else /* CSMA_STATS */
+#define CSMA_STATS_ADD(n, x)
+#endif /* CSMA_STATS */
 /*---------------------------------------------------------------------------*/
 static struct neighbor_queue *
 neighbor_queue_from_addr(const rimeaddr_t *addr)
@@ -123,6 +158,32 @@ neighbor_queue_from_addr(const rimeaddr_t *addr)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* Allocate a queue for a neighbor, reusing an empty one if all are
+   taken. */
+static struct neighbor_queue *
+neighbor_queue_add(const rimeaddr_t *addr)
+{
+  struct neighbor_queue *n;
+
+  n = memb_alloc(&neighbor_memb);
+  if(n == NULL) {
+    for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+      if(list_head(n->queued_packet_list) == NULL && !n->sending) {
+        list_remove(neighbor_list, n);
+        break;
+      }
+    }
+    if(n == NULL) {
+      return NULL;
+    }
+  }
+  memset(n, 0, sizeof(struct neighbor_queue));
+  rimeaddr_copy(&n->addr, addr);
+  LIST_STRUCT_INIT(n, queued_packet_list);
+  list_add(neighbor_list, n);
+  return n;
+}
+/*---------------------------------------------------------------------------*/
 static clock_time_t
 default_timebase(void)
 {
@@ -140,21 +201,66 @@ default_timebase(void)
   return time;
 }
 /*---------------------------------------------------------------------------*/
+static void transmit_next(void *ptr);
+
+/* Set the transmit timer for the first neighbor that will be ready
+   to transmit, or stop it if no neighbor has anything to send. */
 static void
-transmit_packet_list(void *ptr)
+schedule_transmission(void)
 {
-  struct neighbor_queue *n = ptr;
-  if(n) {
-    struct rdc_buf_list *q = list_head(n->queued_packet_list);
-    if(q != NULL) {
-      PRINTF("csma: preparing number %d %p, queue len %d\n", n->transmissions, q,
-          list_length(n->queued_packet_list));
-      /* Send packets in the neighbor's list */
-      NETSTACK_RDC.send_list(packet_sent, n, q);
+  struct neighbor_queue *n;
+  clock_time_t remaining;
+  clock_time_t wait = 0;
+  int waiting = 0;
+
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    if(n->sending || list_head(n->queued_packet_list) == NULL) {
+      continue;
     }
+    if(timer_expired(&n->backoff_timer)) {
+      ctimer_set(&transmit_timer, 0, transmit_next, NULL);
+      return;
+    }
+    remaining = timer_remaining(&n->backoff_timer);
+    if(!waiting || remaining < wait) {
+      wait = remaining;
+      waiting = 1;
+    }
+  }
+  if(waiting) {
+    ctimer_set(&transmit_timer, wait, transmit_next, NULL);
+  } else {
+    ctimer_stop(&transmit_timer);
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Give the first ready neighbor with queued packets one transmission
+   and move it to the back of the list. */
+static void
+transmit_next(void *ptr)
+{
+  struct neighbor_queue *n;
+  struct rdc_buf_list *q;
+
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    if(!n->sending && list_head(n->queued_packet_list) != NULL &&
+       timer_expired(&n->backoff_timer)) {
+      break;
+    }
+  }
+  if(n != NULL) {
+    list_remove(neighbor_list, n);
+    list_add(neighbor_list, n);
+    q = list_head(n->queued_packet_list);
+    PRINTF("csma: preparing number %d %p, queue len %d\n", n->transmissions, q,
+        list_length(n->queued_packet_list));
+    n->sending = 1;
+    /* Send packets in the neighbor's list */
+    NETSTACK_RDC.send_list(packet_sent, n, q);
+  }
+  schedule_transmission();
+}
+/*---------------------------------------------------------------------------*/
 static void
 free_packet(struct neighbor_queue *n, struct rdc_buf_list *p)
 {
@@ -172,14 +278,8 @@ free_packet(struct neighbor_queue *n, struct rdc_buf_list *p)
       n->transmissions = 0;
       n->collisions = 0;
       n->deferrals = 0;
-      /* Set a timer for next transmissions */
-      ctimer_set(&n->transmit_timer, default_timebase(),
-                 transmit_packet_list, n);
-    } else {
-      /* This was the last packet in the queue, we free the neighbor */
-      ctimer_stop(&n->transmit_timer);
-      list_remove(neighbor_list, n);
-      memb_free(&neighbor_memb, n);
+      /* Let the neighbor send its next packet a bit later */
+      timer_set(&n->backoff_timer, default_timebase());
     }
   }
 }
@@ -200,6 +300,7 @@ packet_sent(void *ptr, int status, int num_transmissions)
   if(n == NULL) {
     return;
   }
+  n->sending = 0;
   switch(status) {
   case MAC_TX_OK:
   case MAC_TX_NOACK:
@@ -265,28 +366,36 @@ packet_sent(void *ptr, int status, int num_transmissions)
 
         if(n->transmissions < metadata->max_transmissions) {
         	PRINTF("csma: retransmitting with time %lu %p\n", time, q);
-          ctimer_set(&n->transmit_timer, time,
-                     transmit_packet_list, n);
+          timer_set(&n->backoff_timer, time);
+          CSMA_STATS_ADD(n, backoffs);
           /* This is needed to correctly attribute energy that we spent
              transmitting this packet. */
           queuebuf_update_attr_from_packetbuf(q->buf);
         } else {
           printf("csma: drop with status %d after %d transmissions, %d collisions\n",
                  status, n->transmissions, n->collisions);
+          CSMA_STATS_ADD(n, dropped);
           free_packet(n, q);
+          schedule_transmission();
           mac_call_sent_callback(sent, cptr, status, num_tx);
+          return;
         }
       } else {
         if(status == MAC_TX_OK) {
           PRINTF("csma: rexmit ok %d\n", n->transmissions);
+          CSMA_STATS_ADD(n, sent);
         } else {
           PRINTF("csma: rexmit failed %d: %d\n", n->transmissions, status);
+          CSMA_STATS_ADD(n, dropped);
         }
         free_packet(n, q);
+        schedule_transmission();
         mac_call_sent_callback(sent, cptr, status, num_tx);
+        return;
       }
     }
   }
+  schedule_transmission();
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -307,22 +416,19 @@ send_packet(mac_callback_t sent, void *ptr)
   /* Look for the neighbor entry */
   n = neighbor_queue_from_addr(addr);
   if(n == NULL) {
-    /* Allocate a new neighbor entry */
-    n = memb_alloc(&neighbor_memb);
-    if(n != NULL) {
-      /* Init neighbor entry */
-      rimeaddr_copy(&n->addr, addr);
-      n->transmissions = 0;
-      n->collisions = 0;
-      n->deferrals = 0;
-      /* Init packet list for this neighbor */
-      LIST_STRUCT_INIT(n, queued_packet_list);
-      /* Add neighbor to the list */
-      list_add(neighbor_list, n);
-    }
+    n = neighbor_queue_add(addr);
   }
 
   if(n != NULL) {
+#if CSMA_MAX_PACKETS_PER_NEIGHBOR < MAX_QUEUED_PACKETS
+    if(list_length(n->queued_packet_list) >= CSMA_MAX_PACKETS_PER_NEIGHBOR) {
+      /* Leave the remaining buffers to the other neighbors */
+      PRINTF("csma: neighbor queue full, dropping packet\n");
+      CSMA_STATS_ADD(n, dropped);
+      mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
+      return;
+    }
+#endif /* CSMA_MAX_PACKETS_PER_NEIGHBOR < MAX_QUEUED_PACKETS */
     /* Add packet to the neighbor's queue */
     q = memb_alloc(&packet_memb);
     if(q != NULL) {
@@ -342,6 +448,17 @@ send_packet(mac_callback_t sent, void *ptr)
 	  metadata->sent = sent;
 	  metadata->cptr = ptr;
 
+	  if(list_head(n->queued_packet_list) == NULL) {
+	    /* The neighbor had nothing queued: it gets a turn as soon
+	       as possible, after the ones already waiting. */
+	    n->transmissions = 0;
+	    n->collisions = 0;
+	    n->deferrals = 0;
+	    timer_set(&n->backoff_timer, 0);
+	    list_remove(neighbor_list, n);
+	    list_add(neighbor_list, n);
+	  }
+
 	  if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
 	     PACKETBUF_ATTR_PACKET_TYPE_ACK) {
 	    list_push(n->queued_packet_list, q);
@@ -349,10 +466,7 @@ send_packet(mac_callback_t sent, void *ptr)
 	    list_add(n->queued_packet_list, q);
 	  }
 
-	  /* If q is the first packet in the neighbor's queue, send asap */
-	  if(list_head(n->queued_packet_list) == q) {
-	    ctimer_set(&n->transmit_timer, 0, transmit_packet_list, n);
-	  }
+	  schedule_transmission();
 	  return;
 	}
 	memb_free(&metadata_memb, q->ptr);
@@ -361,11 +475,7 @@ send_packet(mac_callback_t sent, void *ptr)
       memb_free(&packet_memb, q);
       printf("csma: could not allocate queuebuf, dropping packet\n");
     }
-    /* The packet allocation failed. Remove and free neighbor entry if empty. */
-    if(list_length(n->queued_packet_list) == 0) {
-      list_remove(neighbor_list, n);
-      memb_free(&neighbor_memb, n);
-    }
+    CSMA_STATS_ADD(n, dropped);
     printf("csma: could not allocate packet, dropping packet\n");
   } else {
     printf("csma: could not allocate neighbor, dropping packet\n");
@@ -400,12 +510,23 @@ channel_check_interval(void)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+#if CSMA_STATS
+const struct csma_stats *
+csma_neighbor_stats(const rimeaddr_t *addr)
+{
+  struct neighbor_queue *n;
+
+  n = neighbor_queue_from_addr(addr);
+  return n != NULL ? &n->stats : NULL;
+}
+#endif /* CSMA_STATS */
+/*---------------------------------------------------------------------------*/
 static void
 init(void)
 {
+  memb_init(&neighbor_memb);
   memb_init(&packet_memb);
   memb_init(&metadata_memb);
-  memb_init(&neighbor_memb);
 }
 /*---------------------------------------------------------------------------*/
 const struct mac_driver csma_driver = {
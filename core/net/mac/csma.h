@@ -42,10 +42,33 @@
 #define __CSMA_H__
 
 #include "net/mac/mac.h"
+#include "net/rime/rimeaddr.h"
 #include "dev/radio.h"
 
+#ifdef CSMA_CONF_STATS
+#define CSMA_STATS CSMA_CONF_STATS
+#else
+#define CSMA_STATS 0
+#endif /* CSMA_CONF_STATS */
+
+/* Per-neighbor transmission counters */
+struct csma_stats {
+  uint16_t sent;      /* Packets acknowledged, or broadcast */
+  uint16_t dropped;   /* Packets refused or given up on */
+  uint16_t backoffs;  /* Retransmissions after a collision or a missing ACK */
+};
+
 extern const struct mac_driver csma_driver;
 
+#if CSMA_STATS
+/**
+ * \brief      Get the transmission counters of a neighbor
+ * \param addr The link-layer address of the neighbor
+ * \return     The counters, or NULL if the neighbor has no queue entry
+ */
+const struct csma_stats *csma_neighbor_stats(const rimeaddr_t *addr);
+#endif /* CSMA_STATS */
+
 const struct mac_driver *csma_init(const struct mac_driver *r);
 
 #endif /* __CSMA_H__ */
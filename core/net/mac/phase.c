@@ -44,18 +44,65 @@
 #include "net/queuebuf.h"
 #include "net/nbr-table.h"
 
+#include <string.h>
+
 #if PHASE_CONF_DRIFT_CORRECT
 #define PHASE_DRIFT_CORRECT PHASE_CONF_DRIFT_CORRECT
 #else
 #define PHASE_DRIFT_CORRECT 0
 #endif
 
-struct phase {
-  rtimer_clock_t time;
-#if PHASE_DRIFT_CORRECT
-  rtimer_clock_t drift;
+/* The number of wake-up times kept per neighbor. With more than one,
+   the phase and its drift are fitted by least squares. */
+#ifdef PHASE_CONF_SAMPLES
+#define PHASE_SAMPLES PHASE_CONF_SAMPLES
+#elif PHASE_DRIFT_CORRECT
+#define PHASE_SAMPLES 4
+#else
+#define PHASE_SAMPLES 1
+#endif
+
+/* Older samples say little about the current drift, and their
+   elapsed time must stay within the range of clock_time_t. */
+#define PHASE_SAMPLE_MAXAGE (60 * CLOCK_SECOND)
+
+/* Save the drift of every neighbor to CFS, so that the phase lock is
+   tight from the first packet after a reboot. */
+#ifdef PHASE_CONF_PERSIST
+#define PHASE_PERSIST PHASE_CONF_PERSIST
+#else
+#define PHASE_PERSIST 0
+#endif
+
+#ifdef PHASE_CONF_PERSIST_INTERVAL
+#define PHASE_PERSIST_INTERVAL PHASE_CONF_PERSIST_INTERVAL
+#else
+#define PHASE_PERSIST_INTERVAL (10 * 60 * CLOCK_SECOND)
 #endif
+
+#define PHASE_PERSIST_FILE "phase"
+
+#if PHASE_PERSIST
+#include "cfs/cfs.h"
+#endif /* PHASE_PERSIST */
+
+struct phase_sample {
+  rtimer_clock_t time;
+  /* The coarse clock tells how many times time has wrapped. */
+  clock_time_t clock;
+};
+
+struct phase {
+  /* Oldest first, the most recent sample is samples[nsamples - 1] */
+  struct phase_sample samples[PHASE_SAMPLES];
+  uint8_t nsamples;
+  /* Phase drift in rtimer ticks per 2^16 rtimer ticks */
+  int32_t drift;
   uint8_t noacks;
+  /* The neighbor checks the channel 2^cycle_shift times per cycle,
+     at least until cycle_shift_timer expires. */
+  uint8_t cycle_shift;
+  struct timer cycle_shift_timer;
   struct timer noacks_timer;
 };
 
@@ -77,6 +124,10 @@ struct phase_queueitem {
 MEMB(queued_packets_memb, struct phase_queueitem, PHASE_QUEUESIZE);
 NBR_TABLE(struct phase, nbr_phase);
 
+#if PHASE_PERSIST
+static struct ctimer persist_timer;
+#endif /* PHASE_PERSIST */
+
 #define DEBUG 0
 #if DEBUG
 #include <stdio.h>
@@ -87,6 +138,126 @@ NBR_TABLE(struct phase, nbr_phase);
 #define PRINTDEBUG(...)
 #endif
 /*---------------------------------------------------------------------------*/
+/* The rtimer ticks from sample a to sample b. The coarse clock gives
+   an estimate, and the rtimer difference the exact value within one
+   wrap of rtimer_clock_t. */
+static int32_t
+sample_elapsed(const struct phase_sample *a, const struct phase_sample *b)
+{
+  int32_t approx;
+  rtimer_clock_t exact;
+
+  exact = b->time - a->time;
+  if(sizeof(rtimer_clock_t) >= sizeof(int32_t)) {
+    return (int32_t)exact;
+  }
+  approx = (int32_t)(clock_time_t)(b->clock - a->clock) *
+    RTIMER_ARCH_SECOND / CLOCK_SECOND;
+  return approx + (int16_t)(rtimer_clock_t)(exact - (rtimer_clock_t)approx);
+}
+/*---------------------------------------------------------------------------*/
+/* An elapsed time modulo the cycle, between -cycle_time / 2 and
+   cycle_time / 2. */
+static int32_t
+cycle_offset(int32_t elapsed, rtimer_clock_t cycle_time)
+{
+  int32_t offset;
+
+  offset = elapsed % (int32_t)cycle_time;
+  if(offset < -(int32_t)cycle_time / 2) {
+    offset += cycle_time;
+  } else if(offset >= (int32_t)cycle_time / 2) {
+    offset -= cycle_time;
+  }
+  return offset;
+}
+/*---------------------------------------------------------------------------*/
+/* Estimate how long ago the neighbor last woke up. The offsets of
+   the samples from the latest one, modulo the cycle, are fitted as a
+   line over time. Its slope is the drift between the clocks of the
+   neighbor and ours. */
+static rtimer_clock_t
+phase_since_wakeup(struct phase *e, rtimer_clock_t now, rtimer_clock_t cycle_time)
+{
+  const struct phase_sample *ref;
+  struct phase_sample current;
+  int32_t elapsed, x, y, n;
+  int64_t sx, sy, sxx, sxy, den;
+  int64_t a;
+  int32_t since;
+  int i;
+
+  ref = &e->samples[e->nsamples - 1];
+  a = 0;
+  if(e->nsamples >= 2) {
+    n = e->nsamples;
+    sx = sy = sxx = sxy = 0;
+    for(i = 0; i < e->nsamples; i++) {
+      x = sample_elapsed(ref, &e->samples[i]);
+      y = cycle_offset(x, cycle_time);
+      sx += x;
+      sy += y;
+      sxx += (int64_t)x * x;
+      sxy += (int64_t)x * y;
+    }
+    den = n * sxx - sx * sx;
+    if(den > 0) {
+      e->drift = (int32_t)((n * sxy - sx * sy) * 65536 / den);
+    }
+    /* The fitted offset at the latest sample */
+    a = (sy - e->drift * sx / 65536) / n;
+  }
+
+  current.time = now;
+  current.clock = clock_time();
+  elapsed = sample_elapsed(ref, &current);
+  since = (int32_t)((elapsed - a - (int64_t)e->drift * elapsed / 65536) %
+                    (int32_t)cycle_time);
+  if(since < 0) {
+    since += cycle_time;
+  }
+  return since;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_sample(struct phase *e, rtimer_clock_t time)
+{
+  clock_time_t now;
+  int i;
+
+  now = clock_time();
+  /* Drop the samples that are too old to tell the current drift,
+     and make room for the new one. */
+  for(i = 0; i < e->nsamples; i++) {
+    if((clock_time_t)(now - e->samples[i].clock) <= PHASE_SAMPLE_MAXAGE) {
+      break;
+    }
+  }
+  if(i == 0 && e->nsamples == PHASE_SAMPLES) {
+    i = 1;
+  }
+  if(i > 0) {
+    e->nsamples -= i;
+    memmove(&e->samples[0], &e->samples[i],
+            e->nsamples * sizeof(struct phase_sample));
+  }
+  e->samples[e->nsamples].time = time;
+  e->samples[e->nsamples].clock = now;
+  e->nsamples++;
+}
+/*---------------------------------------------------------------------------*/
+/* A neighbor only keeps its advertised rate for a while, and tells
+   us when it slows down only with its next packet. Until then, its
+   wake-ups at the base rate are the ones we can count on. */
+static uint8_t
+entry_cycle_shift(struct phase *e)
+{
+  if(e->cycle_shift == 0 || timer_expired(&e->cycle_shift_timer)) {
+    return 0;
+  }
+  return e->cycle_shift;
+}
+/*---------------------------------------------------------------------------*/
 void
 phase_update(const rimeaddr_t *neighbor, rtimer_clock_t time,
              int mac_status)
@@ -97,10 +268,7 @@ phase_update(const rimeaddr_t *neighbor, rtimer_clock_t time,
   e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
   if(e != NULL) {
     if(mac_status == MAC_TX_OK) {
-#if PHASE_DRIFT_CORRECT
-      e->drift = time-e->time;
-#endif
-      e->time = time;
+      add_sample(e, time);
     }
     /* If the neighbor didn't reply to us, it may have switched
        phase (rebooted). We try a number of transmissions to it
@@ -108,6 +276,8 @@ phase_update(const rimeaddr_t *neighbor, rtimer_clock_t time,
     if(mac_status == MAC_TX_NOACK) {
       PRINTF("phase noacks %d to %d.%d\n", e->noacks, neighbor->u8[0], neighbor->u8[1]);
       e->noacks++;
+      /* It may also have slowed down since it last told us its rate. */
+      e->cycle_shift = 0;
       if(e->noacks == 1) {
         timer_set(&e->noacks_timer, MAX_NOACKS_TIME);
       }
@@ -124,11 +294,11 @@ phase_update(const rimeaddr_t *neighbor, rtimer_clock_t time,
     if(mac_status == MAC_TX_OK && e == NULL) {
       e = nbr_table_add_lladdr(nbr_phase, neighbor);
       if(e) {
-        e->time = time;
-#if PHASE_DRIFT_CORRECT
-      e->drift = 0;
-#endif
-      e->noacks = 0;
+        e->nsamples = 0;
+        e->drift = 0;
+        e->noacks = 0;
+        e->cycle_shift = 0;
+        add_sample(e, time);
       }
     }
   }
@@ -140,7 +310,7 @@ send_packet(void *ptr)
   struct phase_queueitem *p = ptr;
 
   if(p->buf_list == NULL) {
-    queuebuf_to_packetbuf(p->q);
+    queuebuf_to_packetbuf_nocopy(p->q);
     queuebuf_free(p->q);
     NETSTACK_RDC.send(p->mac_callback, p->mac_callback_ptr);
   } else {
@@ -163,13 +333,13 @@ phase_wait(const rimeaddr_t *neighbor, rtimer_clock_t cycle_time,
      time for the next expected phase and setup a ctimer to switch on
      the radio just before the phase. */
   e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
-  if(e != NULL) {
-    rtimer_clock_t wait, now, expected, sync;
+  if(e != NULL && e->nsamples > 0) {
+    rtimer_clock_t wait, now, expected;
     clock_time_t ctimewait;
     
     /* We expect phases to happen every CYCLE_TIME time
-       units. The next expected phase is at time e->time +
-       CYCLE_TIME. To compute a relative offset, we subtract
+       units. The next expected phase is at the predicted phase
+       plus CYCLE_TIME. To compute a relative offset, we subtract
        with clock_time(). Because we are only interested in turning
        on the radio within the CYCLE_TIME period, we compute the
        waiting time with modulo CYCLE_TIME. */
@@ -183,27 +353,11 @@ phase_wait(const rimeaddr_t *neighbor, rtimer_clock_t cycle_time,
     
     now = RTIMER_NOW();
 
-    sync = (e == NULL) ? now : e->time;
+    /* The neighbor wakes up 2^cycle_shift times as often. Its wake-ups
+       at the base rate are still in phase with the samples. */
+    cycle_time >>= entry_cycle_shift(e);
 
-#if PHASE_DRIFT_CORRECT
-    {
-      int32_t s;
-      if(e->drift > cycle_time) {
-        s = e->drift % cycle_time / (e->drift / cycle_time);  /* drift per cycle */
-        s = s * (now - sync) / cycle_time;                    /* estimated drift to now */
-        sync += s;                                            /* add it in */
-      }
-    }
-#endif
-
-    /* Check if cycle_time is a power of two */
-    if(!(cycle_time & (cycle_time - 1))) {
-      /* Faster if cycle_time is a power of two */
-      wait = (rtimer_clock_t)((sync - now) & (cycle_time - 1));
-    } else {
-      /* Works generally */
-      wait = cycle_time - (rtimer_clock_t)((now - sync) % cycle_time);
-    }
+    wait = cycle_time - phase_since_wakeup(e, now, cycle_time);
 
     if(wait < guard_time) {
       wait += cycle_time;
@@ -222,7 +376,10 @@ phase_wait(const rimeaddr_t *neighbor, rtimer_clock_t cycle_time,
         p->mac_callback = mac_callback;
         p->mac_callback_ptr = mac_callback_ptr;
         p->buf_list = buf_list;
-        ctimer_set(&p->timer, ctimewait, send_packet, p);
+        /* Come back a tick early and wait out the rest. A timer that
+           fires late would miss the guard time and have to wait for
+           the next cycle, again and again. */
+        ctimer_set(&p->timer, ctimewait - 1, send_packet, p);
         return PHASE_DEFERRED;
       }
     }
@@ -238,9 +395,83 @@ phase_wait(const rimeaddr_t *neighbor, rtimer_clock_t cycle_time,
 }
 /*---------------------------------------------------------------------------*/
 void
+phase_set_cycle_shift(const rimeaddr_t *neighbor, uint8_t shift,
+                      clock_time_t valid)
+{
+  struct phase *e;
+
+  e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
+  if(e != NULL) {
+    e->cycle_shift = shift;
+    timer_set(&e->cycle_shift_timer, valid);
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+phase_cycle_shift(const rimeaddr_t *neighbor)
+{
+  struct phase *e;
+
+  e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
+  return e != NULL ? entry_cycle_shift(e) : 0;
+}
+#if PHASE_PERSIST
+/* The file holds a rimeaddr_t and an int32_t drift per neighbor. A
+   phase does not survive a reboot of either node, but the drift
+   between two clocks does. */
+static void
+persist_save(void *ptr)
+{
+  struct phase *e;
+  int fd;
+
+  cfs_remove(PHASE_PERSIST_FILE);
+  fd = cfs_open(PHASE_PERSIST_FILE, CFS_WRITE);
+  if(fd >= 0) {
+    for(e = nbr_table_head(nbr_phase); e != NULL;
+        e = nbr_table_next(nbr_phase, e)) {
+      if(e->drift != 0) {
+        cfs_write(fd, nbr_table_get_lladdr(nbr_phase, e), sizeof(rimeaddr_t));
+        cfs_write(fd, &e->drift, sizeof(e->drift));
+      }
+    }
+    cfs_close(fd);
+  }
+  ctimer_reset(&persist_timer);
+}
+/*---------------------------------------------------------------------------*/
+static void
+persist_load(void)
+{
+  struct phase *e;
+  rimeaddr_t addr;
+  int32_t drift;
+  int fd;
+
+  fd = cfs_open(PHASE_PERSIST_FILE, CFS_READ);
+  if(fd < 0) {
+    return;
+  }
+  while(cfs_read(fd, &addr, sizeof(addr)) == sizeof(addr) &&
+        cfs_read(fd, &drift, sizeof(drift)) == sizeof(drift)) {
+    /* The entry has no phase until we next reach the neighbor */
+    e = nbr_table_add_lladdr(nbr_phase, &addr);
+    if(e != NULL) {
+      e->drift = drift;
+    }
+  }
+  cfs_close(fd);
+}
+#endif /* PHASE_PERSIST */
+/*---------------------------------------------------------------------------*/
+void
 phase_init(void)
 {
   memb_init(&queued_packets_memb);
   nbr_table_register(nbr_phase, NULL);
+#if PHASE_PERSIST
+  persist_load();
+  ctimer_set(&persist_timer, PHASE_PERSIST_INTERVAL, persist_save, NULL);
+#endif /* PHASE_PERSIST */
 }
 /*---------------------------------------------------------------------------*/
@@ -63,4 +63,10 @@ void phase_update(const rimeaddr_t *neighbor,
                   rtimer_clock_t time, int mac_status);
 void phase_remove(const rimeaddr_t *neighbor);
 
+/* Record that a neighbor checks the channel 2^shift times per cycle
+   for at least the next valid clock ticks */
+void phase_set_cycle_shift(const rimeaddr_t *neighbor, uint8_t shift,
+                           clock_time_t valid);
+uint8_t phase_cycle_shift(const rimeaddr_t *neighbor);
+
 #endif /* PHASE_H */
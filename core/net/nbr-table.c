@@ -62,6 +62,23 @@ static unsigned num_tables;
 MEMB(neighbor_addr_mem, nbr_table_key_t, NBR_TABLE_MAX_NEIGHBORS);
 LIST(nbr_table_keys);
 
+#if NBR_TABLE_HASH
+#if NBR_TABLE_MAX_NEIGHBORS > 255
+#error NBR_TABLE_HASH supports at most 255 neighbors
+#endif
+/* Open-addressed hash index over the keys, with linear probing. Each
+ * slot holds a neighbor index plus one, 0 marks an empty slot. The
+ * table is kept at most half full. */
+#define HASH_SIZE (NBR_TABLE_MAX_NEIGHBORS <= 4 ? 8 : \
+                   NBR_TABLE_MAX_NEIGHBORS <= 8 ? 16 : \
+                   NBR_TABLE_MAX_NEIGHBORS <= 16 ? 32 : \
+                   NBR_TABLE_MAX_NEIGHBORS <= 32 ? 64 : \
+                   NBR_TABLE_MAX_NEIGHBORS <= 64 ? 128 : \
+                   NBR_TABLE_MAX_NEIGHBORS <= 128 ? 256 : 512)
+#define HASH_MASK (HASH_SIZE - 1)
+static uint8_t hash_slots[HASH_SIZE];
+#endif /* NBR_TABLE_HASH */
+
 /*---------------------------------------------------------------------------*/
 /* Get a key from a neighbor index */
 static nbr_table_key_t *
@@ -105,10 +122,86 @@ key_from_item(nbr_table_t *table, nbr_table_item_t *item)
   return key_from_index(index_from_item(table, item));
 }
 /*---------------------------------------------------------------------------*/
+#if NBR_TABLE_HASH
+/* Home slot of a link-layer address in the hash index */
+static unsigned
+hash_lladdr(const rimeaddr_t *lladdr)
+{
+  unsigned h = 0;
+  int i;
+  for(i = 0; i < RIMEADDR_SIZE; i++) {
+    h = (h << 5) + h + lladdr->u8[i];
+  }
+  return (h ^ (h >> 7)) & HASH_MASK;
+}
+/*---------------------------------------------------------------------------*/
+/* Add a key to the hash index */
+static void
+hash_insert(nbr_table_key_t *key)
+{
+  unsigned slot = hash_lladdr(&key->lladdr);
+  while(hash_slots[slot] != 0) {
+    slot = (slot + 1) & HASH_MASK;
+  }
+  hash_slots[slot] = index_from_key(key) + 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a key from the hash index. Must be called while the key still
+ * holds its link-layer address. */
+static void
+hash_remove(nbr_table_key_t *key)
+{
+  unsigned hole, slot, home;
+  uint8_t entry = index_from_key(key) + 1;
+
+  hole = hash_lladdr(&key->lladdr);
+  while(hash_slots[hole] != entry) {
+    if(hash_slots[hole] == 0) {
+      return;
+    }
+    hole = (hole + 1) & HASH_MASK;
+  }
+  /* Shift back the following entries of the probe sequence, so that
+   * lookups never need tombstones */
+  slot = hole;
+  while(1) {
+    slot = (slot + 1) & HASH_MASK;
+    if(hash_slots[slot] == 0) {
+      break;
+    }
+    home = hash_lladdr(&key_from_index(hash_slots[slot] - 1)->lladdr);
+    /* Move the entry unless its home lies cyclically in (hole, slot] */
+    if(((slot - home) & HASH_MASK) >= ((slot - hole) & HASH_MASK)) {
+      hash_slots[hole] = hash_slots[slot];
+      hole = slot;
+    }
+  }
+  hash_slots[hole] = 0;
+}
+#endif /* NBR_TABLE_HASH */
+/*---------------------------------------------------------------------------*/
 /* Get the index of a neighbor from its link-layer address */
 static int
 index_from_lladdr(const rimeaddr_t *lladdr)
 {
+#if NBR_TABLE_HASH
+  unsigned slot;
+  nbr_table_key_t *key;
+  /* Allow lladdr-free insertion, useful e.g. for IPv6 ND.
+   * Only one such entry is possible at a time, indexed by rimeaddr_null. */
+  if(lladdr == NULL) {
+    lladdr = &rimeaddr_null;
+  }
+  slot = hash_lladdr(lladdr);
+  while(hash_slots[slot] != 0) {
+    key = key_from_index(hash_slots[slot] - 1);
+    if(rimeaddr_cmp(lladdr, &key->lladdr)) {
+      return hash_slots[slot] - 1;
+    }
+    slot = (slot + 1) & HASH_MASK;
+  }
+  return -1;
+#else /* NBR_TABLE_HASH */
   nbr_table_key_t *key;
   /* Allow lladdr-free insertion, useful e.g. for IPv6 ND.
    * Only one such entry is possible at a time, indexed by rimeaddr_null. */
@@ -123,6 +216,7 @@ index_from_lladdr(const rimeaddr_t *lladdr)
     key = list_item_next(key);
   }
   return -1;
+#endif /* NBR_TABLE_HASH */
 }
 /*---------------------------------------------------------------------------*/
 /* Get bit from "used" or "locked" bitmap */
@@ -218,6 +312,9 @@ nbr_table_allocate(void)
       used_map[index_from_key(least_used_key)] = 0;
       /* Remove neighbor from list */
       list_remove(nbr_table_keys, least_used_key);
+#if NBR_TABLE_HASH
+      hash_remove(least_used_key);
+#endif /* NBR_TABLE_HASH */
       /* Return associated key */
       return least_used_key;
     }
@@ -298,6 +395,9 @@ nbr_table_add_lladdr(nbr_table_t *table, const rimeaddr_t *lladdr)
 
     /* Set link-layer address */
     rimeaddr_copy(&key->lladdr, lladdr);
+#if NBR_TABLE_HASH
+    hash_insert(key);
+#endif /* NBR_TABLE_HASH */
   }
 
   /* Get item in the current table */
@@ -46,6 +46,15 @@
 #define NBR_TABLE_MAX_NEIGHBORS 8
 #endif /* NBR_TABLE_CONF_MAX_NEIGHBORS */
 
+/* Index the neighbors by link-layer address in a hash table, making
+ * lookups O(1) on average instead of a scan of all neighbors. Worth
+ * its RAM for large tables, e.g. on border routers. */
+#ifdef NBR_TABLE_CONF_HASH
+#define NBR_TABLE_HASH NBR_TABLE_CONF_HASH
+#else /* NBR_TABLE_CONF_HASH */
+#define NBR_TABLE_HASH 0
+#endif /* NBR_TABLE_CONF_HASH */
+
 /* An item in a neighbor table */
 typedef void nbr_table_item_t;
 
@@ -62,6 +62,10 @@ static uint8_t hdrptr;
 static uint16_t packetbuf_aligned[(PACKETBUF_SIZE + PACKETBUF_HDR_SIZE) / 2 + 1];
 static uint8_t *packetbuf = (uint8_t *)packetbuf_aligned;
 
+/* An external buffer given to packetbuf_attach() replaces the memory
+   above until the packetbuf is cleared. */
+#define OWN_BUFFER ((uint8_t *)packetbuf_aligned)
+
 static uint8_t *packetbufptr;
 
 #define DEBUG 0
@@ -79,6 +83,7 @@ packetbuf_clear(void)
   buflen = bufptr = 0;
   hdrptr = PACKETBUF_HDR_SIZE;
 
+  packetbuf = OWN_BUFFER;
   packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
   packetbuf_attr_clear();
 }
@@ -235,6 +240,34 @@ packetbuf_reference_ptr(void)
   return packetbufptr;
 }
 /*---------------------------------------------------------------------------*/
+void
+packetbuf_attach(void *buf, uint16_t len)
+{
+  bufptr = 0;
+  buflen = len;
+  hdrptr = PACKETBUF_HDR_SIZE;
+
+  packetbuf = buf;
+  packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+void *
+packetbuf_attached(void)
+{
+  return packetbuf == OWN_BUFFER ? NULL : packetbuf;
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_detach(void)
+{
+  if(packetbuf != OWN_BUFFER) {
+    memcpy(OWN_BUFFER + hdrptr, packetbuf + hdrptr,
+           PACKETBUF_HDR_SIZE - hdrptr + bufptr + buflen);
+    packetbuf = OWN_BUFFER;
+    packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
+  }
+}
+/*---------------------------------------------------------------------------*/
 uint16_t
 packetbuf_datalen(void)
 {
@@ -218,6 +218,44 @@ int packetbuf_is_reference(void);
  */
 void *packetbuf_reference_ptr(void);
 
+/**
+ * \brief      Make the packetbuf use an external buffer as its memory
+ * \param buf  A 16-bit aligned buffer of PACKETBUF_HDR_SIZE + PACKETBUF_SIZE bytes
+ * \param len  The length of the data, which starts PACKETBUF_HDR_SIZE bytes into buf
+ *
+ *             This function lets a MAC layer transmit a queued
+ *             packet without first copying it into the packetbuf:
+ *             headers are allocated in the first PACKETBUF_HDR_SIZE
+ *             bytes of the buffer, in front of the data. The
+ *             attributes are not changed.
+ *
+ *             The packetbuf uses the buffer until the next call to
+ *             packetbuf_clear(), packetbuf_copyfrom(),
+ *             packetbuf_reference(), packetbuf_attach() or
+ *             packetbuf_detach(). The owner of the buffer must not
+ *             reuse it before then.
+ *
+ */
+void packetbuf_attach(void *buf, uint16_t len);
+
+/**
+ * \brief      Get the external buffer the packetbuf is attached to
+ * \retval     The buffer given to packetbuf_attach(), or NULL
+ *
+ */
+void *packetbuf_attached(void);
+
+/**
+ * \brief      Copy an attached buffer into the packetbuf's own memory
+ *
+ *             This function copies the header and data of a packetbuf
+ *             attached with packetbuf_attach() into the packetbuf's
+ *             own memory, after which the external buffer is no
+ *             longer used.
+ *
+ */
+void packetbuf_detach(void);
+
 /**
  * \brief      Compact the packetbuf
  *
@@ -347,6 +385,7 @@ enum {
   PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
   PACKETBUF_ATTR_MAC_SEQNO,
   PACKETBUF_ATTR_MAC_ACK,
+  PACKETBUF_ATTR_RPL_PROBE,
 
   /* Scope 1 attributes: used between two neighbors only. */
   PACKETBUF_ATTR_RELIABLE,
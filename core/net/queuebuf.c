@@ -75,10 +75,18 @@ struct queuebuf {
 #endif
 };
 
+#if QUEUEBUF_ZERO_COPY
+/* Room for the headers added below the queue, so that the packetbuf
+   can be attached to the queuebuf data. */
+#define HEADROOM PACKETBUF_HDR_SIZE
+#else /* QUEUEBUF_ZERO_COPY */
+#define HEADROOM 0
+#endif /* QUEUEBUF_ZERO_COPY */
+
 /* The actual queuebuf data */
 struct queuebuf_data {
   uint16_t len;
-  uint8_t data[PACKETBUF_SIZE];
+  uint8_t buf[HEADROOM + PACKETBUF_SIZE];
   struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
   struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
 };
@@ -94,6 +102,14 @@ MEMB(bufmem, struct queuebuf, QUEUEBUF_NUM);
 MEMB(refbufmem, struct queuebuf_ref, QUEUEBUF_REF_NUM);
 MEMB(buframmem, struct queuebuf_data, QUEUEBUFRAM_NUM);
 
+#define DATA(d) (&(d)->buf[HEADROOM])
+
+#if QUEUEBUF_ZERO_COPY
+/* Data of a queuebuf that was freed while the packetbuf was still
+   attached to it. */
+static struct queuebuf_data *lent;
+#endif /* QUEUEBUF_ZERO_COPY */
+
 #if WITH_SWAP
 
 /* Swapping allows to store up to QUEUEBUF_NUM - QUEUEBUFRAM_NUM
@@ -288,6 +304,49 @@ queuebuf_load_to_ram(struct queuebuf *b)
   return b->ram_ptr;
 }
 #endif /* WITH_SWAP */
+#if QUEUEBUF_ZERO_COPY
+/*---------------------------------------------------------------------------*/
+static void
+reclaim_lent(void)
+{
+  if(lent != NULL && packetbuf_attached() != lent->buf) {
+    memb_free(&buframmem, lent);
+    lent = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_data(struct queuebuf_data *d)
+{
+  reclaim_lent();
+  if(packetbuf_attached() == d->buf) {
+    /* The packetbuf can only be attached to one buffer at a time, so
+       there is never more than one lent buffer to keep. */
+    lent = d;
+  } else {
+    memb_free(&buframmem, d);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void *
+alloc_data(void)
+{
+  void *d;
+
+  reclaim_lent();
+  d = memb_alloc(&buframmem);
+  if(d == NULL && lent != NULL) {
+    /* Take the lent buffer back from the packetbuf. */
+    packetbuf_detach();
+    reclaim_lent();
+    d = memb_alloc(&buframmem);
+  }
+  return d;
+}
+#else /* QUEUEBUF_ZERO_COPY */
+#define free_data(d) memb_free(&buframmem, d)
+#define alloc_data() memb_alloc(&buframmem)
+#endif /* QUEUEBUF_ZERO_COPY */
 /*---------------------------------------------------------------------------*/
 void
 queuebuf_init(void)
@@ -302,6 +361,9 @@ queuebuf_init(void)
   memb_init(&buframmem);
   memb_init(&bufmem);
   memb_init(&refbufmem);
+#if QUEUEBUF_ZERO_COPY
+  lent = NULL;
+#endif /* QUEUEBUF_ZERO_COPY */
 #if QUEUEBUF_STATS
   queuebuf_max_len = QUEUEBUF_NUM;
 #endif /* QUEUEBUF_STATS */
@@ -341,7 +403,7 @@ queuebuf_new_from_packetbuf(void)
       buf->line = line;
       buf->time = clock_time();
 #endif /* QUEUEBUF_DEBUG */
-      buf->ram_ptr = memb_alloc(&buframmem);
+      buf->ram_ptr = alloc_data();
 #if WITH_SWAP
       /* If the allocation failed, store the qbuf in swap files */
       if(buf->ram_ptr != NULL) {
@@ -361,7 +423,7 @@ queuebuf_new_from_packetbuf(void)
       buframptr = buf->ram_ptr;
 #endif
 
-      buframptr->len = packetbuf_copyto(buframptr->data);
+      buframptr->len = packetbuf_copyto(DATA(buframptr));
       packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
 
 #if WITH_SWAP
@@ -410,12 +472,12 @@ queuebuf_free(struct queuebuf *buf)
   if(memb_inmemb(&bufmem, buf)) {
 #if WITH_SWAP
     if(buf->location == IN_RAM) {
-      memb_free(&buframmem, buf->ram_ptr);
+      free_data(buf->ram_ptr);
     } else {
       queuebuf_remove_from_file(buf->swap_id);
     }
 #else
-    memb_free(&buframmem, buf->ram_ptr);
+    free_data(buf->ram_ptr);
 #endif
     memb_free(&bufmem, buf);
 #if QUEUEBUF_STATS
@@ -439,7 +501,7 @@ queuebuf_to_packetbuf(struct queuebuf *b)
   struct queuebuf_ref *r;
   if(memb_inmemb(&bufmem, b)) {
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
-    packetbuf_copyfrom(buframptr->data, buframptr->len);
+    packetbuf_copyfrom(DATA(buframptr), buframptr->len);
     packetbuf_attr_copyfrom(buframptr->attrs, buframptr->addrs);
   } else if(memb_inmemb(&refbufmem, b)) {
     r = (struct queuebuf_ref *)b;
@@ -450,6 +512,38 @@ queuebuf_to_packetbuf(struct queuebuf *b)
   }
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Like queuebuf_to_packetbuf(), but attaches the packetbuf to the
+ * queuebuf data instead of copying it. Headers allocated afterwards
+ * go into the headroom of the queuebuf, and are gone the next time
+ * the packet is attached. The data itself must not be modified, as it
+ * is still the queued packet. The queuebuf may be freed while the
+ * packetbuf is attached: its memory is kept until the packetbuf moves
+ * on to another packet.
+ */
+void
+queuebuf_to_packetbuf_nocopy(struct queuebuf *b)
+{
+#if QUEUEBUF_ZERO_COPY && !defined NETSTACK_ENCRYPT
+  struct queuebuf_data *d;
+
+  if(memb_inmemb(&bufmem, b)
+#if WITH_SWAP
+     && b->location == IN_RAM
+#endif /* WITH_SWAP */
+     ) {
+    d = b->ram_ptr;
+    packetbuf_attach(d->buf, d->len);
+    packetbuf_attr_copyfrom(d->attrs, d->addrs);
+    reclaim_lent();
+    return;
+  }
+#endif /* QUEUEBUF_ZERO_COPY && !NETSTACK_ENCRYPT */
+  /* Reference and swapped queuebufs are copied, and so is everything
+     when encryption rewrites the data in place. */
+  queuebuf_to_packetbuf(b);
+}
+/*---------------------------------------------------------------------------*/
 void *
 queuebuf_dataptr(struct queuebuf *b)
 {
@@ -457,7 +551,7 @@ queuebuf_dataptr(struct queuebuf *b)
 
   if(memb_inmemb(&bufmem, b)) {
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
-    return buframptr->data;
+    return DATA(buframptr);
   } else if(memb_inmemb(&refbufmem, b)) {
     r = (struct queuebuf_ref *)b;
     return r->ref;
@@ -79,6 +79,16 @@
   #define WITH_SWAP 0
 #endif /* QUEUEBUFRAM_CONF_NUM */
 
+/* With QUEUEBUF_CONF_ZERO_COPY, every queuebuf reserves header space in
+   front of its data, and queuebuf_to_packetbuf_nocopy() attaches the
+   packetbuf to the queuebuf instead of copying the packet. MAC and RDC
+   layers use this to transmit and retransmit queued packets in place. */
+#ifdef QUEUEBUF_CONF_ZERO_COPY
+#define QUEUEBUF_ZERO_COPY QUEUEBUF_CONF_ZERO_COPY
+#else /* QUEUEBUF_CONF_ZERO_COPY */
+#define QUEUEBUF_ZERO_COPY 0
+#endif /* QUEUEBUF_CONF_ZERO_COPY */
+
 #ifdef QUEUEBUF_CONF_DEBUG
 #define QUEUEBUF_DEBUG QUEUEBUF_CONF_DEBUG
 #else /* QUEUEBUF_CONF_DEBUG */
@@ -98,6 +108,7 @@ struct queuebuf *queuebuf_new_from_packetbuf(void);
 void queuebuf_update_attr_from_packetbuf(struct queuebuf *b);
 
 void queuebuf_to_packetbuf(struct queuebuf *b);
+void queuebuf_to_packetbuf_nocopy(struct queuebuf *b);
 void queuebuf_free(struct queuebuf *b);
 
 void *queuebuf_dataptr(struct queuebuf *b);
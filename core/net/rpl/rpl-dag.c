@@ -75,33 +75,129 @@ static rpl_of_t * const objective_functions[] = {&RPL_OF};
 #define hexa 64
 #define AGE_THRESHOLD 1049//(2^(RPL_DIO_INTERVAL_MIN ))/hexa //+ RPL_DIO_INTERVAL_DOUBLINGS
 //elnaz
-static struct ip_addr_list_struct pt_parents[3];
-static void handle_probe_timer(void *pt);
-//LIST(ip_addr_list);
-//MEMB(pt_prnt_mem, struct ip_addr_list_struct, 3);
-
-static int probe_number=0;
-static int probe_total=0;
-static struct ctimer probe_timer;
-static struct ctimer  stagger_timer;
-static struct ctimer  find_pref_timer;
-static void handle_probe_timer(void *);
-static void handle_stagger_timer(void *);
-static void handle_find_pref_timer(void * ptr);
-static int index;
-
-static int Tx_array[8]={3,7,11,15,19,23,27,31};
-static int Es_array[8]={330,330,330,330,330,330,330,330};
-//static int tx;
-static int tx_indx=4;
-void set_output_power_field(int);
-static 	char pt_exist=0;
+/* Snapshot of the candidates probed in the current round. */
+static rpl_parent_t *pt_parents[RPL_PROBE_CANDIDATES];
+static int pt_count;
+/* Bounded max-heap of probing candidates: the worst candidate sits at the
+   root so that a better neighbor can replace it in O(log n). */
+static rpl_parent_t *candidates[RPL_PROBE_CANDIDATES];
+static uint8_t candidate_count;
+static void probe_round_done(void);
+
 //static char flag=0;
 //elnaz
 /*---------------------------------------------------------------------------*/
 /* Per-parent RPL information */
 NBR_TABLE(rpl_parent_t, rpl_parents);
 /*---------------------------------------------------------------------------*/
+/* Returns non-zero if p is a worse probing candidate than q. */
+static int
+candidate_worse(rpl_parent_t *p, rpl_parent_t *q)
+{
+  if(p->rank != q->rank) {
+    return p->rank > q->rank;
+  }
+  return p->rssi < q->rssi;
+}
+/*---------------------------------------------------------------------------*/
+static void
+candidate_place(rpl_parent_t *p, int i)
+{
+  candidates[i] = p;
+  p->candidate = i + 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+candidate_sift_up(int i)
+{
+  rpl_parent_t *p = candidates[i];
+  int parent;
+
+  while(i > 0) {
+    parent = (i - 1) / 2;
+    if(!candidate_worse(p, candidates[parent])) {
+      break;
+    }
+    candidate_place(candidates[parent], i);
+    i = parent;
+  }
+  candidate_place(p, i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+candidate_sift_down(int i)
+{
+  rpl_parent_t *p = candidates[i];
+  int child;
+
+  while((child = 2 * i + 1) < candidate_count) {
+    if(child + 1 < candidate_count &&
+       candidate_worse(candidates[child + 1], candidates[child])) {
+      child++;
+    }
+    if(!candidate_worse(candidates[child], p)) {
+      break;
+    }
+    candidate_place(candidates[child], i);
+    i = child;
+  }
+  candidate_place(p, i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+candidate_remove(rpl_parent_t *p)
+{
+  rpl_parent_t *last;
+  int i;
+
+  if(p->candidate == 0) {
+    return;
+  }
+  i = p->candidate - 1;
+  p->candidate = 0;
+  last = candidates[--candidate_count];
+  candidates[candidate_count] = NULL;
+  if(last != p) {
+    /* Fill the hole with the last entry and restore the heap property. */
+    candidate_place(last, i);
+    candidate_sift_up(i);
+    candidate_sift_down(last->candidate - 1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+candidate_eligible(rpl_parent_t *p)
+{
+  rpl_dag_t *dag = p->dag;
+
+  return dag != NULL && p != dag->preferred_parent &&
+    p->rank != INFINITE_RANK && p->rank < dag->rank &&
+    p->rssi > RSSI_THRESHOLD;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_update_candidate(rpl_parent_t *p)
+{
+  if(!candidate_eligible(p)) {
+    candidate_remove(p);
+    return;
+  }
+
+  if(p->candidate != 0) {
+    /* The key may have changed; restore the heap property around p. */
+    candidate_sift_up(p->candidate - 1);
+    candidate_sift_down(p->candidate - 1);
+  } else if(candidate_count < RPL_PROBE_CANDIDATES) {
+    candidate_place(p, candidate_count++);
+    candidate_sift_up(p->candidate - 1);
+  } else if(candidate_worse(candidates[0], p)) {
+    /* Evict the worst candidate. */
+    candidates[0]->candidate = 0;
+    candidate_place(p, 0);
+    candidate_sift_down(0);
+  }
+}
+/*---------------------------------------------------------------------------*/
 /* Allocate instance table. */
 rpl_instance_t instance_table[RPL_MAX_INSTANCES];
 rpl_instance_t *default_instance;
@@ -141,6 +237,12 @@ rpl_get_parent_ipaddr(rpl_parent_t *p)
   return uip_ds6_nbr_ipaddr_from_lladdr((uip_lladdr_t *)lladdr);
 }
 /*---------------------------------------------------------------------------*/
+rimeaddr_t *
+rpl_get_parent_lladdr(rpl_parent_t *p)
+{
+  return nbr_table_get_lladdr(rpl_parents, p);
+}
+/*---------------------------------------------------------------------------*/
 static void
 rpl_set_preferred_parent(rpl_dag_t *dag, rpl_parent_t *p)
 {
@@ -164,7 +266,10 @@ rpl_set_preferred_parent(rpl_dag_t *dag, rpl_parent_t *p)
     nbr_table_unlock(rpl_parents, dag->preferred_parent);
     nbr_table_lock(rpl_parents, p);
     dag->preferred_parent = p;
-    p->flag = Pref_PRNT;
+    if(p != NULL) {
+      p->flag = Pref_PRNT;
+      candidate_remove(p);
+    }
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -570,8 +675,17 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
 
 //  PRINTF("RPL: rpl_add_parent lladdr %p\n", lladdr);
   if(lladdr != NULL) {
+    /* Re-adding a known neighbor clears its entry, so drop its
+       candidate slot first. */
+    p = nbr_table_get_from_lladdr(rpl_parents, (rimeaddr_t *)lladdr);
+    if(p != NULL) {
+      candidate_remove(p);
+    }
     /* Add parent in rpl_parents */
     p = nbr_table_add_lladdr(rpl_parents, (rimeaddr_t *)lladdr);
+    if(p == NULL) {
+      return NULL;
+    }
     p->dag = dag;
     p->rank = dio->rank;
     p->dtsn = dio->dtsn;
@@ -586,6 +700,7 @@ else
 #if RPL_DAG_MC != RPL_DAG_MC_NONE
     memcpy(&p->mc, &dio->mc, sizeof(p->mc));
 #endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
+    rpl_update_candidate(p);
   }
 
   return p;
@@ -755,6 +870,8 @@ rpl_remove_parent(rpl_parent_t *parent)
 //  PRINTF("\n");
 
   rpl_nullify_parent(parent);
+  candidate_remove(parent);
+  rpl_probe_forget(parent);
 
   nbr_table_remove(rpl_parents, parent);
 }
@@ -811,6 +928,7 @@ rpl_move_parent(rpl_dag_t *dag_src, rpl_dag_t *dag_dst, rpl_parent_t *parent)
   list_remove(dag_src->parents, parent);
   parent->dag = dag_dst;
   list_add(dag_dst->parents, parent);
+  rpl_update_candidate(parent);
 }
 /*---------------------------------------------------------------------------*/
 rpl_dag_t *
@@ -1299,6 +1417,7 @@ if (p!=NULL)
     } else {
       p->rank=dio->rank;
     }
+    rpl_update_candidate(p);
   }
 
 //  PRINTF("RPL: preferred DAG ");
@@ -1332,322 +1451,50 @@ if (p!=NULL)
 
 char find_pref(void)
 {
-	int timer;
-printf("find_pref\n");
-	if (tx_indx == 4)
-	{
-		pt_exist = rpl_pt_parents();
-	}
-	//	int i = 4;
-	//	int wait = PROBE_NUM_THRESHOLD * (PROBE_INTERVAL+1);
-	//	 etimer_set(&test_one_tx, wait*CLOCK_SECOND);
-		if(pt_exist==1)
-		{
-
-			set_output_power_field(Tx_array[tx_indx]);
-
-			timer = (PROBE_INTERVAL * CLOCK_SECOND);
-			ctimer_set(&probe_timer, timer, &handle_probe_timer, pt_parents);
-		}
+  char pt_exist;
 
-
-
-	return pt_exist;
+  if(rpl_probe_active()) {
+    /* A probing round is already running. */
+    return 0;
+  }
+  pt_exist = rpl_pt_parents();
+  if(pt_exist) {
+    rpl_probe_start(pt_parents, pt_count, probe_round_done);
+  }
+  return pt_exist;
 }
 
 /*---------------------------------------------------------------------------*/
-
-
-char rpl_pt_parents(void)
-{	
-	char pt_exist;
-	rpl_parent_t *p;
-	struct ip_addr_list_struct test;
-	uip_ipaddr_t *dest;
-	unsigned long age;
-rpl_rank_t srank;
-	rpl_parent_t * pref_parent;
-
-/*if(flag==0)
+char
+rpl_pt_parents(void)
 {
-	flag=1;
-	memb_init(&pt_prnt_mem);
-	list_init(ip_addr_list);
-	
-}*/
-pt_parents[0].rank=INFINITE_RANK;
-pt_parents[0].ipaddr=NULL;
-pt_parents[1]=pt_parents[0];
-pt_parents[2]=pt_parents[1];
-
-
-//printf("\nP_T={");
-
-//printf("rank= %u:{", (((&instance_table[0])->current_dag->rank)/256));
-pref_parent =(&instance_table[0])->current_dag->preferred_parent;
-p = nbr_table_head(rpl_parents);
-srank = p->dag->rank;
-  	for( ;p != NULL;p = nbr_table_next(rpl_parents, p)) 
-	{	
-				if(p==pref_parent)
-				{continue;}
-				dest=rpl_get_parent_ipaddr(p);
-				age = (clock_seconds()-(p->update_time))/2000;
-//				 printf("prnt rssi=%d,rank=%u\n",p->rssi, p->rank);
-				if(p->rssi > RSSI_THRESHOLD && (p->rank)<srank)// age<AGE_THRESHOLD &&
-				{	
-					p->numtx = 0;
-					p->recv = 0;
-					if(p->rank < pt_parents[0].rank)
-						{	
-							test=pt_parents[1];
-							pt_parents[1]=pt_parents[0];
-							pt_parents[2]=test;
-							pt_parents[0].rank=p->rank;
-							pt_parents[0].ipaddr=dest;
-							continue;	
-				
-						}
-					if(p->rank < pt_parents[1].rank)
-						{	
-							pt_parents[2]=pt_parents[1];
-							pt_parents[1].rank=p->rank;
-							pt_parents[1].ipaddr=dest;
-							continue;
-						}
-					if(p->rank < pt_parents[2].rank)
-						{	
-							pt_parents[2].rank= p->rank;
-							pt_parents[2].ipaddr= dest;
-						}
-				}
-		
-	}
-		
-	
-printf("P_T={%02x, %02x, %02x}\n",((uint8_t *)pt_parents[0].ipaddr)[15],((uint8_t *)pt_parents[1].ipaddr)[15],((uint8_t *)pt_parents[2].ipaddr)[15]);
-if(pt_parents[0].rank!=INFINITE_RANK)
-{
-	 pt_exist = 1;
-
-}
-else 
-{	
-	//printf("there is no pt_pref_prnt\n");
-	 pt_exist = 0;
-}
-return  pt_exist;
-	
-}
-/* -------------------------------------------------------------------------------*/
-static void handle_probe_timer(void *pt)
-{	struct ip_addr_list_struct *ptr;
-	uip_ipaddr_t *dest;
-	ptr =(struct ip_addr_list_struct *)pt;	
-	//ptr =(list_t)pt;	
-	index=0;
-	int rand_time=1*CLOCK_SECOND;
-
-
-	
-//printf("probe timer handler\n");
-	//for(i=0; ptr[i].rank!=INFINITE_RANK && i<3; i++)
-	//{	
-	if (ptr[0].rank==INFINITE_RANK)
-		return;
-	dest=ptr[index].ipaddr;
-
-	ctimer_set(&stagger_timer, rand_time, &handle_stagger_timer, dest);
-	probe_number ++;
-	if(probe_number<PROBE_NUM_THRESHOLD)
-	{     ctimer_reset(&probe_timer);
-	}
-	else 
-	{       
-		
-		return;
-	}
-}
-/*--------------------------------------------------------------------------------*/
-static void handle_find_pref_timer(void * ptr)
-{
-
-	rpl_dag_t *dag=(&instance_table[0])->current_dag;
-	rpl_parent_t *pref = dag->preferred_parent  ;
-	int etx;
-if(pref!=NULL){
-	etx =(pref->numtx)/(pref->recv);
-	Es_array[tx_indx] = pref->rank + (dag->Tx * (uint16_t)pref->link_metric);//dag->instance->of->calculate_path_metric(pref);
-if(tx_indx==4)
-{
-	pt_parents[1].rank=INFINITE_RANK;
-	pt_parents[1].ipaddr=NULL;
-	pt_parents[2]=pt_parents[1];
-	pt_parents[0].ipaddr = rpl_get_parent_ipaddr(pref);
-	pref->numtx=0;
-	pref->recv=0;
-	if (etx==2)
-	{
-		set_output_power_field(Tx_array[tx_indx]);
-
-	}
-	else
-	{
-		if(etx==1)
-		{tx_indx--;}
-		else
-		{tx_indx++;}
-		find_pref();
-	}
-
-}
-else{
-
-	if (etx==2)
-	{
-
-		set_output_power_field(Tx_array[tx_indx]);
-	}
-	else
-	{
-		if(etx==1)
-		{tx_indx--;
-
-		}
-		else
-		{tx_indx++;}
-
-		set_output_power_field(Tx_array[tx_indx]);
-	}
-
-}//pref!=Null
-
-}
-
-//	int i ;
-//	uip_ipaddr_t *dest;
-//	rpl_parent_t *p;
-//	rpl_dag_t *dag=(&instance_table[0])->current_dag;
-//	for(i=0; i<3 ; i++)
-//	{
-//		if(pt_parents[i].rank !=INFINITE_RANK )
-//		{
-//			dest=pt_parents[i].ipaddr;
-//
-//			p=rpl_find_parent(dag, dest);
-//			printf("new ETX=%d, numtx=%d , recv=%d\n", p->link_metric , p->numtx, p->recv);
-//
-//		}
-//
-//
-//	}
-}
-
-
-/*--------------------------------------------------------------------------------*/
-static void handle_stagger_timer(void * ptr)
-{
-int rand_time;
-uip_ipaddr_t *dest;
-dest=(uip_ipaddr_t *)ptr;
-
-probe_output(dest);
-//printf("probe %d ADDR=%02x%02x \n",probe_number,((uint8_t *)dest)[14], ((uint8_t *)dest)[15]);
-probe_total++;
-
-//printf("probe %d ADDR=%02x%02x \n",probe_number,((uint8_t *)dest)[14], ((uint8_t *)dest)[15]);
-//printf("UNJA");
-
-//printf("stagger-rand_timer=%d", rand_time);
-rand_time=(random_rand()*CLOCK_SECOND)*2/RANDOM_RAND_MAX;
-//rand_time=1*CLOCK_SECOND;
-index++;
-if (index<3 && pt_parents[index].rank !=INFINITE_RANK )
-	{
-	dest=pt_parents[index].ipaddr; 
-	ctimer_set(&stagger_timer, rand_time, &handle_stagger_timer, dest);
-	}
-else
-	{	
-		if(probe_number==(PROBE_NUM_THRESHOLD))
-
-		{	probe_number=0;
-			adjust_ETX_th();
-			printf("\nprobe_total=%d\n",probe_total);
-			ctimer_set(&find_pref_timer, 10*CLOCK_SECOND, &handle_find_pref_timer, NULL);
-
-		}
-	}
+  rpl_parent_t *p;
+  int i, n;
+
+  /* Take a snapshot of the candidate heap for this probing round. The
+     node's own rank may have changed since a candidate was inserted. */
+  n = 0;
+  for(i = 0; i < candidate_count; i++) {
+    p = candidates[i];
+    if(!candidate_eligible(p)) {
+      continue;
+    }
+    p->numtx = 0;
+    p->recv = 0;
+    pt_parents[n++] = p;
+    rpl_trace_parent(RPL_TRACE_CANDIDATE, p);
+  }
+  pt_count = n;
 
+  return n > 0;
 }
-
 /*--------------------------------------------------------------------------------*/
-void monitor_parents(void)
+static void
+probe_round_done(void)
 {
-	rpl_parent_t *p;
-	uip_ipaddr_t *dest;
- uint16_t temp1,temp2;
-	rpl_parent_t *pref_parent =(&instance_table[0])->current_dag->preferred_parent;
-//	rpl_instance_t *instance=&instance_table[0];
-temp1 = ((((&instance_table[0])->current_dag->rank)%256)*100)/256;
-	printf("rank= %u.%u:{", (((&instance_table[0])->current_dag->rank)/256), temp1);
-	for(p = nbr_table_head(rpl_parents); p != NULL ;     p = nbr_table_next(rpl_parents, p))
-	{	dest=rpl_get_parent_ipaddr(p);
-		printf("(");
-		if(p==pref_parent)
-			printf("pref-prnt ");
-		printf("%02x ", ((uint8_t *)dest)[15]);
-temp1 = ((p->link_metric%128)*100)/128;
-temp2 = ((p->rank%256)*100)/256;
-		printf("etx=%d.%2d,rank=%u.%2u,%d)", p->link_metric/128, temp1 ,p->rank/256 , temp2, p->rssi);
-		  /*PRINTF("RPL: My path ETX to the root is %u.%u\n",
-			instance->mc.obj.etx / RPL_DAG_MC_ETX_DIVISOR,
-			(instance->mc.obj.etx % RPL_DAG_MC_ETX_DIVISOR * 100) /
-			 RPL_DAG_MC_ETX_DIVISOR);*/
-		}
-	printf("}\n");
-
+  adjust_ETX_th();
+  /* Let the power controller act on the fresh link estimates. */
+  rpl_txpower_update(instance_table[0].current_dag);
 }
-/*--------------------------------------------------------------------------------*/
-void set_output_power_field(int pow)
-{
-
-rpl_dag_t *dag=(&instance_table[0])->current_dag;
-
-cc2420_set_txpower(pow);
-printf(" Tx=%d \n",pow);
-
-switch(pow) {
 
-case 3:
-	dag->Tx = 1; //0.003;//25.5 * coeff;
-	break;
-case 7:
-	dag->Tx = 1; //0.03;//29.7 * coeff;
-	break;
-case 11:
-	dag->Tx = 3; // 0.1;//33.6 * coeff;
-	break;
-
-case 15:
-	dag->Tx = 7; //0.2;//37.5* coeff;
-	break;
-
-case 19:
-	dag->Tx = 10;//0.3; //41.7* coeff;
-	break;
-
-case 23:
-	dag->Tx = 16; //0.5; //45.6* coeff;
-	break;
-
-case 27:
-	dag->Tx = 26;// 0.8; //49.5* coeff;
-	break;
-
-case 31:
-	dag->Tx = 33;//1; //52.2* coeff;
-
-}
-}
 #endif /* UIP_CONF_IPV6 */
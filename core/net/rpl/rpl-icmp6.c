@@ -73,9 +73,6 @@ static void dio_input(void);
 static void dao_input(void);
 static void dao_ack_input(void);
 
-//elnaz
-static int probe_total=0;
-//elnaz
 /* some debug callbacks useful when debugging RPL networks */
 #ifdef RPL_DEBUG_DIO_INPUT
 void RPL_DEBUG_DIO_INPUT(uip_ipaddr_t *, rpl_dio_t *);
@@ -895,13 +892,8 @@ void probe_output(uip_ipaddr_t *dest)
   buffer = UIP_ICMP_PAYLOAD;
 
   buffer[0] = buffer[1] = 0;
-probe_total++;
-printf("PROBE-MSG num=%d ADDR= %02x \n",probe_total, ((uint8_t *)dest)[15]);
-//printf("PROBE num=%d \n",probe_total, ((uint8_t *)dest)[15]);
+  /* rpl-probe.c counts the probes and traces each round. */
   uip_icmp6_send(dest, ICMP6_RPL, RPL_PROBE, 2);
-
-
-
 }
 
 
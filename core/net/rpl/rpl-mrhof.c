@@ -74,10 +74,6 @@ rpl_of_t rpl_mrhof = {
   1
 };
 
-/* Constants for the ETX moving average */
-#define ETX_SCALE   100
-#define ETX_ALPHA   90
-
 
 /* Reject parents that have a higher link metric than the following. */
 #define MAX_LINK_METRIC			10
@@ -96,10 +92,11 @@ typedef uint16_t rpl_path_metric_t;
 static rpl_path_metric_t
 calculate_path_metric(rpl_parent_t *p)
 {
-	rpl_dag_t *dag=p->dag;//Es
+	rpl_dag_t *dag;//Es
   if(p == NULL) {
-    return MAX_PATH_COST * RPL_DAG_MC_ETX_DIVISOR * dag->Tx; //Es
+    return MAX_PATH_COST * RPL_DAG_MC_ETX_DIVISOR;
   }
+  dag = p->dag;
 
 #if RPL_DAG_MC == RPL_DAG_MC_NONE
   return p->rank + (dag->Tx * (uint16_t)p->link_metric);//Es
@@ -113,7 +110,7 @@ calculate_path_metric(rpl_parent_t *p)
 }
 
 //elnaz
-static uint16_t ETX_THERESHOLD=(RPL_DAG_MC_ETX_DIVISOR*1.5);
+static uint16_t ETX_THERESHOLD=(RPL_DAG_MC_ETX_DIVISOR * 3 / 2);
 //elnaz
 static void
 reset(rpl_dag_t *sag)
@@ -169,8 +166,7 @@ p->recv++;
 dest=rpl_get_parent_ipaddr(p);
 //printf("numtx=%d ADDR=%02x%02x \n", numtx, ((uint8_t *)dest)[14], ((uint8_t *)dest)[15]);
 
-    new_etx = ((uint32_t)recorded_etx * ETX_ALPHA +
-               (uint32_t)packet_etx * (ETX_SCALE - ETX_ALPHA)) / ETX_SCALE;
+    new_etx = RPL_ETX_EWMA(recorded_etx, packet_etx);
 
     PRINTF("RPL: ETX changed from %u to %u (packet ETX = %u)\n",
         (unsigned)(recorded_etx / RPL_DAG_MC_ETX_DIVISOR),
@@ -189,10 +185,9 @@ dest=rpl_get_parent_ipaddr(p);
 //test = PROBE_NUM_THRESHOLD * PROBE_INTERVAL * 2;
 //printf("%lu , test= %d, delta=%d ", (clock_seconds()-last_probe_time),  test, (PROBE_NUM_THRESHOLD * PROBE_INTERVAL * 2) );
   pref = p->dag->preferred_parent;
-  temp = (p->link_metric)/RPL_DAG_MC_ETX_DIVISOR;
-  temp = temp * RPL_DAG_MC_ETX_DIVISOR;
+  temp = RPL_ETX_FLOOR(p->link_metric);
   if(temp>ETX_THERESHOLD && p==pref)
-	{	printf("pass threshhold ADDR=%02x etx=%u th=%u\n", ((uint8_t *)dest)[15],p->link_metric,ETX_THERESHOLD);
+	{	rpl_trace_value(RPL_TRACE_THRESHOLD, ((uint8_t *)dest)[15], ETX_THERESHOLD);
 		delta = (clock_seconds()-last_probe_time);
 		//printf("t=%lu , %lu,%lu, %lu \n",delta, delta*CLOCK_SECOND, 120, 120*CLOCK_SECOND);
 	if(delta>(wait*60))
@@ -230,7 +225,9 @@ dest=rpl_get_parent_ipaddr(p);
 else
 	{ //printf("error ADDR= %02x%02x \n",((uint8_t *)dest)[14], ((uint8_t *)dest)[15]);
 	}
-monitor_parents();
+  rpl_probe_link_callback(p, status, packet_etx);
+  rpl_txpower_link_callback(p, status, packet_etx);
+  rpl_trace_parent(RPL_TRACE_LINK, p);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -240,15 +237,14 @@ calculate_rank(rpl_parent_t *p, rpl_rank_t base_rank)
 {
   rpl_rank_t new_rank;
   rpl_rank_t rank_increase;
-  rpl_dag_t *dag=p->dag;//Es
 
   if(p == NULL) {
     if(base_rank == 0) {
       return INFINITE_RANK;
     }
-    rank_increase = RPL_INIT_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR* (dag->Tx);//Es
+    rank_increase = RPL_INIT_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
   } else {
-    rank_increase = (p->link_metric)* (dag->Tx);//Es
+    rank_increase = (p->link_metric)* (p->dag->Tx);//Es
     if(base_rank == 0) {
       base_rank = p->rank;
     }
@@ -197,6 +197,33 @@
  */
 #define RPL_DAG_MC_ETX_DIVISOR		8//128
 
+#if (RPL_DAG_MC_ETX_DIVISOR & (RPL_DAG_MC_ETX_DIVISOR - 1)) != 0
+#error "RPL_DAG_MC_ETX_DIVISOR must be a power of two"
+#endif
+
+/* Integer part of a fixed-point ETX value, still in fixed point. */
+#define RPL_ETX_FLOOR(etx)	((etx) & ~(RPL_DAG_MC_ETX_DIVISOR - 1))
+
+/*
+ * Moving average of the link ETX. Each sample moves the estimate
+ * 1/2^RPL_ETX_ALPHA_SHIFT of the way towards it, which gives
+ * alpha = 1 - 2^-RPL_ETX_ALPHA_SHIFT (0.875 by default). The step is
+ * rounded up so that the estimate can reach the sample even with the
+ * coarse RPL_DAG_MC_ETX_DIVISOR.
+ */
+#ifdef RPL_CONF_ETX_ALPHA_SHIFT
+#define RPL_ETX_ALPHA_SHIFT	RPL_CONF_ETX_ALPHA_SHIFT
+#else
+#define RPL_ETX_ALPHA_SHIFT	3
+#endif /* RPL_CONF_ETX_ALPHA_SHIFT */
+
+#define RPL_ETX_EWMA_STEP(diff)						\
+  (((diff) + (1 << RPL_ETX_ALPHA_SHIFT) - 1) >> RPL_ETX_ALPHA_SHIFT)
+#define RPL_ETX_EWMA(recorded, sample)					\
+  ((sample) >= (recorded) ?						\
+   (recorded) + RPL_ETX_EWMA_STEP((sample) - (recorded)) :		\
+   (recorded) - RPL_ETX_EWMA_STEP((recorded) - (sample)))
+
 /* DIS related */
 #define RPL_DIS_SEND                    1
 #ifdef  RPL_DIS_INTERVAL_CONF
@@ -210,6 +237,135 @@
 #define PROBE_NUM_THRESHOLD 10
 #define PROBE_INTERVAL 5
 
+/* Maximum number of potential preferred parents kept as probing
+   candidates and probed in each round. */
+#ifdef RPL_CONF_PROBE_CANDIDATES
+#define RPL_PROBE_CANDIDATES RPL_CONF_PROBE_CANDIDATES
+#else
+#define RPL_PROBE_CANDIDATES 3
+#endif /* RPL_CONF_PROBE_CANDIDATES */
+
+/* Number of probes kept in flight towards each candidate. */
+#ifdef RPL_CONF_PROBE_WINDOW
+#define RPL_PROBE_WINDOW RPL_CONF_PROBE_WINDOW
+#else
+#define RPL_PROBE_WINDOW 2
+#endif /* RPL_CONF_PROBE_WINDOW */
+
+/* Mean interval between two rounds of probe transmissions. */
+#ifdef RPL_CONF_PROBE_TICK
+#define RPL_PROBE_TICK RPL_CONF_PROBE_TICK
+#else
+#define RPL_PROBE_TICK (CLOCK_SECOND / 4)
+#endif /* RPL_CONF_PROBE_TICK */
+
+/* Outstanding probes without a MAC callback for this long are lost. */
+#ifdef RPL_CONF_PROBE_LOSS_TIMEOUT
+#define RPL_PROBE_LOSS_TIMEOUT RPL_CONF_PROBE_LOSS_TIMEOUT
+#else
+#define RPL_PROBE_LOSS_TIMEOUT (4 * CLOCK_SECOND)
+#endif /* RPL_CONF_PROBE_LOSS_TIMEOUT */
+
+/* A candidate is done once the ETX confidence interval half-width
+   is below RPL_PROBE_ETX_TOLERANCE, with at least
+   RPL_PROBE_MIN_SAMPLES samples. */
+#ifdef RPL_CONF_PROBE_MIN_SAMPLES
+#define RPL_PROBE_MIN_SAMPLES RPL_CONF_PROBE_MIN_SAMPLES
+#else
+#define RPL_PROBE_MIN_SAMPLES 4
+#endif /* RPL_CONF_PROBE_MIN_SAMPLES */
+
+#ifdef RPL_CONF_PROBE_ETX_TOLERANCE
+#define RPL_PROBE_ETX_TOLERANCE RPL_CONF_PROBE_ETX_TOLERANCE
+#else
+#define RPL_PROBE_ETX_TOLERANCE (RPL_DAG_MC_ETX_DIVISOR / 2)
+#endif /* RPL_CONF_PROBE_ETX_TOLERANCE */
+
+/*---------------------------------------------------------------------------*/
+/* Transmit power control */
+#define RPL_TXPOWER_LEVELS 8
+
+/* Power level used until the controller has made a decision. */
+#ifdef RPL_CONF_TXPOWER_INIT_LEVEL
+#define RPL_TXPOWER_INIT_LEVEL RPL_CONF_TXPOWER_INIT_LEVEL
+#else
+#define RPL_TXPOWER_INIT_LEVEL 4
+#endif /* RPL_CONF_TXPOWER_INIT_LEVEL */
+
+/* Interval between periodic power decisions; 0 disables them. */
+#ifdef RPL_CONF_TXPOWER_PERIOD
+#define RPL_TXPOWER_PERIOD RPL_CONF_TXPOWER_PERIOD
+#else
+#define RPL_TXPOWER_PERIOD (60 * CLOCK_SECOND)
+#endif /* RPL_CONF_TXPOWER_PERIOD */
+
+/* Estimates older than this many decisions are measured again. */
+#ifdef RPL_CONF_TXPOWER_MAX_AGE
+#define RPL_TXPOWER_MAX_AGE RPL_CONF_TXPOWER_MAX_AGE
+#else
+#define RPL_TXPOWER_MAX_AGE 5
+#endif /* RPL_CONF_TXPOWER_MAX_AGE */
+
+/* Try a higher level when the ETX at the current one exceeds this. */
+#ifdef RPL_CONF_TXPOWER_EXPLORE_UP_ETX
+#define RPL_TXPOWER_EXPLORE_UP_ETX RPL_CONF_TXPOWER_EXPLORE_UP_ETX
+#else
+#define RPL_TXPOWER_EXPLORE_UP_ETX (2 * RPL_DAG_MC_ETX_DIVISOR)
+#endif /* RPL_CONF_TXPOWER_EXPLORE_UP_ETX */
+
+/*---------------------------------------------------------------------------*/
+/* Event tracing */
+
+/* Number of records in the trace ring; must be a power of two. */
+#ifdef RPL_CONF_TRACE_SIZE
+#define RPL_TRACE_SIZE RPL_CONF_TRACE_SIZE
+#else
+#define RPL_TRACE_SIZE 32
+#endif /* RPL_CONF_TRACE_SIZE */
+
+#if (RPL_TRACE_SIZE & (RPL_TRACE_SIZE - 1)) != 0 || RPL_TRACE_SIZE > 128
+#error RPL_TRACE_SIZE must be a power of two no larger than 128
+#endif
+
+/* Drain the ring over the serial line. With 0, the records are left
+   for an external reader such as a Cooja script. */
+#ifdef RPL_CONF_TRACE_DRAIN
+#define RPL_TRACE_DRAIN RPL_CONF_TRACE_DRAIN
+#else
+#define RPL_TRACE_DRAIN 1
+#endif /* RPL_CONF_TRACE_DRAIN */
+
+#ifdef RPL_CONF_TRACE_DRAIN_INTERVAL
+#define RPL_TRACE_DRAIN_INTERVAL RPL_CONF_TRACE_DRAIN_INTERVAL
+#else
+#define RPL_TRACE_DRAIN_INTERVAL CLOCK_SECOND
+#endif /* RPL_CONF_TRACE_DRAIN_INTERVAL */
+
+/* Trace record types. Parent records carry the link ETX, rank and
+   RSSI of the parent; the others carry the node's own rank and one
+   value in the etx field. */
+#define RPL_TRACE_LINK        1 /* MAC callback for a parent */
+#define RPL_TRACE_CANDIDATE   2 /* Parent selected for a probing round */
+#define RPL_TRACE_THRESHOLD   3 /* Preferred parent above the ETX
+                                   threshold; etx holds the threshold */
+#define RPL_TRACE_TXPOWER     4 /* New power level in id, PA level in etx */
+#define RPL_TRACE_PROBE_DONE  5 /* Round over id targets; etx holds
+                                   the total number of probes */
+#define RPL_TRACE_DROPPED     6 /* etx holds the number of lost records */
+
+/* Set in the type of parent records for the preferred parent. */
+#define RPL_TRACE_PREFERRED 0x80
+
+struct rpl_trace_record {
+  uint16_t time;
+  uint8_t type;
+  uint8_t id;
+  uint16_t etx;
+  uint16_t rank;
+  int8_t rssi;
+  uint8_t tx;
+};
+
 /*---------------------------------------------------------------------------*/
 /* Lollipop counters */
 
@@ -317,11 +473,30 @@ rpl_dag_t *rpl_select_dag(rpl_instance_t *instance,rpl_parent_t *parent);
 void rpl_recalculate_ranks(void);
 //elnaz
 char rpl_pt_parents(void);
+void rpl_update_candidate(rpl_parent_t *);
 char find_pref(void);
-void monitor_parents(void);
 void adjust_ETX_th(void);
 //elnaz
 
+/* Probing of candidate parents. */
+int rpl_probe_start(rpl_parent_t **parents, int count, void (*done)(void));
+int rpl_probe_active(void);
+void rpl_probe_forget(rpl_parent_t *);
+void rpl_probe_link_callback(rpl_parent_t *, int status, uint16_t packet_etx);
+
+/* Transmit power control. */
+void rpl_txpower_init(void);
+void rpl_txpower_update(rpl_dag_t *);
+void rpl_txpower_link_callback(rpl_parent_t *, int status, uint16_t packet_etx);
+int rpl_txpower_get_level(void);
+uint8_t rpl_txpower_get_pa_level(int level);
+uint16_t rpl_txpower_get_etx(rpl_parent_t *, int level);
+
+/* Event tracing. */
+void rpl_trace_init(void);
+void rpl_trace_parent(uint8_t type, rpl_parent_t *);
+void rpl_trace_value(uint8_t type, uint8_t id, uint16_t value);
+
 
 /* RPL routing table functions. */
 void rpl_remove_routes(rpl_dag_t *dag);
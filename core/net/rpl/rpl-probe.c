@@ -0,0 +1,261 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \file
+ *         Pipelined probing of candidate parents.
+ *
+ *         A probing round keeps up to RPL_PROBE_WINDOW probes in flight
+ *         towards every target, collects the ETX of each probe from the
+ *         MAC callback, and finishes a target as soon as the confidence
+ *         interval of its ETX estimate is tight enough.
+ */
+
+#include "contiki.h"
+#include "net/rpl/rpl-private.h"
+#include "net/mac/mac.h"
+#include "net/packetbuf.h"
+#include "lib/random.h"
+#include "sys/ctimer.h"
+
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#if UIP_CONF_IPV6
+/*---------------------------------------------------------------------------*/
+struct probe_target {
+  rpl_parent_t *parent;
+  uip_ipaddr_t *ipaddr;
+  clock_time_t last_event;
+  uint8_t sent;
+  uint8_t outstanding;
+  uint8_t samples;
+  uint8_t converged;
+  uint16_t sum;
+  uint32_t sum_sq;
+};
+
+static struct probe_target targets[RPL_PROBE_CANDIDATES];
+static uint8_t target_count;
+static uint8_t active;
+static uint8_t sending;
+static uint16_t probe_total;
+static void (*round_done)(void);
+static struct ctimer tick_timer;
+
+static void handle_tick_timer(void *ptr);
+/*---------------------------------------------------------------------------*/
+static int
+target_done(struct probe_target *t)
+{
+  return t->converged ||
+    (t->sent >= PROBE_NUM_THRESHOLD && t->outstanding == 0);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The ETX estimate is good enough when the half-width of its ~95%
+ * confidence interval, 2 * sqrt(var / n), is at most
+ * RPL_PROBE_ETX_TOLERANCE. With n * var = sum_sq - sum^2 / n this
+ * becomes 4 * (n * sum_sq - sum^2) <= tol^2 * n^3, which needs no
+ * square root or division.
+ */
+static int
+target_converged(struct probe_target *t)
+{
+  uint32_t n = t->samples;
+  uint32_t spread;
+
+  if(n < RPL_PROBE_MIN_SAMPLES) {
+    return 0;
+  }
+  spread = n * t->sum_sq - (uint32_t)t->sum * t->sum;
+  return 4 * spread <= (uint32_t)RPL_PROBE_ETX_TOLERANCE *
+    RPL_PROBE_ETX_TOLERANCE * n * n * n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+finish_round(void)
+{
+  active = 0;
+  ctimer_stop(&tick_timer);
+  rpl_trace_value(RPL_TRACE_PROBE_DONE, target_count, probe_total);
+  if(round_done != NULL) {
+    round_done();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+schedule_tick(void)
+{
+  clock_time_t interval;
+
+  /* Jitter the ticks so that neighbors probing at the same time
+     do not stay in lock step. */
+  interval = RPL_PROBE_TICK / 2 + random_rand() % (RPL_PROBE_TICK / 2 + 1);
+  ctimer_set(&tick_timer, interval, handle_tick_timer, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_tick_timer(void *ptr)
+{
+  struct probe_target *t;
+  clock_time_t now;
+  int pending;
+
+  now = clock_time();
+  pending = 0;
+  for(t = targets; t < &targets[target_count]; t++) {
+    if(target_done(t)) {
+      continue;
+    }
+    if(t->outstanding > 0 &&
+       (clock_time_t)(now - t->last_event) > RPL_PROBE_LOSS_TIMEOUT) {
+      /* The MAC callbacks for these probes are not coming back. */
+      t->outstanding = 0;
+    }
+    if(t->outstanding < RPL_PROBE_WINDOW && t->sent < PROBE_NUM_THRESHOLD) {
+      sending = 1;
+      probe_output(t->ipaddr);
+      sending = 0;
+      t->sent++;
+      t->outstanding++;
+      t->last_event = now;
+      probe_total++;
+    }
+    if(!target_done(t)) {
+      pending = 1;
+    }
+  }
+
+  if(pending) {
+    schedule_tick();
+  } else {
+    finish_round();
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_probe_start(rpl_parent_t **parents, int count, void (*done)(void))
+{
+  struct probe_target *t;
+  int i;
+
+  if(active || count <= 0) {
+    return 0;
+  }
+  if(count > RPL_PROBE_CANDIDATES) {
+    count = RPL_PROBE_CANDIDATES;
+  }
+
+  memset(targets, 0, sizeof(targets));
+  t = targets;
+  for(i = 0; i < count; i++) {
+    t->ipaddr = rpl_get_parent_ipaddr(parents[i]);
+    if(t->ipaddr != NULL) {
+      t->parent = parents[i];
+      t++;
+    }
+  }
+  target_count = t - targets;
+  if(target_count == 0) {
+    return 0;
+  }
+  round_done = done;
+  active = 1;
+
+  PRINTF("RPL: probing %u candidates\n", target_count);
+  handle_tick_timer(NULL);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_probe_active(void)
+{
+  return active;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_probe_sending(void)
+{
+  /* sicslowpan.c marks the frames of a probe with
+     PACKETBUF_ATTR_RPL_PROBE while this is set. */
+  return sending;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_probe_forget(rpl_parent_t *p)
+{
+  struct probe_target *t;
+
+  for(t = targets; t < &targets[target_count]; t++) {
+    if(t->parent == p) {
+      /* Stop probing a parent that left the neighbor table. */
+      t->parent = NULL;
+      t->converged = 1;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_probe_link_callback(rpl_parent_t *p, int status, uint16_t packet_etx)
+{
+  struct probe_target *t;
+
+  /* Only the probes themselves are samples of the round. */
+  if(!active || !packetbuf_attr(PACKETBUF_ATTR_RPL_PROBE)) {
+    return;
+  }
+
+  for(t = targets; t < &targets[target_count]; t++) {
+    if(t->parent != p || target_done(t)) {
+      continue;
+    }
+    if(t->outstanding > 0) {
+      t->outstanding--;
+    }
+    t->last_event = clock_time();
+    if((status == MAC_TX_OK || status == MAC_TX_NOACK) && t->samples < 0xff) {
+      t->samples++;
+      t->sum += packet_etx;
+      t->sum_sq += (uint32_t)packet_etx * packet_etx;
+      t->converged = target_converged(t);
+    }
+    return;
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* UIP_CONF_IPV6 */
@@ -0,0 +1,198 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \file
+ *         Binary event trace for RPL parent and link state.
+ *
+ *         Events are written as fixed-size records into a ring buffer
+ *         in constant time, so that they can be recorded from the
+ *         per-packet path without disturbing it. A low-priority process
+ *         drains the ring over the serial line as hex dumps, which are
+ *         turned into text off the node by tools/rpl-trace/parse-rpl-trace.
+ *         Simulations can instead read rpl_trace_buf directly from the
+ *         mote memory and advance rpl_trace_get.
+ */
+
+#include "contiki.h"
+#include "net/rpl/rpl-private.h"
+
+#include <stdio.h>
+
+#if UIP_CONF_IPV6
+/*---------------------------------------------------------------------------*/
+/* Not static, so that they can be located by an external reader. */
+struct rpl_trace_record rpl_trace_buf[RPL_TRACE_SIZE];
+volatile uint8_t rpl_trace_put, rpl_trace_get;
+static uint16_t dropped;
+
+#if RPL_TRACE_DRAIN
+PROCESS(rpl_trace_process, "RPL trace");
+#endif /* RPL_TRACE_DRAIN */
+/*---------------------------------------------------------------------------*/
+static struct rpl_trace_record *
+alloc_record(uint8_t type)
+{
+  struct rpl_trace_record *r;
+
+  if((uint8_t)(rpl_trace_put - rpl_trace_get) >= RPL_TRACE_SIZE) {
+    /* Keep the oldest records; the reader learns about the gap. */
+    if(dropped < 0xffff) {
+      dropped++;
+    }
+    return NULL;
+  }
+  r = &rpl_trace_buf[rpl_trace_put & (RPL_TRACE_SIZE - 1)];
+  r->time = (uint16_t)clock_time();
+  r->type = type;
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_trace_parent(uint8_t type, rpl_parent_t *p)
+{
+  struct rpl_trace_record *r;
+  rimeaddr_t *lladdr;
+
+  r = alloc_record(type);
+  if(r == NULL) {
+    return;
+  }
+  lladdr = rpl_get_parent_lladdr(p);
+  r->id = lladdr != NULL ? lladdr->u8[RIMEADDR_SIZE - 1] : 0;
+  r->etx = p->link_metric;
+  r->rank = p->rank;
+  r->rssi = p->rssi;
+  r->tx = rpl_txpower_get_pa_level(rpl_txpower_get_level());
+  if(p->dag != NULL && p->dag->preferred_parent == p) {
+    r->type |= RPL_TRACE_PREFERRED;
+  }
+  rpl_trace_put++;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_trace_value(uint8_t type, uint8_t id, uint16_t value)
+{
+  struct rpl_trace_record *r;
+  rpl_dag_t *dag;
+
+  r = alloc_record(type);
+  if(r == NULL) {
+    return;
+  }
+  dag = rpl_get_any_dag();
+  r->id = id;
+  r->etx = value;
+  r->rank = dag != NULL ? dag->rank : INFINITE_RANK;
+  r->rssi = 0;
+  r->tx = rpl_txpower_get_pa_level(rpl_txpower_get_level());
+  rpl_trace_put++;
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_TRACE_DRAIN
+static void
+put_hex(uint16_t value, int digits)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  while(digits-- > 0) {
+    putchar(hex[(value >> (digits * 4)) & 0xf]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * One line per record: "RT" followed by time, type, id, etx, rank,
+ * rssi and tx power in hex, most significant digit first.
+ */
+static void
+drain_record(struct rpl_trace_record *r)
+{
+  putchar('R');
+  putchar('T');
+  putchar(' ');
+  put_hex(r->time, 4);
+  put_hex(r->type, 2);
+  put_hex(r->id, 2);
+  put_hex(r->etx, 4);
+  put_hex(r->rank, 4);
+  put_hex((uint8_t)r->rssi, 2);
+  put_hex(r->tx, 2);
+  putchar('\n');
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(rpl_trace_process, ev, data)
+{
+  static struct etimer et;
+  struct rpl_trace_record *r;
+  uint16_t lost;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&et, RPL_TRACE_DRAIN_INTERVAL);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+
+    while(rpl_trace_get != rpl_trace_put) {
+      r = &rpl_trace_buf[rpl_trace_get & (RPL_TRACE_SIZE - 1)];
+      drain_record(r);
+      rpl_trace_get++;
+      /* Let everything else run between two records. */
+      PROCESS_PAUSE();
+    }
+    if(dropped > 0) {
+      /* The ring is empty now, so this record always fits. */
+      lost = dropped;
+      dropped = 0;
+      rpl_trace_value(RPL_TRACE_DROPPED, 0, lost);
+    }
+  }
+
+  PROCESS_END();
+}
+#endif /* RPL_TRACE_DRAIN */
+/*---------------------------------------------------------------------------*/
+void
+rpl_trace_init(void)
+{
+  rpl_trace_put = rpl_trace_get = 0;
+  dropped = 0;
+#if RPL_TRACE_DRAIN
+  process_set_priority(&rpl_trace_process, PROCESS_PRIORITY_LOW);
+  process_start(&rpl_trace_process, NULL);
+#endif /* RPL_TRACE_DRAIN */
+}
+/*---------------------------------------------------------------------------*/
+#endif /* UIP_CONF_IPV6 */
@@ -0,0 +1,281 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \file
+ *         Closed-loop transmit power control for RPL.
+ *
+ *         For every parent, an ETX estimate is kept per output power
+ *         level. The controller picks the level that minimizes the
+ *         expected radio energy per delivered packet, ETX(level) times
+ *         the radio current at that level, and periodically revisits
+ *         stale levels so that it can follow improving links.
+ */
+
+#include "contiki.h"
+#include "net/rpl/rpl-private.h"
+#include "net/nbr-table.h"
+#include "net/mac/mac.h"
+#include "dev/cc2420.h"
+#include "sys/ctimer.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#if UIP_CONF_IPV6
+/*---------------------------------------------------------------------------*/
+/* CC2420 PA_LEVEL settings, from the lowest to the highest output power. */
+static const uint8_t pa_levels[RPL_TXPOWER_LEVELS] = {
+  3, 7, 11, 15, 19, 23, 27, 31
+};
+
+/* Radio current in TX at each PA level, in 0.1 mA (CC2420 datasheet). */
+static const uint8_t tx_current[RPL_TXPOWER_LEVELS] = {
+  85, 99, 112, 125, 139, 152, 165, 174
+};
+
+/* Weight of the link ETX in the MRHOF path metric at each level. */
+static const uint8_t metric_weight[RPL_TXPOWER_LEVELS] = {
+  1, 1, 3, 7, 10, 16, 26, 33
+};
+
+/* Per-neighbor link statistics, one ETX estimate per power level. */
+struct txpower_link {
+  uint16_t etx[RPL_TXPOWER_LEVELS]; /* 0 means no estimate */
+  uint8_t age[RPL_TXPOWER_LEVELS];  /* decisions since the last sample */
+};
+NBR_TABLE(struct txpower_link, txpower_links);
+
+static int current_level = RPL_TXPOWER_INIT_LEVEL;
+#if RPL_TXPOWER_PERIOD
+static struct ctimer update_timer;
+#endif /* RPL_TXPOWER_PERIOD */
+
+static void explore_done(void);
+/*---------------------------------------------------------------------------*/
+static struct txpower_link *
+get_link(rpl_parent_t *p, int create)
+{
+  rimeaddr_t *lladdr;
+  struct txpower_link *link;
+
+  lladdr = rpl_get_parent_lladdr(p);
+  if(lladdr == NULL) {
+    return NULL;
+  }
+  link = nbr_table_get_from_lladdr(txpower_links, lladdr);
+  if(link == NULL && create) {
+    link = nbr_table_add_lladdr(txpower_links, lladdr);
+  }
+  return link;
+}
+/*---------------------------------------------------------------------------*/
+static int
+fresh(struct txpower_link *link, int level)
+{
+  return link->etx[level] != 0 && link->age[level] <= RPL_TXPOWER_MAX_AGE;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+energy_cost(struct txpower_link *link, int level)
+{
+  return (uint32_t)link->etx[level] * tx_current[level];
+}
+/*---------------------------------------------------------------------------*/
+static void
+apply_level(rpl_dag_t *dag, int level)
+{
+  current_level = level;
+  cc2420_set_txpower(pa_levels[level]);
+  if(dag != NULL) {
+    dag->Tx = metric_weight[level];
+  }
+  rpl_trace_value(RPL_TRACE_TXPOWER, level, pa_levels[level]);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Picks the output power level for the link to p. Returns the level
+ * and sets *explore if the level has no fresh estimate and must be
+ * measured before it can be trusted.
+ */
+static int
+decide(struct txpower_link *link, int *explore)
+{
+  int level;
+  int best;
+  uint32_t cost;
+  uint32_t best_cost;
+
+  *explore = 0;
+  best = current_level;
+  best_cost = fresh(link, best) ? energy_cost(link, best) : 0xffffffff;
+  for(level = 0; level < RPL_TXPOWER_LEVELS; level++) {
+    if(level != current_level && fresh(link, level)) {
+      cost = energy_cost(link, level);
+      if(cost < best_cost) {
+        best = level;
+        best_cost = cost;
+      }
+    }
+  }
+
+  if(best == current_level) {
+    if(best > 0 && !fresh(link, best - 1)) {
+      /* A lower level may have become usable since it was last tried. */
+      *explore = 1;
+      best--;
+    } else if(best < RPL_TXPOWER_LEVELS - 1 && !fresh(link, best + 1) &&
+              link->etx[best] > RPL_TXPOWER_EXPLORE_UP_ETX) {
+      /* The current level is lossy; see whether more power pays off. */
+      *explore = 1;
+      best++;
+    }
+  }
+
+  for(level = 0; level < RPL_TXPOWER_LEVELS; level++) {
+    if(link->age[level] < 0xff) {
+      link->age[level]++;
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_txpower_update(rpl_dag_t *dag)
+{
+  rpl_parent_t *pref;
+  struct txpower_link *link;
+  int level;
+  int explore;
+
+  if(dag == NULL || dag->preferred_parent == NULL || rpl_probe_active()) {
+    return;
+  }
+  pref = dag->preferred_parent;
+  link = get_link(pref, 1);
+  if(link == NULL) {
+    return;
+  }
+
+  level = decide(link, &explore);
+  PRINTF("RPL: tx power level %d -> %d%s\n", current_level, level,
+         explore ? " (exploring)" : "");
+  if(level != current_level || dag->Tx != metric_weight[level]) {
+    apply_level(dag, level);
+  }
+  if(explore) {
+    /* Measure the new level on the preferred parent right away. */
+    rpl_probe_start(&pref, 1, explore_done);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+explore_done(void)
+{
+  if(default_instance != NULL) {
+    rpl_txpower_update(default_instance->current_dag);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_TXPOWER_PERIOD
+static void
+handle_update_timer(void *ptr)
+{
+  if(default_instance != NULL && default_instance->current_dag != NULL &&
+     default_instance->current_dag->rank != ROOT_RANK(default_instance)) {
+    rpl_txpower_update(default_instance->current_dag);
+  }
+  ctimer_reset(&update_timer);
+}
+#endif /* RPL_TXPOWER_PERIOD */
+/*---------------------------------------------------------------------------*/
+void
+rpl_txpower_link_callback(rpl_parent_t *p, int status, uint16_t packet_etx)
+{
+  struct txpower_link *link;
+  uint16_t *etx;
+
+  if(status != MAC_TX_OK && status != MAC_TX_NOACK) {
+    return;
+  }
+  link = get_link(p, 1);
+  if(link == NULL) {
+    return;
+  }
+
+  etx = &link->etx[current_level];
+  if(*etx == 0) {
+    *etx = packet_etx;
+  } else {
+    /* EWMA with alpha = 3/4. */
+    *etx = (uint16_t)(((uint32_t)*etx * 3 + packet_etx) >> 2);
+  }
+  link->age[current_level] = 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_txpower_get_level(void)
+{
+  return current_level;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+rpl_txpower_get_pa_level(int level)
+{
+  return level >= 0 && level < RPL_TXPOWER_LEVELS ? pa_levels[level] : 0;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+rpl_txpower_get_etx(rpl_parent_t *p, int level)
+{
+  struct txpower_link *link;
+
+  if(level < 0 || level >= RPL_TXPOWER_LEVELS) {
+    return 0;
+  }
+  link = get_link(p, 0);
+  return link != NULL ? link->etx[level] : 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_txpower_init(void)
+{
+  nbr_table_register(txpower_links, NULL);
+#if RPL_TXPOWER_PERIOD
+  ctimer_set(&update_timer, RPL_TXPOWER_PERIOD, handle_update_timer, NULL);
+#endif /* RPL_TXPOWER_PERIOD */
+}
+/*---------------------------------------------------------------------------*/
+#endif /* UIP_CONF_IPV6 */
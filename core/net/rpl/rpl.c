@@ -224,6 +224,8 @@ rpl_init(void)
   default_instance = NULL;
 
   rpl_dag_init();
+  rpl_txpower_init();
+  rpl_trace_init();
   rpl_reset_periodic_timer();
 
   /* add rpl multicast address */
@@ -122,6 +122,7 @@ struct rpl_parent {
   char flag;
   int numtx;
   int recv;
+  uint8_t candidate; /* 1-based slot in the probing candidate heap, 0 if none */
 };
 typedef struct rpl_parent rpl_parent_t;
 /*---------------------------------------------------------------------------*/
@@ -233,15 +234,6 @@ struct rpl_instance {
   struct ctimer dao_timer;
 };
 /*---------------------------------------------------------------------------*/
-//elnaz
-struct ip_addr_list_struct{
-  //
-// struct ip_addr_list_struct *next;
-  uip_ipaddr_t * ipaddr;
-rpl_rank_t rank;
-};
-//elnaz
-/*---------------------------------------------------------------------------*/
 /* Public RPL functions. */
 void rpl_init(void);
 void uip_rpl_input(void);
@@ -258,8 +250,10 @@ void rpl_insert_header(void);
 void rpl_remove_header(void);
 uint8_t rpl_invert_header(void);
 uip_ipaddr_t *rpl_get_parent_ipaddr(rpl_parent_t *nbr);
+rimeaddr_t *rpl_get_parent_lladdr(rpl_parent_t *nbr);
 rpl_rank_t rpl_get_parent_rank(uip_lladdr_t *addr);
 uint16_t rpl_get_parent_link_metric(uip_lladdr_t *addr);
 void rpl_dag_init(void);
+int rpl_probe_sending(void);
 /*---------------------------------------------------------------------------*/
 #endif /* RPL_H */
@@ -67,6 +67,10 @@
 #include "net/sicslowpan.h"
 #include "net/netstack.h"
 
+#if UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl.h"
+#endif /* UIP_CONF_IPV6_RPL */
+
 #if UIP_CONF_IPV6
 
 #include <stdio.h>
@@ -214,40 +218,96 @@ static uint8_t uncomp_hdr_len;
 static int last_tx_status;
 /** @} */
 
+/** Forward fragments without reassembling the packets we route. */
+#define SICSLOWPAN_FRAG_FORWARD (SICSLOWPAN_CONF_FRAG && \
+                                 SICSLOWPAN_CONF_FRAG_FORWARD && \
+                                 UIP_CONF_ROUTER)
+
 #if SICSLOWPAN_CONF_FRAG
 /** \name Fragmentation related variables
  *  @{
  */
 
-static uint16_t sicslowpan_len;
+/**
+ * A packet being reassembled, identified by the sender and the tag
+ * and size of its fragments.
+ */
+struct sicslowpan_reass {
+  /**
+   * The buffer used for the 6lowpan reassembly.
+   * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
+   * It has a fix size as we do not use dynamic memory allocation.
+   */
+  uip_buf_t buf;
+
+  /** The total length of the IPv6 packet in the buffer, 0 if unused. */
+  uint16_t len;
+
+  /**
+   * length of the ip packet already received.
+   * It includes IP and transport headers.
+   */
+  uint16_t processed_len;
+
+  /** The tag in the fragments being merged. */
+  uint16_t tag;
+
+  /** The source address of the fragments being merged */
+  rimeaddr_t sender;
+
+  /** Reassembly %process %timer. */
+  struct timer timer;
+};
 
 /**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
+ * The packets being reassembled. Each takes UIP_BUFSIZE bytes, so
+ * SICSLOWPAN_REASS_CONTEXTS is the memory budget for reassembly.
  */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
+static struct sicslowpan_reass reass[SICSLOWPAN_REASS_CONTEXTS];
 
-/** The total length of the IPv6 packet in the sicslowpan_buf. */
+/** The reassembly the current fragment belongs to. */
+static struct sicslowpan_reass *cur_reass;
 
 /**
- * length of the ip packet already sent / received.
- * It includes IP and transport headers.
+ * The buffer the current packet is uncompressed into: the reassembly
+ * buffer for fragments, uip_buf for packets that are not fragmented.
  */
-static uint16_t processed_ip_in_len;
+static uint8_t *sicslowpan_buf = uip_buf;
+#define sicslowpan_len (cur_reass->len)
+#define processed_ip_in_len (cur_reass->processed_len)
 
 /** Datagram tag to be put in the fragments I send. */
 static uint16_t my_tag;
 
-/** When reassembling, the tag in the fragments being merged. */
-static uint16_t reass_tag;
+#if SICSLOWPAN_FRAG_FORWARD
+/**
+ * A packet routed through this node whose fragments are forwarded as
+ * they arrive. The first fragment sets up the entry, which maps the
+ * sender and tag of the incoming fragments to the next hop and the
+ * tag of the outgoing ones.
+ */
+struct sicslowpan_frag_fwd {
+  /** The size of the IPv6 packet, 0 if unused. */
+  uint16_t size;
+  /** The tag in the incoming fragments. */
+  uint16_t tag;
+  /** The previous hop. */
+  rimeaddr_t sender;
+  /** The tag in the outgoing fragments. */
+  uint16_t out_tag;
+  /** The next hop. */
+  rimeaddr_t nexthop;
+  /** Bytes of the IPv6 packet forwarded so far. */
+  uint16_t forwarded;
+  struct timer timer;
+};
 
-/** When reassembling, the source address of the fragments being merged */
-rimeaddr_t frag_sender;
+static struct sicslowpan_frag_fwd frag_fwd[SICSLOWPAN_FRAG_FORWARD_ENTRIES];
+#endif /* SICSLOWPAN_FRAG_FORWARD */
 
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+#if SICSLOWPAN_STATS
+struct sicslowpan_stats sicslowpan_stats;
+#endif /* SICSLOWPAN_STATS */
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
@@ -1344,6 +1404,64 @@ send_packet(rimeaddr_t *dest)
   watchdog_periodic();
 }
 /*--------------------------------------------------------------------*/
+/**
+ * \brief Compress the headers of the IP packet in uip_buf into the
+ * rime buffer, setting rime_hdr_len and uncomp_hdr_len.
+ * \param dest the link layer destination address of the packet
+ */
+static void
+compress_hdr(rimeaddr_t *dest)
+{
+  if(uip_len >= COMPRESSION_THRESHOLD) {
+    /* Try to compress the headers */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1
+    compress_hdr_hc1(dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6
+    compress_hdr_ipv6(dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+    compress_hdr_hc06(dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+  } else {
+    compress_hdr_ipv6(dest);
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief The length of the NETSTACK_FRAMER header for a frame to dest
+ *
+ * The header is added in the NETSTACK_RDC. We calculate it here only
+ * to make a better decision of whether the outgoing packet needs to
+ * be fragmented or not. This clears packetbuf, but leaves the data in
+ * the rime buffer in place.
+ */
+static int
+get_framer_hdrlen(rimeaddr_t *dest)
+{
+  int framer_hdrlen;
+
+#define USE_FRAMER_HDRLEN 1
+#if USE_FRAMER_HDRLEN
+  packetbuf_clear();
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, dest);
+  framer_hdrlen = NETSTACK_FRAMER.create();
+  if(framer_hdrlen < 0) {
+    /* Framing failed, we assume the maximum header length */
+    framer_hdrlen = 21;
+  }
+  packetbuf_clear();
+
+  /* We must set the max transmissions attribute again after clearing
+     the buffer. */
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+#else /* USE_FRAMER_HDRLEN */
+  framer_hdrlen = 21;
+#endif /* USE_FRAMER_HDRLEN */
+  return framer_hdrlen;
+}
+/*--------------------------------------------------------------------*/
 /** \brief Take an IP packet and format it to be sent on an 802.15.4
  *  network using 6lowpan.
  *  \param localdest The MAC address of the destination
@@ -1381,6 +1499,14 @@ output(uip_lladdr_t *localdest)
     set_packet_attrs();
   }
 
+#if UIP_CONF_IPV6_RPL
+  /* Mark the probes of RPL, so that their MAC callback is told from
+     those of the other packets to the same neighbor. */
+  if(rpl_probe_sending()) {
+    packetbuf_set_attr(PACKETBUF_ATTR_RPL_PROBE, 1);
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+
 #define TCP_FIN 0x01
 #define TCP_ACK 0x10
 #define TCP_CTL 0x3f
@@ -1409,43 +1535,11 @@ output(uip_lladdr_t *localdest)
   
   PRINTFO("sicslowpan output: sending packet len %d\n", uip_len);
 
-  if(uip_len >= COMPRESSION_THRESHOLD) {
-    /* Try to compress the headers */
-#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1
-    compress_hdr_hc1(&dest);
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1 */
-#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6
-    compress_hdr_ipv6(&dest);
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6 */
-#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
-    compress_hdr_hc06(&dest);
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
-  } else {
-    compress_hdr_ipv6(&dest);
-  }
+  compress_hdr(&dest);
   PRINTFO("sicslowpan output: header of len %d\n", rime_hdr_len);
 
-  /* Calculate NETSTACK_FRAMER's header length, that will be added in the NETSTACK_RDC.
-   * We calculate it here only to make a better decision of whether the outgoing packet
-   * needs to be fragmented or not. */
-#define USE_FRAMER_HDRLEN 1
-#if USE_FRAMER_HDRLEN
-  packetbuf_clear();
-  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &dest);
-  framer_hdrlen = NETSTACK_FRAMER.create();
-  if(framer_hdrlen < 0) {
-    /* Framing failed, we assume the maximum header length */
-    framer_hdrlen = 21;
-  }
-  packetbuf_clear();
-
-  /* We must set the max transmissions attribute again after clearing
-     the buffer. */
-  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
-                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
-#else /* USE_FRAMER_HDRLEN */
-  framer_hdrlen = 21;
-#endif /* USE_FRAMER_HDRLEN */
+  /* Calculate NETSTACK_FRAMER's header length, that will be added in the NETSTACK_RDC. */
+  framer_hdrlen = get_framer_hdrlen(&dest);
 
   if((int)uip_len - (int)uncomp_hdr_len > (int)MAC_MAX_PAYLOAD - framer_hdrlen - (int)rime_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
@@ -1491,6 +1585,7 @@ output(uip_lladdr_t *localdest)
       return 0;
     }
     send_packet(&dest);
+    SICSLOWPAN_STAT(sicslowpan_stats.frags_out++);
     queuebuf_to_packetbuf(q);
     queuebuf_free(q);
     q = NULL;
@@ -1537,6 +1632,7 @@ output(uip_lladdr_t *localdest)
         return 0;
       }
       send_packet(&dest);
+      SICSLOWPAN_STAT(sicslowpan_stats.frags_out++);
       queuebuf_to_packetbuf(q);
       queuebuf_free(q);
       q = NULL;
@@ -1568,6 +1664,291 @@ output(uip_lladdr_t *localdest)
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the reassembly that a fragment belongs to
+ * \param size The size of the IPv6 packet, from the fragment header
+ * \param tag The datagram tag, from the fragment header
+ * \param first Non-zero for a FRAG1, which may start a reassembly
+ *
+ * A FRAG1 starts a reassembly in a free or timed out context. A
+ * router that forwards fragments as they arrive interleaves the
+ * fragments of several packets, so a new packet from a sender does
+ * not end the reassembly of an older one. If all contexts are busy,
+ * the oldest reassembly is discarded, which lessens the negative
+ * impacts of too high SICSLOWPAN_REASS_MAXAGE.
+ */
+static struct sicslowpan_reass *
+reass_lookup(uint16_t size, uint16_t tag, uint8_t first)
+{
+  const rimeaddr_t *sender;
+  struct sicslowpan_reass *r, *found;
+
+  sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+  found = NULL;
+  for(r = reass; r < &reass[SICSLOWPAN_REASS_CONTEXTS]; r++) {
+    if(r->len != 0 && timer_expired(&r->timer)) {
+      /* if reassembly timed out, cancel it */
+      r->len = 0;
+      SICSLOWPAN_STAT(sicslowpan_stats.reass_timeout++);
+    }
+    if(r->len == 0 || !rimeaddr_cmp(&r->sender, sender)) {
+      continue;
+    }
+    if(r->tag == tag && r->len == size) {
+      return r;
+    }
+  }
+
+  if(!first) {
+    return NULL;
+  }
+
+  for(r = reass; r < &reass[SICSLOWPAN_REASS_CONTEXTS]; r++) {
+    if(r->len == 0) {
+      found = r;
+      break;
+    }
+    if(found == NULL ||
+       timer_remaining(&r->timer) < timer_remaining(&found->timer)) {
+      found = r;
+    }
+  }
+  if(found->len != 0) {
+    PRINTFI("sicslowpan input: no free reassembly context\n");
+    SICSLOWPAN_STAT(sicslowpan_stats.reass_dropped++);
+  }
+
+  found->len = size;
+  found->processed_len = 0;
+  found->tag = tag;
+  rimeaddr_copy(&found->sender, sender);
+  timer_set(&found->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
+  PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
+          size, tag);
+  return found;
+}
+#endif /* SICSLOWPAN_CONF_FRAG */
+#if SICSLOWPAN_FRAG_FORWARD
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the forwarding entry of a packet
+ *
+ * Timed out entries are freed on the way.
+ */
+static struct sicslowpan_frag_fwd *
+frag_fwd_lookup(uint16_t size, uint16_t tag)
+{
+  const rimeaddr_t *sender;
+  struct sicslowpan_frag_fwd *f;
+
+  sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+  for(f = frag_fwd; f < &frag_fwd[SICSLOWPAN_FRAG_FORWARD_ENTRIES]; f++) {
+    if(f->size != 0 && timer_expired(&f->timer)) {
+      f->size = 0;
+    }
+    if(f->size == size && f->tag == tag &&
+       rimeaddr_cmp(&f->sender, sender)) {
+      return f;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward the first fragment of a packet routed through us
+ * \param size The size of the IPv6 packet
+ * \param tag The datagram tag in the fragment
+ * \param len The bytes of the IPv6 packet in this fragment
+ * \return 1 if the fragment was forwarded or dropped, 0 if the packet
+ * has to be reassembled
+ *
+ * The first fragment has been uncompressed into uip_buf. Its headers
+ * are processed as uip6.c does for a packet it forwards, compressed
+ * again for the next hop, and sent with the rest of the fragment.
+ * Neither this fragment nor the ones that go through frag_fwd_next()
+ * take a reassembly buffer. When 0 is returned, uip_buf holds the
+ * fragment as it was received.
+ */
+static int
+frag_fwd_first(uint16_t size, uint16_t tag, uint16_t len)
+{
+  struct sicslowpan_frag_fwd *f, *entry;
+  uip_ds6_route_t *route;
+  uip_ds6_nbr_t *nbr;
+  uip_ipaddr_t *nexthop;
+  rimeaddr_t sender, dest;
+  int framer_hdrlen;
+
+  /* The first fragment may come again if its ack was lost. */
+  f = frag_fwd_lookup(size, tag);
+  if(f != NULL) {
+    f->size = 0;
+  }
+  rimeaddr_copy(&sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+
+  uip_len = size;
+  uip_ext_len = 0;
+
+  /* Only unicast packets that uip6.c would forward */
+  if(uip_ds6_is_my_addr(&UIP_IP_BUF->destipaddr) ||
+     uip_ds6_is_my_maddr(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_loopback(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->srcipaddr) ||
+     uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) ||
+     uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr) ||
+     size > UIP_LINK_MTU || UIP_IP_BUF->ttl <= 1) {
+    /* uip6.c takes care of these, and of the ICMP errors */
+    return 0;
+  }
+
+#if UIP_CONF_IPV6_RPL
+  /* The RPL option can be updated in place, but not inserted. */
+  if(UIP_IP_BUF->proto != UIP_PROTO_HBHO ||
+     len < UIP_IPH_LEN + ((uip_buf[UIP_LLIPH_LEN + 1] + 1) << 3) ||
+     uip_buf[UIP_LLIPH_LEN + 2] != UIP_EXT_HDR_OPT_RPL) {
+    return 0;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+
+  /* Next hop determination, as in tcpip_ipv6_output() */
+  if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)) {
+    nexthop = &UIP_IP_BUF->destipaddr;
+  } else {
+    route = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr);
+    if(route != NULL) {
+      nexthop = uip_ds6_route_nexthop(route);
+    } else {
+      nexthop = uip_ds6_defrt_choose();
+    }
+  }
+  if(nexthop == NULL) {
+    return 0;
+  }
+  /* Packets that wait for address resolution are reassembled. */
+  nbr = uip_ds6_nbr_lookup(nexthop);
+  if(nbr == NULL || nbr->state == NBR_INCOMPLETE) {
+    return 0;
+  }
+  rimeaddr_copy(&dest, (const rimeaddr_t *)uip_ds6_nbr_get_ll(nbr));
+
+  entry = NULL;
+  for(f = frag_fwd; f < &frag_fwd[SICSLOWPAN_FRAG_FORWARD_ENTRIES]; f++) {
+    if(f->size == 0) {
+      entry = f;
+      break;
+    }
+  }
+  if(entry == NULL) {
+    return 0;
+  }
+
+  /* Build the first fragment for the next hop. Only the IPv6 header
+     is compressed, so the packet is left as it was received if the
+     fragment does not fit. */
+  UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+  framer_hdrlen = get_framer_hdrlen(&dest);
+  uncomp_hdr_len = 0;
+  rime_hdr_len = 0;
+  rime_ptr = packetbuf_dataptr();
+  compress_hdr(&dest);
+  rime_payload_len = len - uncomp_hdr_len;
+  if(len < uncomp_hdr_len ||
+     SICSLOWPAN_FRAG1_HDR_LEN + rime_hdr_len + rime_payload_len >
+     MAC_MAX_PAYLOAD - framer_hdrlen) {
+    /* The headers did not compress as well for the next hop. */
+    PRINTFI("sicslowpan forward: first fragment too large, reassembling\n");
+    UIP_IP_BUF->ttl = UIP_IP_BUF->ttl + 1;
+    return 0;
+  }
+
+  /* Hop-by-hop processing, as in uip6.c. The RPL option is in the
+     uncompressed part of the fragment. */
+#if UIP_CONF_IPV6_RPL
+  if(rpl_verify_header(2)) {
+    PRINTFI("sicslowpan forward: RPL option error, dropping packet\n");
+    SICSLOWPAN_STAT(sicslowpan_stats.frags_dropped++);
+    return 1;
+  }
+  rpl_update_header_empty();
+  if(rpl_update_header_final(nexthop)) {
+    SICSLOWPAN_STAT(sicslowpan_stats.frags_dropped++);
+    return 1;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+  memmove(rime_ptr + SICSLOWPAN_FRAG1_HDR_LEN, rime_ptr, rime_hdr_len);
+  SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | size));
+  SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, my_tag);
+  rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
+  memcpy(rime_ptr + rime_hdr_len, (uint8_t *)UIP_IP_BUF + uncomp_hdr_len,
+         rime_payload_len);
+  packetbuf_set_datalen(rime_hdr_len + rime_payload_len);
+
+  entry->size = size;
+  entry->tag = tag;
+  rimeaddr_copy(&entry->sender, &sender);
+  entry->out_tag = my_tag++;
+  rimeaddr_copy(&entry->nexthop, &dest);
+  entry->forwarded = len;
+  timer_set(&entry->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
+  PRINTFI("sicslowpan forward: size %d, tag %d -> %d\n",
+          size, tag, entry->out_tag);
+
+  send_packet(&dest);
+  SICSLOWPAN_STAT(sicslowpan_stats.frags_forwarded++);
+  if((last_tx_status == MAC_TX_COLLISION) ||
+     (last_tx_status == MAC_TX_ERR) ||
+     (last_tx_status == MAC_TX_ERR_FATAL)) {
+    /* The next hop cannot reassemble this packet any more. */
+    entry->size = 0;
+  }
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward a subsequent fragment of a packet whose first
+ * fragment has been forwarded
+ * \return 1 if the fragment was forwarded, 0 if it does not belong
+ * to a forwarded packet
+ */
+static int
+frag_fwd_next(uint16_t size, uint16_t tag, uint8_t offset)
+{
+  struct sicslowpan_frag_fwd *f;
+  uint8_t frame[PACKETBUF_SIZE];
+  uint16_t len;
+
+  f = frag_fwd_lookup(size, tag);
+  if(f == NULL) {
+    return 0;
+  }
+
+  /* Only the tag changes on the way. */
+  len = packetbuf_datalen();
+  memcpy(frame, packetbuf_dataptr(), len);
+  SET16(frame, RIME_FRAG_TAG, f->out_tag);
+  packetbuf_clear();
+  packetbuf_copyfrom(frame, len);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  send_packet(&f->nexthop);
+  SICSLOWPAN_STAT(sicslowpan_stats.frags_forwarded++);
+
+  f->forwarded += len - SICSLOWPAN_FRAGN_HDR_LEN;
+  if(f->forwarded >= f->size ||
+     (offset << 3) + len - SICSLOWPAN_FRAGN_HDR_LEN >= f->size ||
+     (last_tx_status == MAC_TX_COLLISION) ||
+     (last_tx_status == MAC_TX_ERR) ||
+     (last_tx_status == MAC_TX_ERR_FATAL)) {
+    f->size = 0;
+  }
+  return 1;
+}
+#endif /* SICSLOWPAN_FRAG_FORWARD */
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
@@ -1603,11 +1984,9 @@ input(void)
   rime_ptr = packetbuf_dataptr();
 
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
+  /* Packets that are not fragmented are uncompressed in place. */
+  sicslowpan_buf = uip_buf;
+  cur_reass = NULL;
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1640,70 +2019,45 @@ input(void)
              frag_size, frag_tag, frag_offset);
       rime_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
 
-      /* If this is the last fragment, we may shave off any extrenous
-         bytes at the end. We must be liberal in what we accept. */
-      PRINTFI("last_fragment?: processed_ip_in_len %d rime_payload_len %d frag_size %d\n",
-              processed_ip_in_len, packetbuf_datalen() - rime_hdr_len, frag_size);
-
-      if(processed_ip_in_len + packetbuf_datalen() - rime_hdr_len >= frag_size) {
-        last_fragment = 1;
-      }
       is_fragment = 1;
       break;
     default:
       break;
   }
 
-  /* We are currently reassembling a packet, but have just received the first
-   * fragment of another packet. We can either ignore it and hope to receive
-   * the rest of the under-reassembly packet fragments, or we can discard the
-   * previous packet altogether, and start reassembling the new packet.
-   *
-   * We discard the previous packet, and start reassembling the new packet.
-   * This lessens the negative impacts of too high SICSLOWPAN_REASS_MAXAGE.
-   */
-#define PRIORITIZE_NEW_PACKETS 1
-#if PRIORITIZE_NEW_PACKETS
-  if(processed_ip_in_len > 0 && first_fragment
-      && !rimeaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
-#endif /* PRIORITIZE_NEW_PACKETS */
-
-  if(processed_ip_in_len > 0) {
-    /* reassembly is ongoing */
-    /*    printf("frag %d %d\n", reass_tag, frag_tag);*/
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !rimeaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
-      /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+  if(is_fragment) {
+    SICSLOWPAN_STAT(sicslowpan_stats.frags_in++);
+    if(frag_size == 0 || frag_size > UIP_BUFSIZE - UIP_LLH_LEN) {
       return;
     }
-  } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if((frag_size > 0) && (frag_size <= UIP_BUFSIZE)) {
-      /* We are currently not reassembling a packet, but have received a packet fragment
-       * that is not the first one. */
-      if(is_fragment && !first_fragment) {
+#if SICSLOWPAN_FRAG_FORWARD
+    if(!first_fragment && frag_fwd_next(frag_size, frag_tag, frag_offset)) {
+      return;
+    }
+#endif /* SICSLOWPAN_FRAG_FORWARD */
+    /* When forwarding, a first fragment is uncompressed into uip_buf
+       and only takes a reassembly buffer if it is not forwarded. */
+    if(!(SICSLOWPAN_FRAG_FORWARD && first_fragment)) {
+      cur_reass = reass_lookup(frag_size, frag_tag, first_fragment);
+      if(cur_reass == NULL) {
+        /*
+         * the packet is a fragment that does not belong to a packet
+         * being reassembled.
+         */
+        PRINTFI("sicslowpan input: Dropping 6lowpan fragment of a packet not being reassembled\n");
+        SICSLOWPAN_STAT(sicslowpan_stats.frags_dropped++);
         return;
       }
+      sicslowpan_buf = cur_reass->buf.u8;
 
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
-      PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      rimeaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      /* If this is the last fragment, we may shave off any extrenous
+         bytes at the end. We must be liberal in what we accept. */
+      PRINTFI("last_fragment?: processed_ip_in_len %d rime_payload_len %d frag_size %d\n",
+              processed_ip_in_len, packetbuf_datalen() - rime_hdr_len, frag_size);
+      if(!first_fragment &&
+         processed_ip_in_len + packetbuf_datalen() - rime_hdr_len >= frag_size) {
+        last_fragment = 1;
+      }
     }
   }
 
@@ -1766,11 +2120,11 @@ input(void)
   {
     int req_size = UIP_LLH_LEN + uncomp_hdr_len + (uint16_t)(frag_offset << 3)
         + rime_payload_len;
-    if(req_size > sizeof(sicslowpan_buf)) {
+    if(req_size > UIP_BUFSIZE) {
       PRINTF(
           "SICSLOWPAN: packet dropped, minimum required SICSLOWPAN_IP_BUF size: %d+%d+%d+%d=%d (current size: %d)\n",
           UIP_LLH_LEN, uncomp_hdr_len, (uint16_t)(frag_offset << 3),
-          rime_payload_len, req_size, sizeof(sicslowpan_buf));
+          rime_payload_len, req_size, UIP_BUFSIZE);
       return;
     }
   }
@@ -1779,8 +2133,27 @@ input(void)
   
   /* update processed_ip_in_len if fragment, sicslowpan_len otherwise */
 
+#if SICSLOWPAN_FRAG_FORWARD
+  if(first_fragment) {
+    uint16_t hdr_len = uncomp_hdr_len, payload_len = rime_payload_len;
+
+    if(hdr_len + payload_len < frag_size &&
+       frag_fwd_first(frag_size, frag_tag, hdr_len + payload_len)) {
+      uip_len = 0;
+      return;
+    }
+    uip_len = 0;
+    /* Reassemble the packet after all. */
+    cur_reass = reass_lookup(frag_size, frag_tag, 1);
+    sicslowpan_buf = cur_reass->buf.u8;
+    memcpy(SICSLOWPAN_IP_BUF, UIP_IP_BUF, hdr_len + payload_len);
+    uncomp_hdr_len = hdr_len;
+    rime_payload_len = payload_len;
+  }
+#endif /* SICSLOWPAN_FRAG_FORWARD */
+
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0) {
+  if(cur_reass != NULL) {
     /* Add the size of the header only for the first fragment. */
     if(first_fragment != 0) {
       processed_ip_in_len += uncomp_hdr_len;
@@ -1794,49 +2167,45 @@ input(void)
     }
     PRINTF("processed_ip_in_len %d, rime_payload_len %d\n", processed_ip_in_len, rime_payload_len);
 
-  } else {
-#endif /* SICSLOWPAN_CONF_FRAG */
-    sicslowpan_len = rime_payload_len + uncomp_hdr_len;
-#if SICSLOWPAN_CONF_FRAG
-  }
-
-  /*
-   * If we have a full IP packet in sicslowpan_buf, deliver it to
-   * the IP stack
-   */
-  PRINTF("sicslowpan_init processed_ip_in_len %d, sicslowpan_len %d\n",
-         processed_ip_in_len, sicslowpan_len);
-  if(processed_ip_in_len == 0 || (processed_ip_in_len == sicslowpan_len)) {
+    if(processed_ip_in_len != sicslowpan_len) {
+      return;
+    }
+    /*
+     * We have a full IP packet in sicslowpan_buf, deliver it to
+     * the IP stack
+     */
     PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
            sicslowpan_len);
     memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
     uip_len = sicslowpan_len;
     sicslowpan_len = 0;
-    processed_ip_in_len = 0;
+    SICSLOWPAN_STAT(sicslowpan_stats.reassembled++);
+  } else
 #endif /* SICSLOWPAN_CONF_FRAG */
+  {
+    /* The packet was uncompressed in place. */
+    uip_len = rime_payload_len + uncomp_hdr_len;
+  }
 
 #if DEBUG
-    {
-      uint16_t ndx;
-      PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
-      for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
-        uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
-        PRINTF("%02x", data);
-      }
-      PRINTF("\n");
+  {
+    uint16_t ndx;
+    PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
+    for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
+      uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
+      PRINTF("%02x", data);
     }
+    PRINTF("\n");
+  }
 #endif
 
-    /* if callback is set then set attributes and call */
-    if(callback) {
-      set_packet_attrs();
-      callback->input_callback();
-    }
-
-    tcpip_input();
-#if SICSLOWPAN_CONF_FRAG
+  /* if callback is set then set attributes and call */
+  if(callback) {
+    set_packet_attrs();
+    callback->input_callback();
   }
-#endif /* SICSLOWPAN_CONF_FRAG */
+
+  tcpip_input();
 }
 /** @} */
 
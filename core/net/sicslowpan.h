@@ -317,6 +317,31 @@ struct sicslowpan_nh_compressor {
 
 };
 
+#ifdef SICSLOWPAN_CONF_STATS
+#define SICSLOWPAN_STATS SICSLOWPAN_CONF_STATS
+#else
+#define SICSLOWPAN_STATS 0
+#endif
+
+#if SICSLOWPAN_STATS
+/** Fragmentation statistics. */
+struct sicslowpan_stats {
+  uint16_t frags_in;      /**< Fragments received. */
+  uint16_t frags_dropped; /**< Fragments of no packet being reassembled. */
+  uint16_t reassembled;   /**< Packets reassembled and delivered. */
+  uint16_t reass_timeout; /**< Reassemblies that timed out. */
+  uint16_t reass_dropped; /**< Reassemblies given up for lack of a context. */
+  uint16_t frags_out;     /**< Fragments sent. */
+  uint16_t frags_forwarded; /**< Fragments forwarded without reassembly. */
+};
+
+extern struct sicslowpan_stats sicslowpan_stats;
+
+#define SICSLOWPAN_STAT(code) (code)
+#else
+#define SICSLOWPAN_STAT(code)
+#endif /* SICSLOWPAN_STATS */
+
 
 extern const struct network_driver sicslowpan_driver;
 
@@ -65,6 +65,33 @@ LIST(notificationlist);
 
 static int num_routes = 0;
 
+#if UIP_DS6_ROUTE_INDEX
+/* Host routes (/128) are found through an open-addressed hash table
+   with linear probing. Each slot holds the index of a route in
+   routememb plus one, 0 marks an empty slot. The table is kept at
+   most half full. Routes with shorter prefixes are marked in a bitmap
+   and searched only when no host route matches. */
+#define ROUTE_HASH_SIZE (UIP_DS6_ROUTE_NB <= 8 ? 16 : \
+                         UIP_DS6_ROUTE_NB <= 16 ? 32 : \
+                         UIP_DS6_ROUTE_NB <= 32 ? 64 : \
+                         UIP_DS6_ROUTE_NB <= 64 ? 128 : \
+                         UIP_DS6_ROUTE_NB <= 128 ? 256 : \
+                         UIP_DS6_ROUTE_NB <= 256 ? 512 : \
+                         UIP_DS6_ROUTE_NB <= 512 ? 1024 : \
+                         UIP_DS6_ROUTE_NB <= 1024 ? 2048 : 4096)
+#define ROUTE_HASH_MASK (ROUTE_HASH_SIZE - 1)
+#if UIP_DS6_ROUTE_NB > 2048
+#error UIP_DS6_ROUTE_INDEX supports at most 2048 routes
+#elif UIP_DS6_ROUTE_NB < 255
+typedef uint8_t route_slot_t;
+#else
+typedef uint16_t route_slot_t;
+#endif
+static route_slot_t route_hash[ROUTE_HASH_SIZE];
+static uint8_t prefix_routes[(UIP_DS6_ROUTE_NB + 7) / 8];
+static int num_prefix_routes;
+#endif /* UIP_DS6_ROUTE_INDEX */
+
 #undef DEBUG
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
@@ -136,10 +163,142 @@ uip_ds6_notification_rm(struct uip_ds6_notification *n)
 }
 #endif
 /*---------------------------------------------------------------------------*/
+#if UIP_DS6_ROUTE_INDEX
+static unsigned
+route_index(uip_ds6_route_t *r)
+{
+  return r - (uip_ds6_route_t *)routememb.mem;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+route_from_slot(route_slot_t slot)
+{
+  return &((uip_ds6_route_t *)routememb.mem)[slot - 1];
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+route_hash_addr(const uip_ipaddr_t *addr)
+{
+  uint32_t h = 0;
+  int i;
+  for(i = 0; i < 8; i++) {
+    h = (h * 31) + addr->u16[i];
+  }
+  /* Addresses in a DAG differ in a few bits of the interface
+     identifier only, so mix those into the low bits. */
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return h & ROUTE_HASH_MASK;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_add(uip_ds6_route_t *r)
+{
+  unsigned i = route_index(r);
+  unsigned slot;
+
+  if(r->length == 128) {
+    slot = route_hash_addr(&r->ipaddr);
+    while(route_hash[slot] != 0) {
+      slot = (slot + 1) & ROUTE_HASH_MASK;
+    }
+    route_hash[slot] = i + 1;
+  } else {
+    prefix_routes[i / 8] |= 1 << (i % 8);
+    num_prefix_routes++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Must be called before the address or length of a route changes. */
+static void
+index_remove(uip_ds6_route_t *r)
+{
+  unsigned i = route_index(r);
+  unsigned hole, slot, home;
+
+  if(r->length != 128) {
+    if(prefix_routes[i / 8] & (1 << (i % 8))) {
+      prefix_routes[i / 8] &= ~(1 << (i % 8));
+      num_prefix_routes--;
+    }
+    return;
+  }
+
+  hole = route_hash_addr(&r->ipaddr);
+  while(route_hash[hole] != i + 1) {
+    if(route_hash[hole] == 0) {
+      return;
+    }
+    hole = (hole + 1) & ROUTE_HASH_MASK;
+  }
+  /* Shift back the rest of the probe sequence instead of leaving a
+     tombstone. */
+  slot = hole;
+  while(1) {
+    slot = (slot + 1) & ROUTE_HASH_MASK;
+    if(route_hash[slot] == 0) {
+      break;
+    }
+    home = route_hash_addr(&route_from_slot(route_hash[slot])->ipaddr);
+    if(((slot - home) & ROUTE_HASH_MASK) >= ((slot - hole) & ROUTE_HASH_MASK)) {
+      route_hash[hole] = route_hash[slot];
+      hole = slot;
+    }
+  }
+  route_hash[hole] = 0;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+index_lookup(uip_ipaddr_t *addr)
+{
+  uip_ds6_route_t *r;
+  uip_ds6_route_t *found_route;
+  uint8_t longestmatch;
+  unsigned slot, i;
+
+  /* A host route is always the longest match. */
+  slot = route_hash_addr(addr);
+  while(route_hash[slot] != 0) {
+    r = route_from_slot(route_hash[slot]);
+    if(uip_ipaddr_cmp(addr, &r->ipaddr)) {
+      return r;
+    }
+    slot = (slot + 1) & ROUTE_HASH_MASK;
+  }
+
+  found_route = NULL;
+  longestmatch = 0;
+  if(num_prefix_routes > 0) {
+    for(i = 0; i < UIP_DS6_ROUTE_NB; i++) {
+      if(prefix_routes[i / 8] == 0) {
+        i |= 7;
+        continue;
+      }
+      if((prefix_routes[i / 8] & (1 << (i % 8))) == 0) {
+        continue;
+      }
+      r = &((uip_ds6_route_t *)routememb.mem)[i];
+      if(r->length >= longestmatch &&
+         uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
+        longestmatch = r->length;
+        found_route = r;
+      }
+    }
+  }
+  return found_route;
+}
+#endif /* UIP_DS6_ROUTE_INDEX */
+/*---------------------------------------------------------------------------*/
 void
 uip_ds6_route_init(void)
 {
   memb_init(&routememb);
+#if UIP_DS6_ROUTE_INDEX
+  memset(route_hash, 0, sizeof(route_hash));
+  memset(prefix_routes, 0, sizeof(prefix_routes));
+  num_prefix_routes = 0;
+#endif /* UIP_DS6_ROUTE_INDEX */
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 
@@ -216,15 +375,19 @@ uip_ds6_route_num_routes(void)
 uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *addr)
 {
-  uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
+#if !UIP_DS6_ROUTE_INDEX
+  uip_ds6_route_t *r;
   uint8_t longestmatch;
+#endif /* !UIP_DS6_ROUTE_INDEX */
 
   PRINTF("uip-ds6-route: Looking up route for ");
   PRINT6ADDR(addr);
   PRINTF("\n");
 
-
+#if UIP_DS6_ROUTE_INDEX
+  found_route = index_lookup(addr);
+#else /* UIP_DS6_ROUTE_INDEX */
   found_route = NULL;
   longestmatch = 0;
   for(r = uip_ds6_route_head();
@@ -236,6 +399,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
       found_route = r;
     }
   }
+#endif /* UIP_DS6_ROUTE_INDEX */
 
   if(found_route != NULL) {
     PRINTF("uip-ds6-route: Found route: ");
@@ -277,6 +441,9 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
     PRINTF("uip_ds6_route_add: old route already found, updating this one instead: ");
     PRINT6ADDR(ipaddr);
     PRINTF("\n");
+#if UIP_DS6_ROUTE_INDEX
+    index_remove(r);
+#endif /* UIP_DS6_ROUTE_INDEX */
   } else {
     struct uip_ds6_route_neighbor_routes *routes;
     /* If there is no routing entry, create one */
@@ -330,6 +497,9 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
+#if UIP_DS6_ROUTE_INDEX
+  index_add(r);
+#endif /* UIP_DS6_ROUTE_INDEX */
 
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
@@ -366,6 +536,9 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
     PRINTF("\n");
 
     list_remove(route->routes->route_list, route);
+#if UIP_DS6_ROUTE_INDEX
+    index_remove(route);
+#endif /* UIP_DS6_ROUTE_INDEX */
     if(list_head(route->routes->route_list) == NULL) {
       /* If this was the only route using this neighbor, remove the
          neibhor from the table */
@@ -80,6 +80,16 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 #define UIP_DS6_ROUTE_NB UIP_CONF_MAX_ROUTES
 #endif /* UIP_CONF_MAX_ROUTES */
 
+/* Index host routes in a hash table, and keep shorter prefixes apart,
+   so that uip_ds6_route_lookup() does not walk the whole routing
+   table. By default only used for tables where a walk is expensive,
+   e.g. on RPL roots. */
+#ifdef UIP_CONF_DS6_ROUTE_INDEX
+#define UIP_DS6_ROUTE_INDEX UIP_CONF_DS6_ROUTE_INDEX
+#else /* UIP_CONF_DS6_ROUTE_INDEX */
+#define UIP_DS6_ROUTE_INDEX (UIP_DS6_ROUTE_NB > 16)
+#endif /* UIP_CONF_DS6_ROUTE_INDEX */
+
 /** \brief define some additional RPL related route state and
  *  neighbor callback for RPL - if not a DS6_ROUTE_STATE is already set */
 #ifndef UIP_DS6_ROUTE_STATE_TYPE
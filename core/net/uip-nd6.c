@@ -530,10 +530,8 @@ uip_nd6_na_input(void)
     nbr->queue_buf_len = 0;
     return;
     }*/
-  if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
-    uip_len = uip_packetqueue_buflen(&nbr->packethandle);
-    memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-    uip_packetqueue_free(&nbr->packethandle);
+  if(uip_packetqueue_pop(&nbr->packethandle)) {
+    /* tcpip_ipv6_output() sends this one and then the rest */
     return;
   }
   
@@ -955,10 +953,9 @@ uip_nd6_ra_input(void)
     nbr->queue_buf_len = 0;
     return;
     }*/
-  if(nbr != NULL && uip_packetqueue_buflen(&nbr->packethandle) != 0) {
-    uip_len = uip_packetqueue_buflen(&nbr->packethandle);
-    memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-    uip_packetqueue_free(&nbr->packethandle);
+  if(nbr != NULL && nbr->state != NBR_INCOMPLETE &&
+     uip_packetqueue_pop(&nbr->packethandle)) {
+    /* tcpip_ipv6_output() sends this one and then the rest */
     return;
   }
 
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "net/uip.h"
 
@@ -6,8 +7,7 @@
 
 #include "net/uip-packetqueue.h"
 
-#define MAX_NUM_QUEUED_PACKETS 2
-MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
+MEMB(packets_memb, struct uip_packetqueue_packet, UIP_PACKETQUEUE_NUM);
 
 #define DEBUG 0
 #if DEBUG
@@ -18,14 +18,39 @@ MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
 #endif
 
 /*---------------------------------------------------------------------------*/
+/* Drop the packets of a queue that have outlived their lifetime. */
 static void
-packet_timedout(void *ptr)
+purge(struct uip_packetqueue_handle *h)
 {
-  struct uip_packetqueue_handle *h = ptr;
+  struct uip_packetqueue_packet **pp, *p;
 
-  PRINTF("uip_packetqueue_free timed out %p\n", h);
-  memb_free(&packets_memb, h->packet);
-  h->packet = NULL;
+  pp = &h->packet;
+  while(*pp != NULL) {
+    p = *pp;
+    if(timer_expired(&p->lifetime)) {
+      PRINTF("uip_packetqueue packet timed out %p\n", h);
+      *pp = p->next;
+      memb_free(&packets_memb, p);
+      UIP_STAT(++uip_stat.nd6.queue_drop);
+    } else {
+      pp = &p->next;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Make room in the pool by dropping timed out packets of any queue. */
+static void
+purge_all(void)
+{
+  struct uip_packetqueue_packet *p;
+  int i;
+
+  p = (struct uip_packetqueue_packet *)packets_memb.mem;
+  for(i = 0; i < UIP_PACKETQUEUE_NUM; i++, p++) {
+    if(packets_memb.count[i] > 0 && timer_expired(&p->lifetime)) {
+      purge(p->handle);
+    }
+  }
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -35,52 +60,89 @@ uip_packetqueue_new(struct uip_packetqueue_handle *handle)
   handle->packet = NULL;
 }
 /*---------------------------------------------------------------------------*/
-struct uip_packetqueue_packet *
-uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime)
+int
+uip_packetqueue_push(struct uip_packetqueue_handle *handle,
+                     clock_time_t lifetime)
 {
-  PRINTF("uip_packetqueue_alloc %p\n", handle);
-  if(handle->packet != NULL) {
-    PRINTF("alloced\n");
-    return NULL;
+  struct uip_packetqueue_packet **pp, *p;
+  int n;
+
+  PRINTF("uip_packetqueue_push %p\n", handle);
+  purge(handle);
+  n = 0;
+  for(pp = &handle->packet; *pp != NULL; pp = &(*pp)->next) {
+    n++;
   }
-  handle->packet = memb_alloc(&packets_memb);
-  if(handle->packet != NULL) {
-    ctimer_set(&handle->packet->lifetimer, lifetime,
-               packet_timedout, handle);
-  } else {
-    PRINTF("uip_packetqueue_alloc failed\n");
+  if(n >= UIP_PACKETQUEUE_MAX_PER_NBR || uip_len > sizeof(p->queue_buf)) {
+    PRINTF("uip_packetqueue_push: queue full\n");
+    UIP_STAT(++uip_stat.nd6.queue_drop);
+    return 0;
   }
-  return handle->packet;
-}
-/*---------------------------------------------------------------------------*/
-void
-uip_packetqueue_free(struct uip_packetqueue_handle *handle)
-{
-  PRINTF("uip_packetqueue_free %p\n", handle);
-  if(handle->packet != NULL) {
-    ctimer_stop(&handle->packet->lifetimer);
-    memb_free(&packets_memb, handle->packet);
-    handle->packet = NULL;
+  p = memb_alloc(&packets_memb);
+  if(p == NULL) {
+    purge_all();
+    p = memb_alloc(&packets_memb);
+    if(p == NULL) {
+      PRINTF("uip_packetqueue_push: pool full\n");
+      UIP_STAT(++uip_stat.nd6.queue_drop);
+      return 0;
+    }
+    /* The purge may have shortened this queue too. */
+    for(pp = &handle->packet; *pp != NULL; pp = &(*pp)->next);
   }
+  memcpy(p->queue_buf, &uip_buf[UIP_LLH_LEN], uip_len);
+  p->queue_buf_len = uip_len;
+  timer_set(&p->lifetime, lifetime);
+  p->handle = handle;
+  p->next = NULL;
+  *pp = p;
+  UIP_STAT(++uip_stat.nd6.queued);
+  return 1;
 }
 /*---------------------------------------------------------------------------*/
-uint8_t *
-uip_packetqueue_buf(struct uip_packetqueue_handle *h)
+int
+uip_packetqueue_pop(struct uip_packetqueue_handle *handle)
 {
-  return h->packet != NULL? h->packet->queue_buf: NULL;
+  struct uip_packetqueue_packet *p;
+
+  purge(handle);
+  p = handle->packet;
+  if(p == NULL) {
+    return 0;
+  }
+  PRINTF("uip_packetqueue_pop %p\n", handle);
+  uip_len = p->queue_buf_len;
+  memcpy(&uip_buf[UIP_LLH_LEN], p->queue_buf, uip_len);
+  handle->packet = p->next;
+  memb_free(&packets_memb, p);
+  UIP_STAT(++uip_stat.nd6.flushed);
+  return 1;
 }
 /*---------------------------------------------------------------------------*/
-uint16_t
-uip_packetqueue_buflen(struct uip_packetqueue_handle *h)
+int
+uip_packetqueue_len(struct uip_packetqueue_handle *handle)
 {
-  return h->packet != NULL? h->packet->queue_buf_len: 0;
+  struct uip_packetqueue_packet *p;
+  int n;
+
+  n = 0;
+  for(p = handle->packet; p != NULL; p = p->next) {
+    n++;
+  }
+  return n;
 }
 /*---------------------------------------------------------------------------*/
 void
-uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len)
+uip_packetqueue_free(struct uip_packetqueue_handle *handle)
 {
-  if(h->packet != NULL) {
-    h->packet->queue_buf_len = len;
+  struct uip_packetqueue_packet *p;
+
+  PRINTF("uip_packetqueue_free %p\n", handle);
+  while(handle->packet != NULL) {
+    p = handle->packet;
+    handle->packet = p->next;
+    memb_free(&packets_memb, p);
+    UIP_STAT(++uip_stat.nd6.queue_drop);
   }
 }
 /*---------------------------------------------------------------------------*/
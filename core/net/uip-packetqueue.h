@@ -1,35 +1,52 @@
 #ifndef UIP_PACKETQUEUE_H
 #define UIP_PACKETQUEUE_H
 
-#include "sys/ctimer.h"
+#include "sys/timer.h"
+
+/* Number of packets that can be queued for all neighbors together. */
+#ifdef UIP_PACKETQUEUE_CONF_NUM
+#define UIP_PACKETQUEUE_NUM UIP_PACKETQUEUE_CONF_NUM
+#else
+#define UIP_PACKETQUEUE_NUM 2
+#endif
+
+/* Number of packets that can be queued for one neighbor. */
+#ifdef UIP_PACKETQUEUE_CONF_MAX_PER_NBR
+#define UIP_PACKETQUEUE_MAX_PER_NBR UIP_PACKETQUEUE_CONF_MAX_PER_NBR
+#else
+#define UIP_PACKETQUEUE_MAX_PER_NBR UIP_PACKETQUEUE_NUM
+#endif
 
 struct uip_packetqueue_handle;
 
 struct uip_packetqueue_packet {
-  struct uip_ds6_queued_packet *next;
+  struct uip_packetqueue_packet *next;
   uint8_t queue_buf[UIP_BUFSIZE - UIP_LLH_LEN];
   uint16_t queue_buf_len;
-  struct ctimer lifetimer;
+  struct timer lifetime;
   struct uip_packetqueue_handle *handle;
 };
 
+/* A FIFO of packets waiting for one neighbor, oldest first. */
 struct uip_packetqueue_handle {
   struct uip_packetqueue_packet *packet;
 };
 
 void uip_packetqueue_new(struct uip_packetqueue_handle *handle);
 
+/* Queue a copy of the packet in uip_buf at the end of the FIFO. The
+   packet is dropped if it is not sent within lifetime. Returns 0 if
+   the neighbor's queue or the shared pool is full. */
+int uip_packetqueue_push(struct uip_packetqueue_handle *handle,
+                         clock_time_t lifetime);
 
-struct uip_packetqueue_packet *
-uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime);
+/* Move the oldest packet that has not expired to uip_buf. Returns 0,
+   with uip_buf untouched, if there is none. */
+int uip_packetqueue_pop(struct uip_packetqueue_handle *handle);
 
+int uip_packetqueue_len(struct uip_packetqueue_handle *handle);
 
-void
-uip_packetqueue_free(struct uip_packetqueue_handle *handle);
-
-uint8_t *uip_packetqueue_buf(struct uip_packetqueue_handle *h);
-uint16_t uip_packetqueue_buflen(struct uip_packetqueue_handle *h);
-void uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len);
-
+/* Drop all packets queued for the neighbor. */
+void uip_packetqueue_free(struct uip_packetqueue_handle *handle);
 
 #endif /* UIP_PACKETQUEUE_H */
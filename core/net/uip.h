@@ -834,7 +834,11 @@ struct uip_udp_conn *uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport);
  *
  * \hideinitializer
  */
+#if UIP_CONF_IPV6 && UIP_CONN_HASH_SIZE
+void uip_udp_remove(struct uip_udp_conn *conn);
+#else
 #define uip_udp_remove(conn) (conn)->lport = 0
+#endif
 
 /**
  * Bind a UDP connection to a local port.
@@ -846,7 +850,11 @@ struct uip_udp_conn *uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport);
  *
  * \hideinitializer
  */
+#if UIP_CONF_IPV6 && UIP_CONN_HASH_SIZE
+void uip_udp_bind(struct uip_udp_conn *conn, uint16_t port);
+#else
 #define uip_udp_bind(conn, port) (conn)->lport = port
+#endif
 
 /**
  * Send a UDP datagram of length len on the current connection.
@@ -1460,6 +1468,15 @@ struct uip_stats {
     uip_stats_t drop;     /**< Number of dropped ND6 packets. */
     uip_stats_t recv;     /**< Number of recived ND6 packets */
     uip_stats_t sent;     /**< Number of sent ND6 packets */
+#if UIP_CONF_IPV6_QUEUE_PKT
+    uip_stats_t queued;   /**< Number of packets queued during
+			     address resolution. */
+    uip_stats_t queue_drop; /**< Number of queued packets dropped
+			       because the queue was full, they timed
+			       out, or the neighbor was removed. */
+    uip_stats_t flushed;  /**< Number of queued packets sent once
+			     the neighbor became reachable. */
+#endif /* UIP_CONF_IPV6_QUEUE_PKT */
   } nd6;
 #endif /*UIP_CONF_IPV6*/
 };
@@ -71,6 +71,7 @@
  */
 
 #include "net/uip.h"
+#include "net/uip_arch.h"
 #include "net/uipopt.h"
 #include "net/uip-icmp6.h"
 #include "net/uip-nd6.h"
@@ -196,8 +197,13 @@ struct uip_conn *uip_conn;
 
 /* Temporary variables. */
 #if (UIP_TCP || UIP_UDP)
+#if UIP_UDP_CONNS > 255 || UIP_CONNS > 255 || UIP_LISTENPORTS > 255
+/* Also a loop index over the connection tables */
+static uint16_t c;
+#else
 static uint8_t c;
 #endif
+#endif
 
 #if UIP_ACTIVE_OPEN || UIP_UDP
 /* Keeps track of the last port used for a new connection. */
@@ -255,6 +261,32 @@ struct uip_udp_conn uip_udp_conns[UIP_UDP_CONNS];
 #endif /* UIP_UDP */
 /** @} */
 
+#if UIP_CONN_HASH_SIZE
+/*---------------------------------------------------------------------------*/
+/** @{ \name Connection lookup tables                                       */
+/*---------------------------------------------------------------------------*/
+/* The connections, and the listening ports, are chained in buckets by
+   their local port. A link is the index of the next entry plus one,
+   or 0 at the end of a chain. */
+typedef uint16_t conn_link_t;
+
+#define CONN_HASH(port) (((port) ^ ((port) >> 8)) & (UIP_CONN_HASH_SIZE - 1))
+
+#if UIP_TCP
+static conn_link_t tcp_hash[UIP_CONN_HASH_SIZE];
+static conn_link_t tcp_hash_next[UIP_CONNS];
+/* The port that each connection is chained under, 0 if none */
+static uint16_t tcp_hash_port[UIP_CONNS];
+static conn_link_t listen_hash[UIP_CONN_HASH_SIZE];
+static conn_link_t listen_hash_next[UIP_LISTENPORTS];
+#endif /* UIP_TCP */
+#if UIP_UDP
+static conn_link_t udp_hash[UIP_CONN_HASH_SIZE];
+static conn_link_t udp_hash_next[UIP_UDP_CONNS];
+#endif /* UIP_UDP */
+/** @} */
+#endif /* UIP_CONN_HASH_SIZE */
+
 /*---------------------------------------------------------------------------*/
 /** @{ \name ICMPv6 variables                                                */
 /*---------------------------------------------------------------------------*/
@@ -298,37 +330,44 @@ uip_add32(uint8_t *op32, uint16_t op16)
 #endif /* UIP_ARCH_ADD32 && UIP_TCP */
 
 #if ! UIP_ARCH_CHKSUM
+#if UIP_ARCH_CHKSUM_ADD
+#define chksum(sum, data, len) uip_chksum_add(sum, data, len)
+#else /* UIP_ARCH_CHKSUM_ADD */
 /*---------------------------------------------------------------------------*/
 static uint16_t
 chksum(uint16_t sum, const uint8_t *data, uint16_t len)
 {
-  uint16_t t;
+  uint32_t acc;
   const uint8_t *dataptr;
   const uint8_t *last_byte;
 
+  /* Sum the 16-bit words in 32 bits and fold the carries back in at
+     the end. At most 0x7fff words fit in len, so acc cannot overflow. */
+  acc = sum;
   dataptr = data;
   last_byte = data + len - 1;
-  
-  while(dataptr < last_byte) {   /* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
-    }
+
+  while(dataptr + 2 < last_byte) {   /* At least four more bytes */
+    acc += ((uint16_t)dataptr[0] << 8) | dataptr[1];
+    acc += ((uint16_t)dataptr[2] << 8) | dataptr[3];
+    dataptr += 4;
+  }
+  if(dataptr < last_byte) {   /* At least two more bytes */
+    acc += ((uint16_t)dataptr[0] << 8) | dataptr[1];
     dataptr += 2;
   }
-  
+
   if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
-    }
+    acc += (uint16_t)dataptr[0] << 8;
   }
 
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc += acc >> 16;
+
   /* Return sum in host byte order. */
-  return sum;
+  return (uint16_t)acc;
 }
+#endif /* UIP_ARCH_CHKSUM_ADD */
 /*---------------------------------------------------------------------------*/
 uint16_t
 uip_chksum(uint16_t *data, uint16_t len)
@@ -405,6 +444,44 @@ uip_udpchksum(void)
 #endif /* UIP_UDP && UIP_UDP_CHECKSUMS */
 #endif /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
+#if UIP_CONN_HASH_SIZE
+static void
+conn_link(conn_link_t *bucket, conn_link_t *next, uint16_t i)
+{
+  next[i] = *bucket;
+  *bucket = i + 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+conn_unlink(conn_link_t *bucket, conn_link_t *next, uint16_t i)
+{
+  conn_link_t *l;
+
+  for(l = bucket; *l != 0; l = &next[*l - 1]) {
+    if(*l == i + 1) {
+      *l = next[i];
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP
+/* Chain a connection that has just got its local port. */
+static void
+tcp_hash_set(struct uip_conn *conn)
+{
+  uint16_t i;
+
+  i = conn - uip_conns;
+  if(tcp_hash_port[i] != 0) {
+    conn_unlink(&tcp_hash[CONN_HASH(tcp_hash_port[i])], tcp_hash_next, i);
+  }
+  tcp_hash_port[i] = conn->lport;
+  conn_link(&tcp_hash[CONN_HASH(conn->lport)], tcp_hash_next, i);
+}
+#endif /* UIP_TCP */
+#endif /* UIP_CONN_HASH_SIZE */
+/*---------------------------------------------------------------------------*/
 void
 uip_init(void)
 {
@@ -429,6 +506,17 @@ uip_init(void)
     uip_udp_conns[c].lport = 0;
   }
 #endif /* UIP_UDP */
+
+#if UIP_CONN_HASH_SIZE
+#if UIP_TCP
+  memset(tcp_hash, 0, sizeof(tcp_hash));
+  memset(tcp_hash_port, 0, sizeof(tcp_hash_port));
+  memset(listen_hash, 0, sizeof(listen_hash));
+#endif /* UIP_TCP */
+#if UIP_UDP
+  memset(udp_hash, 0, sizeof(udp_hash));
+#endif /* UIP_UDP */
+#endif /* UIP_CONN_HASH_SIZE */
 }
 /*---------------------------------------------------------------------------*/
 #if UIP_TCP && UIP_ACTIVE_OPEN
@@ -447,6 +535,20 @@ uip_connect(uip_ipaddr_t *ripaddr, uint16_t rport)
 
   /* Check if this port is already in use, and if so try to find
      another one. */
+#if UIP_CONN_HASH_SIZE
+  {
+    conn_link_t l;
+
+    for(l = tcp_hash[CONN_HASH(uip_htons(lastport))]; l != 0;
+        l = tcp_hash_next[l - 1]) {
+      conn = &uip_conns[l - 1];
+      if(conn->tcpstateflags != UIP_CLOSED &&
+         conn->lport == uip_htons(lastport)) {
+        goto again;
+      }
+    }
+  }
+#else /* UIP_CONN_HASH_SIZE */
   for(c = 0; c < UIP_CONNS; ++c) {
     conn = &uip_conns[c];
     if(conn->tcpstateflags != UIP_CLOSED &&
@@ -454,6 +556,7 @@ uip_connect(uip_ipaddr_t *ripaddr, uint16_t rport)
       goto again;
     }
   }
+#endif /* UIP_CONN_HASH_SIZE */
 
   conn = 0;
   for(c = 0; c < UIP_CONNS; ++c) {
@@ -497,6 +600,9 @@ uip_connect(uip_ipaddr_t *ripaddr, uint16_t rport)
   conn->lport = uip_htons(lastport);
   conn->rport = rport;
   uip_ipaddr_copy(&conn->ripaddr, ripaddr);
+#if UIP_CONN_HASH_SIZE
+  tcp_hash_set(conn);
+#endif /* UIP_CONN_HASH_SIZE */
   
   return conn;
 }
@@ -541,11 +647,24 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
     lastport = 4096;
   }
   
+#if UIP_CONN_HASH_SIZE
+  {
+    conn_link_t l;
+
+    for(l = udp_hash[CONN_HASH(uip_htons(lastport))]; l != 0;
+        l = udp_hash_next[l - 1]) {
+      if(uip_udp_conns[l - 1].lport == uip_htons(lastport)) {
+        goto again;
+      }
+    }
+  }
+#else /* UIP_CONN_HASH_SIZE */
   for(c = 0; c < UIP_UDP_CONNS; ++c) {
     if(uip_udp_conns[c].lport == uip_htons(lastport)) {
       goto again;
     }
   }
+#endif /* UIP_CONN_HASH_SIZE */
 
   conn = 0;
   for(c = 0; c < UIP_UDP_CONNS; ++c) {
@@ -559,7 +678,7 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
     return 0;
   }
   
-  conn->lport = UIP_HTONS(lastport);
+  uip_udp_bind(conn, UIP_HTONS(lastport));
   conn->rport = rport;
   if(ripaddr == NULL) {
     memset(&conn->ripaddr, 0, sizeof(uip_ipaddr_t));
@@ -570,18 +689,72 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
   
   return conn;
 }
+/*---------------------------------------------------------------------------*/
+#if UIP_CONN_HASH_SIZE
+void
+uip_udp_bind(struct uip_udp_conn *conn, uint16_t port)
+{
+  uint16_t i;
+
+  i = conn - uip_udp_conns;
+  if(conn->lport != 0) {
+    conn_unlink(&udp_hash[CONN_HASH(conn->lport)], udp_hash_next, i);
+  }
+  conn->lport = port;
+  if(port != 0) {
+    conn_link(&udp_hash[CONN_HASH(port)], udp_hash_next, i);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_udp_remove(struct uip_udp_conn *conn)
+{
+  uip_udp_bind(conn, 0);
+}
+#endif /* UIP_CONN_HASH_SIZE */
+/*---------------------------------------------------------------------------*/
+/* Does the UDP packet in uip_buf belong to this connection? */
+static int
+udp_conn_matches(struct uip_udp_conn *conn)
+{
+  /* If the local UDP port is non-zero, the connection is considered
+     to be used. If so, the local port number is checked against the
+     destination port number in the received packet. If the two port
+     numbers match, the remote port number is checked if the
+     connection is bound to a remote port. Finally, if the
+     connection is bound to a remote IP address, the source IP
+     address of the packet is checked. */
+  return conn->lport != 0 &&
+    UIP_UDP_BUF->destport == conn->lport &&
+    (conn->rport == 0 ||
+     UIP_UDP_BUF->srcport == conn->rport) &&
+    (uip_is_addr_unspecified(&conn->ripaddr) ||
+     uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &conn->ripaddr));
+}
 #endif /* UIP_UDP */
 /*---------------------------------------------------------------------------*/
 #if UIP_TCP
 void
 uip_unlisten(uint16_t port)
 {
+#if UIP_CONN_HASH_SIZE
+  conn_link_t l;
+
+  for(l = listen_hash[CONN_HASH(port)]; l != 0; l = listen_hash_next[l - 1]) {
+    if(uip_listenports[l - 1] == port) {
+      uip_listenports[l - 1] = 0;
+      conn_unlink(&listen_hash[CONN_HASH(port)], listen_hash_next, l - 1);
+      return;
+    }
+  }
+#else /* UIP_CONN_HASH_SIZE */
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == port) {
       uip_listenports[c] = 0;
       return;
     }
   }
+#endif /* UIP_CONN_HASH_SIZE */
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -590,6 +763,9 @@ uip_listen(uint16_t port)
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == 0) {
       uip_listenports[c] = port;
+#if UIP_CONN_HASH_SIZE
+      conn_link(&listen_hash[CONN_HASH(port)], listen_hash_next, c);
+#endif /* UIP_CONN_HASH_SIZE */
       return;
     }
   }
@@ -1492,25 +1668,35 @@ uip_process(uint8_t flag)
   }
 
   /* Demultiplex this UDP packet between the UDP "connections". */
+#if UIP_CONN_HASH_SIZE
+  {
+    struct uip_udp_conn *found;
+    conn_link_t l;
+
+    /* As with a scan of uip_udp_conns, the first match wins. */
+    found = NULL;
+    for(l = udp_hash[CONN_HASH(UIP_UDP_BUF->destport)]; l != 0;
+        l = udp_hash_next[l - 1]) {
+      uip_udp_conn = &uip_udp_conns[l - 1];
+      if(udp_conn_matches(uip_udp_conn) &&
+         (found == NULL || uip_udp_conn < found)) {
+        found = uip_udp_conn;
+      }
+    }
+    if(found != NULL) {
+      uip_udp_conn = found;
+      goto udp_found;
+    }
+  }
+#else /* UIP_CONN_HASH_SIZE */
   for(uip_udp_conn = &uip_udp_conns[0];
       uip_udp_conn < &uip_udp_conns[UIP_UDP_CONNS];
       ++uip_udp_conn) {
-    /* If the local UDP port is non-zero, the connection is considered
-       to be used. If so, the local port number is checked against the
-       destination port number in the received packet. If the two port
-       numbers match, the remote port number is checked if the
-       connection is bound to a remote port. Finally, if the
-       connection is bound to a remote IP address, the source IP
-       address of the packet is checked. */
-    if(uip_udp_conn->lport != 0 &&
-       UIP_UDP_BUF->destport == uip_udp_conn->lport &&
-       (uip_udp_conn->rport == 0 ||
-        UIP_UDP_BUF->srcport == uip_udp_conn->rport) &&
-       (uip_is_addr_unspecified(&uip_udp_conn->ripaddr) ||
-        uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &uip_udp_conn->ripaddr))) {
+    if(udp_conn_matches(uip_udp_conn)) {
       goto udp_found;
     }
   }
+#endif /* UIP_CONN_HASH_SIZE */
   PRINTF("udp: no matching connection found\n");
 
 #if UIP_UDP_SEND_UNREACH_NOPORT
@@ -1599,6 +1785,22 @@ uip_process(uint8_t flag)
 
   /* Demultiplex this segment. */
   /* First check any active connections. */
+#if UIP_CONN_HASH_SIZE
+  {
+    conn_link_t l;
+
+    for(l = tcp_hash[CONN_HASH(UIP_TCP_BUF->destport)]; l != 0;
+        l = tcp_hash_next[l - 1]) {
+      uip_connr = &uip_conns[l - 1];
+      if(uip_connr->tcpstateflags != UIP_CLOSED &&
+         UIP_TCP_BUF->destport == uip_connr->lport &&
+         UIP_TCP_BUF->srcport == uip_connr->rport &&
+         uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &uip_connr->ripaddr)) {
+        goto found;
+      }
+    }
+  }
+#else /* UIP_CONN_HASH_SIZE */
   for(uip_connr = &uip_conns[0]; uip_connr <= &uip_conns[UIP_CONNS - 1];
       ++uip_connr) {
     if(uip_connr->tcpstateflags != UIP_CLOSED &&
@@ -1608,6 +1810,7 @@ uip_process(uint8_t flag)
       goto found;
     }
   }
+#endif /* UIP_CONN_HASH_SIZE */
 
   /* If we didn't find and active connection that expected the packet,
      either this packet is an old duplicate, or this is a SYN packet
@@ -1619,11 +1822,24 @@ uip_process(uint8_t flag)
   
   tmp16 = UIP_TCP_BUF->destport;
   /* Next, check listening connections. */
+#if UIP_CONN_HASH_SIZE
+  {
+    conn_link_t l;
+
+    for(l = listen_hash[CONN_HASH(tmp16)]; l != 0;
+        l = listen_hash_next[l - 1]) {
+      if(tmp16 == uip_listenports[l - 1]) {
+        goto found_listen;
+      }
+    }
+  }
+#else /* UIP_CONN_HASH_SIZE */
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(tmp16 == uip_listenports[c]) {
       goto found_listen;
     }
   }
+#endif /* UIP_CONN_HASH_SIZE */
   
   /* No matching connection found, so we send a RST packet. */
   UIP_STAT(++uip_stat.tcp.synrst);
@@ -1721,6 +1937,9 @@ uip_process(uint8_t flag)
   uip_connr->sv = 4;
   uip_connr->nrtx = 0;
   uip_connr->lport = UIP_TCP_BUF->destport;
+#if UIP_CONN_HASH_SIZE
+  tcp_hash_set(uip_connr);
+#endif /* UIP_CONN_HASH_SIZE */
   uip_connr->rport = UIP_TCP_BUF->srcport;
   uip_ipaddr_copy(&uip_connr->ripaddr, &UIP_IP_BUF->srcipaddr);
   uip_connr->tcpstateflags = UIP_SYN_RCVD;
@@ -103,6 +103,26 @@ void uip_add32(uint8_t *op32, uint16_t op16);
  */
 uint16_t uip_chksum(uint16_t *buf, uint16_t len);
 
+/**
+ * Add a buffer to a partial Internet checksum.
+ *
+ * uIP calls this function for all its checksums when the architecture
+ * defines UIP_ARCH_CHKSUM_ADD, so that it can use wider words or
+ * vector instructions to sum the buffer.
+ *
+ * \param sum The one's complement sum so far, in host byte order,
+ * with the buffer read as big endian 16-bit words.
+ *
+ * \param data A pointer to the buffer, with no alignment required.
+ *
+ * \param len The length of the buffer. An odd last byte is padded
+ * with a zero byte.
+ *
+ * \return The one's complement sum with the buffer added, in host
+ * byte order.
+ */
+uint16_t uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len);
+
 /**
  * Calculate the IP header checksum of the packet header in uip_buf.
  *
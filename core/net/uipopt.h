@@ -266,6 +266,23 @@
 #define UIP_UDP_CONNS    10
 #endif /* UIP_CONF_UDP_CONNS */
 
+/**
+ * The number of buckets in the tables that find the UDP and TCP
+ * connection of an incoming IPv6 packet from its destination port, or
+ * 0 to scan the connection tables instead. Must be a power of two no
+ * larger than 256.
+ *
+ * With the tables, the local port of a UDP connection must only be
+ * changed with uip_udp_bind() and uip_udp_remove().
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_CONN_HASH_SIZE
+#define UIP_CONN_HASH_SIZE (UIP_CONF_CONN_HASH_SIZE)
+#else /* UIP_CONF_CONN_HASH_SIZE */
+#define UIP_CONN_HASH_SIZE 0
+#endif /* UIP_CONF_CONN_HASH_SIZE */
+
 /**
  * The name of the function that should be called when UDP datagrams arrive.
  *
@@ -468,6 +485,34 @@
 #define SICSLOWPAN_REASS_MAXAGE 20
 #endif
 
+/**
+ * Number of packets that can be reassembled at the same time, from
+ * different senders. Each takes a buffer of UIP_BUFSIZE bytes.
+ */
+#ifdef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_REASS_CONTEXTS (SICSLOWPAN_CONF_REASS_CONTEXTS)
+#else
+#define SICSLOWPAN_REASS_CONTEXTS 1
+#endif
+
+/**
+ * Do we forward the fragments of packets we route as they arrive,
+ * instead of reassembling the packets first (default: no). Needs
+ * UIP_CONF_ROUTER.
+ */
+#ifndef SICSLOWPAN_CONF_FRAG_FORWARD
+#define SICSLOWPAN_CONF_FRAG_FORWARD 0
+#endif
+
+/**
+ * Number of packets whose fragments can be forwarded at the same time
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARD_ENTRIES
+#define SICSLOWPAN_FRAG_FORWARD_ENTRIES (SICSLOWPAN_CONF_FRAG_FORWARD_ENTRIES)
+#else
+#define SICSLOWPAN_FRAG_FORWARD_ENTRIES 4
+#endif
+
 /**
  * Do we compress the IP header or not (default: no)
  */
@@ -92,6 +92,9 @@ ctimer_init(void)
 {
   initialized = 0;
   list_init(ctimer_list);
+  /* Callback timers drive the MAC and routing protocols, whose timing
+     should not suffer from a backlog of application events. */
+  process_set_priority(&ctimer_process, PROCESS_PRIORITY_HIGH);
   process_start(&ctimer_process, NULL);
 }
 /*---------------------------------------------------------------------------*/
@@ -52,8 +52,117 @@
 static struct etimer *timerlist;
 static clock_time_t next_expiration;
 
+#if ETIMER_HEAP_SIZE
+#if ETIMER_HEAP_SIZE > 254
+#error ETIMER_CONF_HEAP_SIZE must be at most 254
+#endif
+/* The heap holds the pending timers ordered on the time left, with
+   the earliest at heap[0]. heap_index is the 1-based slot of a timer
+   in the heap, OVERFLOW for timers on timerlist, which then only
+   holds the timers that did not fit. */
+#define OVERFLOW 0xff
+static struct etimer *heap[ETIMER_HEAP_SIZE];
+static unsigned char heap_count;
+#endif /* ETIMER_HEAP_SIZE */
+
 PROCESS(etimer_process, "Event timer");
 /*---------------------------------------------------------------------------*/
+#if ETIMER_HEAP_SIZE
+/*
+ * Time left until a timer expires, 0 once it has expired. As all
+ * timers count down together, the order of the timers on this key
+ * does not change over time, and it is correct across clock wraps.
+ */
+static clock_time_t
+time_left(struct etimer *t, clock_time_t now)
+{
+  clock_time_t passed = now - t->timer.start;
+  return passed >= t->timer.interval ? 0 : t->timer.interval - passed;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_place(struct etimer *t, int i)
+{
+  heap[i] = t;
+  t->heap_index = i + 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_sift_up(int i, clock_time_t now)
+{
+  struct etimer *t = heap[i];
+  clock_time_t left = time_left(t, now);
+  int parent;
+
+  while(i > 0) {
+    parent = (i - 1) / 2;
+    if(time_left(heap[parent], now) <= left) {
+      break;
+    }
+    heap_place(heap[parent], i);
+    i = parent;
+  }
+  heap_place(t, i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_sift_down(int i, clock_time_t now)
+{
+  struct etimer *t = heap[i];
+  clock_time_t left = time_left(t, now);
+  clock_time_t child_left;
+  int child;
+
+  while((child = 2 * i + 1) < heap_count) {
+    child_left = time_left(heap[child], now);
+    if(child + 1 < heap_count &&
+       time_left(heap[child + 1], now) < child_left) {
+      child++;
+      child_left = time_left(heap[child], now);
+    }
+    if(left <= child_left) {
+      break;
+    }
+    heap_place(heap[child], i);
+    i = child;
+  }
+  heap_place(t, i);
+}
+/*---------------------------------------------------------------------------*/
+/* Restore the heap order around a timer whose expiration time changed. */
+static void
+heap_update(struct etimer *t)
+{
+  clock_time_t now = clock_time();
+  int i = t->heap_index - 1;
+
+  heap_sift_up(i, now);
+  heap_sift_down(t->heap_index - 1, now);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_remove(struct etimer *t)
+{
+  int i = t->heap_index - 1;
+
+  t->heap_index = 0;
+  heap_count--;
+  if(i < heap_count) {
+    heap_place(heap[heap_count], i);
+    heap_update(heap[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Timers are often not zero-initialized, so the index is only trusted
+   when the heap agrees. */
+static int
+in_heap(struct etimer *t)
+{
+  return t->heap_index > 0 && t->heap_index <= heap_count &&
+    heap[t->heap_index - 1] == t;
+}
+#endif /* ETIMER_HEAP_SIZE */
+/*---------------------------------------------------------------------------*/
 static void
 update_time(void)
 {
@@ -61,6 +170,14 @@ update_time(void)
   clock_time_t now;
   struct etimer *t;
 
+#if ETIMER_HEAP_SIZE
+  if(heap_count > 0 && timerlist == NULL) {
+    /* The common case: no overflow, the earliest timer is on top. */
+    next_expiration = etimer_expiration_time(heap[0]);
+    return;
+  }
+#endif /* ETIMER_HEAP_SIZE */
+
   if (timerlist == NULL) {
     next_expiration = 0;
   } else {
@@ -73,6 +190,12 @@ update_time(void)
 	tdist = t->timer.start + t->timer.interval - now;
       }
     }
+#if ETIMER_HEAP_SIZE
+    if(heap_count > 0 &&
+       etimer_expiration_time(heap[0]) - now < tdist) {
+      tdist = etimer_expiration_time(heap[0]) - now;
+    }
+#endif /* ETIMER_HEAP_SIZE */
     next_expiration = now + tdist;
   }
 }
@@ -80,6 +203,9 @@ update_time(void)
 PROCESS_THREAD(etimer_process, ev, data)
 {
   struct etimer *t, *u;
+#if ETIMER_HEAP_SIZE
+  int i;
+#endif /* ETIMER_HEAP_SIZE */
 	
   PROCESS_BEGIN();
 
@@ -91,6 +217,19 @@ PROCESS_THREAD(etimer_process, ev, data)
     if(ev == PROCESS_EVENT_EXITED) {
       struct process *p = data;
 
+#if ETIMER_HEAP_SIZE
+      for(i = 0; i < heap_count;) {
+        if(heap[i]->p == p) {
+          heap_remove(heap[i]);
+          /* Another timer has moved into slot i; start over from the
+             top, as it may also have moved up. */
+          i = 0;
+        } else {
+          i++;
+        }
+      }
+#endif /* ETIMER_HEAP_SIZE */
+
       while(timerlist != NULL && timerlist->p == p) {
 	timerlist = timerlist->next;
       }
@@ -104,11 +243,29 @@ PROCESS_THREAD(etimer_process, ev, data)
 	    t = t->next;
 	}
       }
+#if ETIMER_HEAP_SIZE
+      update_time();
+#endif /* ETIMER_HEAP_SIZE */
       continue;
     } else if(ev != PROCESS_EVENT_POLL) {
       continue;
     }
 
+#if ETIMER_HEAP_SIZE
+    /* Only the top of the heap can have expired before the others. */
+    while(heap_count > 0 && timer_expired(&heap[0]->timer)) {
+      t = heap[0];
+      if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
+        t->p = PROCESS_NONE;
+        heap_remove(t);
+      } else {
+        etimer_request_poll();
+        break;
+      }
+    }
+    update_time();
+#endif /* ETIMER_HEAP_SIZE */
+
   again:
     
     u = NULL;
@@ -127,6 +284,9 @@ PROCESS_THREAD(etimer_process, ev, data)
 	    timerlist = t->next;
 	  }
 	  t->next = NULL;
+#if ETIMER_HEAP_SIZE
+	  t->heap_index = 0;
+#endif /* ETIMER_HEAP_SIZE */
 	  update_time();
 	  goto again;
 	} else {
@@ -154,7 +314,18 @@ add_timer(struct etimer *timer)
 
   etimer_request_poll();
 
+#if ETIMER_HEAP_SIZE
+  if(in_heap(timer)) {
+    /* Timer already in the heap; its expiration time has changed. */
+    timer->p = PROCESS_CURRENT();
+    heap_update(timer);
+    update_time();
+    return;
+  }
+  if(timer->heap_index == OVERFLOW && timer->p != PROCESS_NONE) {
+#else /* ETIMER_HEAP_SIZE */
   if(timer->p != PROCESS_NONE) {
+#endif /* ETIMER_HEAP_SIZE */
     for(t = timerlist; t != NULL; t = t->next) {
       if(t == timer) {
 	/* Timer already on list, bail out. */
@@ -165,8 +336,18 @@ add_timer(struct etimer *timer)
     }
   }
 
-  /* Timer not on list. */
   timer->p = PROCESS_CURRENT();
+#if ETIMER_HEAP_SIZE
+  if(heap_count < ETIMER_HEAP_SIZE) {
+    heap_place(timer, heap_count++);
+    heap_sift_up(heap_count - 1, clock_time());
+    update_time();
+    return;
+  }
+  timer->heap_index = OVERFLOW;
+#endif /* ETIMER_HEAP_SIZE */
+
+  /* Timer not on list. */
   timer->next = timerlist;
   timerlist = timer;
 
@@ -198,6 +379,11 @@ void
 etimer_adjust(struct etimer *et, int timediff)
 {
   et->timer.start += timediff;
+#if ETIMER_HEAP_SIZE
+  if(in_heap(et)) {
+    heap_update(et);
+  }
+#endif /* ETIMER_HEAP_SIZE */
   update_time();
 }
 /*---------------------------------------------------------------------------*/
@@ -222,7 +408,11 @@ etimer_start_time(struct etimer *et)
 int
 etimer_pending(void)
 {
+#if ETIMER_HEAP_SIZE
+  return heap_count > 0 || timerlist != NULL;
+#else /* ETIMER_HEAP_SIZE */
   return timerlist != NULL;
+#endif /* ETIMER_HEAP_SIZE */
 }
 /*---------------------------------------------------------------------------*/
 clock_time_t
@@ -236,6 +426,16 @@ etimer_stop(struct etimer *et)
 {
   struct etimer *t;
 
+#if ETIMER_HEAP_SIZE
+  if(in_heap(et)) {
+    heap_remove(et);
+    update_time();
+    et->next = NULL;
+    et->p = PROCESS_NONE;
+    return;
+  }
+#endif /* ETIMER_HEAP_SIZE */
+
   /* First check if et is the first event timer on the list. */
   if(et == timerlist) {
     timerlist = timerlist->next;
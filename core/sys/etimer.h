@@ -65,6 +65,19 @@
 #include "sys/timer.h"
 #include "sys/process.h"
 
+/*
+ * With ETIMER_CONF_HEAP_SIZE, pending timers are kept in a binary
+ * min-heap ordered on the time left, of up to that many timers. The
+ * next expiration is then known in constant time and a timer is
+ * added or removed in O(log n). Timers that do not fit in the heap
+ * are kept on a list, as without the option.
+ */
+#ifdef ETIMER_CONF_HEAP_SIZE
+#define ETIMER_HEAP_SIZE ETIMER_CONF_HEAP_SIZE
+#else
+#define ETIMER_HEAP_SIZE 0
+#endif /* ETIMER_CONF_HEAP_SIZE */
+
 /**
  * A timer.
  *
@@ -77,6 +90,9 @@ struct etimer {
   struct timer timer;
   struct etimer *next;
   struct process *p;
+#if ETIMER_HEAP_SIZE
+  unsigned char heap_index;
+#endif /* ETIMER_HEAP_SIZE */
 };
 
 /**
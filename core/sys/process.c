@@ -63,6 +63,9 @@ struct event_data {
   process_event_t ev;
   process_data_t data;
   struct process *p;
+#if PROCESS_CONF_PRIORITIES
+  process_num_events_t next;
+#endif /* PROCESS_CONF_PRIORITIES */
 };
 
 static process_num_events_t nevents, fevent;
@@ -74,6 +77,45 @@ process_num_events_t process_maxevents;
 
 static volatile unsigned char poll_requested;
 
+#if PROCESS_CONF_PRIORITIES
+#if PROCESS_CONF_NUMEVENTS > 255
+#error PROCESS_CONF_PRIORITIES supports at most 255 events
+#endif
+#if PROCESS_CONF_NUMPOLLS & (PROCESS_CONF_NUMPOLLS - 1) || PROCESS_CONF_NUMPOLLS > 128
+#error PROCESS_CONF_NUMPOLLS must be a power of two no larger than 128
+#endif
+
+/* The events slots are linked into one queue per priority class and a
+   free list; NO_EVENT ends a list. */
+#define NO_EVENT 0xff
+static process_num_events_t queue_head[PROCESS_PRIORITIES];
+static process_num_events_t queue_tail[PROCESS_PRIORITIES];
+static process_num_events_t queue_len[PROCESS_PRIORITIES];
+static process_num_events_t free_event;
+
+/* Classes in the order in which they are served. */
+static const unsigned char class_order[PROCESS_PRIORITIES] = {
+  PROCESS_PRIORITY_HIGH, PROCESS_PRIORITY_NORMAL, PROCESS_PRIORITY_LOW
+};
+
+/* Processes to be polled, in the order of the requests. The indices
+   are 8-bit quantities so that process_poll() can be called from
+   interrupts. When the queue is full, poll_requested makes the kernel
+   scan the whole process list instead. An interrupt that arrives
+   while poll_lock is set also uses poll_requested, as the interrupted
+   process_poll() may be between reading and advancing poll_put. */
+static struct process *polls[PROCESS_CONF_NUMPOLLS];
+static volatile unsigned char poll_put, poll_get, poll_lock;
+#define POLL_PENDING() (poll_requested || poll_put != poll_get)
+
+#if PROCESS_CONF_STATS
+process_num_events_t process_maxevents_class[PROCESS_PRIORITIES];
+unsigned char process_maxpolls;
+#endif /* PROCESS_CONF_STATS */
+#else /* PROCESS_CONF_PRIORITIES */
+#define POLL_PENDING() poll_requested
+#endif /* PROCESS_CONF_PRIORITIES */
+
 #define PROCESS_STATE_NONE        0
 #define PROCESS_STATE_RUNNING     1
 #define PROCESS_STATE_CALLED      2
@@ -214,6 +256,27 @@ process_init(void)
   process_maxevents = 0;
 #endif /* PROCESS_CONF_STATS */
 
+#if PROCESS_CONF_PRIORITIES
+  {
+    int i;
+    for(i = 0; i < PROCESS_CONF_NUMEVENTS; i++) {
+      events[i].next = i + 1 < PROCESS_CONF_NUMEVENTS ? i + 1 : NO_EVENT;
+    }
+    free_event = 0;
+    for(i = 0; i < PROCESS_PRIORITIES; i++) {
+      queue_head[i] = queue_tail[i] = NO_EVENT;
+      queue_len[i] = 0;
+#if PROCESS_CONF_STATS
+      process_maxevents_class[i] = 0;
+#endif /* PROCESS_CONF_STATS */
+    }
+    poll_put = poll_get = poll_lock = 0;
+#if PROCESS_CONF_STATS
+    process_maxpolls = 0;
+#endif /* PROCESS_CONF_STATS */
+  }
+#endif /* PROCESS_CONF_PRIORITIES */
+
   process_current = process_list = NULL;
 }
 /*---------------------------------------------------------------------------*/
@@ -225,6 +288,32 @@ static void
 do_poll(void)
 {
   struct process *p;
+#if PROCESS_CONF_PRIORITIES
+  unsigned char n;
+
+  /* Only the polls that were pending on entry are handled, so that a
+     process that keeps polling itself does not lock out events. */
+  for(n = poll_put - poll_get; n > 0; n--) {
+    p = polls[poll_get & (PROCESS_CONF_NUMPOLLS - 1)];
+    /* Clear the flag before advancing, so that a new request from an
+       interrupt is queued again rather than lost. */
+    if(p->needspoll) {
+      p->needspoll = 0;
+      poll_get++;
+      /* The process may have exited since the request. */
+      if(process_is_running(p)) {
+        p->state = PROCESS_STATE_RUNNING;
+        call_process(p, PROCESS_EVENT_POLL, NULL);
+      }
+    } else {
+      /* Already polled by a scan of the process list. */
+      poll_get++;
+    }
+  }
+  if(!poll_requested) {
+    return;
+  }
+#endif /* PROCESS_CONF_PRIORITIES */
 
   poll_requested = 0;
   /* Call the processes that needs to be polled. */
@@ -237,6 +326,33 @@ do_poll(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_PRIORITIES
+/* Take the first event of the most urgent class off its queue. */
+static struct event_data *
+next_event(void)
+{
+  process_num_events_t e;
+  int i;
+  unsigned char c;
+
+  for(i = 0; i < PROCESS_PRIORITIES; i++) {
+    c = class_order[i];
+    e = queue_head[c];
+    if(e != NO_EVENT) {
+      queue_head[c] = events[e].next;
+      if(queue_head[c] == NO_EVENT) {
+        queue_tail[c] = NO_EVENT;
+      }
+      queue_len[c]--;
+      events[e].next = free_event;
+      free_event = e;
+      return &events[e];
+    }
+  }
+  return NULL;
+}
+#endif /* PROCESS_CONF_PRIORITIES */
+/*---------------------------------------------------------------------------*/
 /*
  * Process the next event in the event queue and deliver it to
  * listening processes.
@@ -261,6 +377,16 @@ do_event(void)
   if(nevents > 0) {
     
     /* There are events that we should deliver. */
+#if PROCESS_CONF_PRIORITIES
+    {
+      /* The slot is free again, but nothing can be posted into it
+         before its contents are copied. */
+      struct event_data *e = next_event();
+      ev = e->ev;
+      data = e->data;
+      receiver = e->p;
+    }
+#else /* PROCESS_CONF_PRIORITIES */
     ev = events[fevent].ev;
     
     data = events[fevent].data;
@@ -269,6 +395,7 @@ do_event(void)
     /* Since we have seen the new event, we move pointer upwards
        and decrese the number of events. */
     fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
+#endif /* PROCESS_CONF_PRIORITIES */
     --nevents;
 
     /* If this is a broadcast event, we deliver it to all events, in
@@ -278,7 +405,7 @@ do_event(void)
 
 	/* If we have been requested to poll a process, we do this in
 	   between processing the broadcast event. */
-	if(poll_requested) {
+	if(POLL_PENDING()) {
 	  do_poll();
 	}
 	call_process(p, ev, data);
@@ -302,20 +429,24 @@ int
 process_run(void)
 {
   /* Process poll events. */
-  if(poll_requested) {
+  if(POLL_PENDING()) {
     do_poll();
   }
 
   /* Process one event from the queue */
   do_event();
 
-  return nevents + poll_requested;
+  return process_nevents();
 }
 /*---------------------------------------------------------------------------*/
 int
 process_nevents(void)
 {
+#if PROCESS_CONF_PRIORITIES
+  return nevents + poll_requested + (unsigned char)(poll_put - poll_get);
+#else /* PROCESS_CONF_PRIORITIES */
   return nevents + poll_requested;
+#endif /* PROCESS_CONF_PRIORITIES */
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -343,7 +474,30 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
     return PROCESS_ERR_FULL;
   }
   
+#if PROCESS_CONF_PRIORITIES
+  {
+    unsigned char c;
+
+    c = p == PROCESS_BROADCAST ? PROCESS_PRIORITY_NORMAL : p->priority;
+    snum = free_event;
+    free_event = events[snum].next;
+    events[snum].next = NO_EVENT;
+    if(queue_tail[c] == NO_EVENT) {
+      queue_head[c] = snum;
+    } else {
+      events[queue_tail[c]].next = snum;
+    }
+    queue_tail[c] = snum;
+    queue_len[c]++;
+#if PROCESS_CONF_STATS
+    if(queue_len[c] > process_maxevents_class[c]) {
+      process_maxevents_class[c] = queue_len[c];
+    }
+#endif /* PROCESS_CONF_STATS */
+  }
+#else /* PROCESS_CONF_PRIORITIES */
   snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
+#endif /* PROCESS_CONF_PRIORITIES */
   events[snum].ev = ev;
   events[snum].data = data;
   events[snum].p = p;
@@ -373,12 +527,51 @@ process_poll(struct process *p)
   if(p != NULL) {
     if(p->state == PROCESS_STATE_RUNNING ||
        p->state == PROCESS_STATE_CALLED) {
+#if PROCESS_CONF_PRIORITIES
+      unsigned char pending;
+
+      if(p->needspoll) {
+        /* Already queued, or covered by a scan. */
+        return;
+      }
+      p->needspoll = 1;
+      if(poll_lock) {
+        /* We interrupted another process_poll(). */
+        poll_requested = 1;
+        return;
+      }
+      poll_lock = 1;
+      pending = poll_put - poll_get;
+      if(pending < PROCESS_CONF_NUMPOLLS) {
+        polls[poll_put & (PROCESS_CONF_NUMPOLLS - 1)] = p;
+        poll_put++;
+#if PROCESS_CONF_STATS
+        if(pending + 1 > process_maxpolls) {
+          process_maxpolls = pending + 1;
+        }
+#endif /* PROCESS_CONF_STATS */
+      } else {
+        poll_requested = 1;
+      }
+      poll_lock = 0;
+#else /* PROCESS_CONF_PRIORITIES */
       p->needspoll = 1;
       poll_requested = 1;
+#endif /* PROCESS_CONF_PRIORITIES */
     }
   }
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_PRIORITIES
+void
+process_set_priority(struct process *p, unsigned char priority)
+{
+  if(p != NULL && priority < PROCESS_PRIORITIES) {
+    p->priority = priority;
+  }
+}
+#endif /* PROCESS_CONF_PRIORITIES */
+/*---------------------------------------------------------------------------*/
 int
 process_is_running(struct process *p)
 {
@@ -88,6 +88,39 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_CONF_NUMEVENTS 32
 #endif /* PROCESS_CONF_NUMEVENTS */
 
+/*
+ * With PROCESS_CONF_PRIORITIES, events are queued per priority class
+ * of the receiving process and the most urgent class is served first.
+ * Polls are queued as well, so that the kernel does not have to scan
+ * all processes to find the polled ones.
+ */
+#ifndef PROCESS_CONF_PRIORITIES
+#define PROCESS_CONF_PRIORITIES 0
+#endif /* PROCESS_CONF_PRIORITIES */
+
+/* Number of polls that can be pending before the kernel falls back to
+   scanning the process list. */
+#ifndef PROCESS_CONF_NUMPOLLS
+#define PROCESS_CONF_NUMPOLLS 8
+#endif /* PROCESS_CONF_NUMPOLLS */
+
+/**
+ * \name Priority classes
+ *
+ * Events posted to a process are handled in the order of the
+ * priority class of the process: first all events to high priority
+ * processes, then those to normal ones, then those to low priority
+ * ones. Broadcast events have normal priority. Processes have normal
+ * priority until process_set_priority() is called.
+ *
+ * @{
+ */
+#define PROCESS_PRIORITY_NORMAL 0
+#define PROCESS_PRIORITY_HIGH   1
+#define PROCESS_PRIORITY_LOW    2
+#define PROCESS_PRIORITIES      3
+/** @} */
+
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -323,6 +356,9 @@ struct process {
   PT_THREAD((* thread)(struct pt *, process_event_t, process_data_t));
   struct pt pt;
   unsigned char state, needspoll;
+#if PROCESS_CONF_PRIORITIES
+  unsigned char priority;
+#endif /* PROCESS_CONF_PRIORITIES */
 };
 
 /**
@@ -452,6 +488,22 @@ process_current = p
  */
 CCIF process_event_t process_alloc_event(void);
 
+/**
+ * \brief      Set the priority class of a process.
+ * \param p    The process
+ * \param priority PROCESS_PRIORITY_HIGH, PROCESS_PRIORITY_NORMAL or
+ *             PROCESS_PRIORITY_LOW
+ *
+ *             Events that are already queued for the process keep
+ *             their class. Without PROCESS_CONF_PRIORITIES, this does
+ *             nothing.
+ */
+#if PROCESS_CONF_PRIORITIES
+CCIF void process_set_priority(struct process *p, unsigned char priority);
+#else
+#define process_set_priority(p, priority)
+#endif /* PROCESS_CONF_PRIORITIES */
+
 /** @} */
 
 /**
@@ -521,6 +573,16 @@ int process_nevents(void);
 
 /** @} */
 
+#if PROCESS_CONF_STATS
+/* High-water marks of the event queue and, with priorities, of the
+   queue of each class and of the poll queue. */
+extern process_num_events_t process_maxevents;
+#if PROCESS_CONF_PRIORITIES
+extern process_num_events_t process_maxevents_class[PROCESS_PRIORITIES];
+extern unsigned char process_maxpolls;
+#endif /* PROCESS_CONF_PRIORITIES */
+#endif /* PROCESS_CONF_STATS */
+
 CCIF extern struct process *process_list;
 
 #define PROCESS_LIST() process_list
@@ -78,6 +78,11 @@ rtimer_arch_schedule(rtimer_clock_t t)
   rtimer_clock_t c;
 
   c = t - (unsigned short)clock_time();
+  if(c == 0 || RTIMER_CLOCK_LT(t, (unsigned short)clock_time())) {
+    /* The time has already come. A zero it_value would disarm the
+       timer instead of firing it, so fire it as soon as possible. */
+    c = 1;
+  }
   
   val.it_value.tv_sec = c / 1000;
   val.it_value.tv_usec = (c % 1000) * 1000;
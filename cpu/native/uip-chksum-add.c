@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         uIP checksum addition for native, with SSE2 or AVX2 when
+ *         the compiler targets them.
+ *
+ *         The one's complement sum does not depend on the byte
+ *         order of the words (RFC 1071), so the buffer is summed as
+ *         little endian words in wide accumulators, and the result
+ *         is swapped to the big endian sum uIP works with.
+ */
+
+#include "net/uip.h"
+#include "net/uip_arch.h"
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if UIP_ARCH_CHKSUM_ADD
+/*---------------------------------------------------------------------------*/
+static uint64_t
+sum_vector(const uint8_t **datap, uint16_t *lenp)
+{
+  const uint8_t *data = *datap;
+  uint16_t len = *lenp;
+  uint32_t lanes[8];
+  uint64_t acc;
+  int i;
+
+  /* Each 32-bit lane gets at most two 16-bit words per block of a
+     buffer shorter than 64 kB, so the lanes cannot overflow. */
+#if defined(__AVX2__)
+  __m256i zero = _mm256_setzero_si256();
+  __m256i a = zero, b = zero;
+
+  while(len >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)data);
+    a = _mm256_add_epi32(a, _mm256_unpacklo_epi16(v, zero));
+    b = _mm256_add_epi32(b, _mm256_unpackhi_epi16(v, zero));
+    data += 32;
+    len -= 32;
+  }
+  _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi32(a, b));
+#elif defined(__SSE2__)
+  __m128i zero = _mm_setzero_si128();
+  __m128i a = zero, b = zero;
+
+  while(len >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)data);
+    a = _mm_add_epi32(a, _mm_unpacklo_epi16(v, zero));
+    b = _mm_add_epi32(b, _mm_unpackhi_epi16(v, zero));
+    data += 16;
+    len -= 16;
+  }
+  _mm_storeu_si128((__m128i *)lanes, _mm_add_epi32(a, b));
+  memset(&lanes[4], 0, 4 * sizeof(uint32_t));
+#else
+  memset(lanes, 0, sizeof(lanes));
+#endif
+
+  acc = 0;
+  for(i = 0; i < 8; i++) {
+    acc += lanes[i];
+  }
+  *datap = data;
+  *lenp = len;
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint64_t acc;
+  uint32_t w32;
+  uint16_t w16;
+
+  acc = sum_vector(&data, &len);
+
+  /* The rest, 32 bits at a time */
+  while(len >= 4) {
+    memcpy(&w32, data, 4);
+    acc += w32;
+    data += 4;
+    len -= 4;
+  }
+  if(len >= 2) {
+    memcpy(&w16, data, 2);
+    acc += w16;
+    data += 2;
+    len -= 2;
+  }
+  if(len > 0) {
+    /* The pad byte goes after the last byte in memory. */
+#if UIP_BYTE_ORDER == UIP_BIG_ENDIAN
+    acc += (uint16_t)data[0] << 8;
+#else
+    acc += data[0];
+#endif
+  }
+
+  /* Fold the carries back into 16 bits. */
+  while(acc >> 16) {
+    acc = (acc >> 16) + (acc & 0xffff);
+  }
+
+#if UIP_BYTE_ORDER != UIP_BIG_ENDIAN
+  /* Back to big endian words */
+  acc = ((acc & 0xff) << 8) | ((acc >> 8) & 0xff);
+#endif
+
+  acc += sum;
+  acc = (acc >> 16) + (acc & 0xffff);
+  return (uint16_t)acc;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* UIP_ARCH_CHKSUM_ADD */
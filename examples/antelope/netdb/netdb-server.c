@@ -220,7 +220,7 @@ PROCESS_THREAD(query_process, ev, data)
 	  processed++;
 	  db_print_tuple(&handle);
 	} else if(result == DB_OK) {
-	  /* A tuple was processed, but did not match the condition. */
+	  /* Tuples were processed, but did not match the condition. */
 	  processed++;
 	  continue;
 	} else {
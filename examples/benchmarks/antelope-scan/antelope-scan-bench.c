@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native benchmark of full relation scans in Antelope. A
+ *         relation of sensor samples is stored in Coffee on a
+ *         simulated flash, and a selective query is run over it.
+ *         The rows must be read several at a time, and the filter
+ *         must go through several rows for each db_process() call.
+ *         The selected rows and an aggregate are checked.
+ */
+
+#include "contiki.h"
+#include "antelope.h"
+#include "sim-xmem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWS         2000
+#define THRESHOLD    980
+
+/*---------------------------------------------------------------------------*/
+static unsigned
+sample(unsigned n)
+{
+  return (n * 7919) % 1000;
+}
+/*---------------------------------------------------------------------------*/
+/* Run a query to the end; return the number of rows or -1 on errors. */
+static long
+run_query(const char *query, unsigned long *calls, long *first_value)
+{
+  static db_handle_t handle;
+  attribute_value_t value;
+  db_result_t result;
+  long rows;
+
+  *calls = 0;
+  rows = 0;
+  if(DB_ERROR(db_query(&handle, query))) {
+    return -1;
+  }
+  while(db_processing(&handle)) {
+    result = db_process(&handle);
+    (*calls)++;
+    if(result == DB_GOT_ROW) {
+      if(rows == 0 && first_value != NULL &&
+         !DB_ERROR(db_get_value(&value, &handle, 0))) {
+        *first_value = db_value_to_long(&value);
+      }
+      rows++;
+    } else if(result != DB_OK) {
+      db_free(&handle);
+      return result == DB_FINISHED ? rows : -1;
+    }
+  }
+  db_free(&handle);
+  return rows;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(antelope_scan_bench_process, "Antelope scan benchmark");
+AUTOSTART_PROCESSES(&antelope_scan_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(antelope_scan_bench_process, ev, data)
+{
+  unsigned long start, reads, calls, max_calls;
+  long selected, max_value;
+  unsigned n, expected;
+  int ok;
+
+  PROCESS_BEGIN();
+
+  db_init();
+  ok = !DB_ERROR(db_query(NULL, "CREATE RELATION samples;")) &&
+    !DB_ERROR(db_query(NULL, "CREATE ATTRIBUTE time DOMAIN INT IN samples;")) &&
+    !DB_ERROR(db_query(NULL, "CREATE ATTRIBUTE value DOMAIN INT IN samples;"));
+
+  expected = 0;
+  for(n = 0; ok && n < ROWS; n++) {
+    ok = !DB_ERROR(db_query(NULL, "INSERT (%u, %u) INTO samples;",
+                            n, sample(n)));
+    if(sample(n) > THRESHOLD) {
+      expected++;
+    }
+  }
+  if(!ok) {
+    printf("the samples could not be stored\n");
+  }
+
+  start = sim_xmem_reads;
+  selected = run_query("SELECT time, value FROM samples WHERE value > 980;",
+                       &calls, NULL);
+  reads = sim_xmem_reads - start;
+
+  max_value = -1;
+  run_query("SELECT MAX(value) FROM samples;", &max_calls, &max_value);
+
+  printf("%d rows, scan buffer of %d bytes\n", ROWS, DB_SCAN_BUFFER_SIZE);
+  printf("selected %ld of %u expected: %lu flash reads, "
+         "%lu db_process() calls\n", selected, expected, reads, calls);
+  printf("max %ld in %lu db_process() calls\n", max_value, max_calls);
+
+  ok = ok && selected == expected && max_value == 999 &&
+    reads < ROWS / 4 && calls < ROWS / 4;
+  printf("antelope scan check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native check and benchmark of the uIP checksum. Random
+ *         buffers of random length and alignment, and random ICMPv6
+ *         packets with their pseudo-header, are summed by uIP and by
+ *         the byte at a time loop it used to have, which must agree.
+ */
+
+#include "contiki.h"
+#include "net/uip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BUFFERS     10000
+#define MAX_LEN     1280
+#define ROUNDS      20000
+
+#define UIP_IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+static uint8_t buf[MAX_LEN + 8];
+static int errors;
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/* The checksum loop uip6.c had before */
+static uint16_t
+ref_chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint16_t t;
+  const uint8_t *dataptr;
+  const uint8_t *last_byte;
+
+  dataptr = data;
+  last_byte = data + len - 1;
+
+  while(dataptr < last_byte) {
+    t = (dataptr[0] << 8) + dataptr[1];
+    sum += t;
+    if(sum < t) {
+      sum++;
+    }
+    dataptr += 2;
+  }
+
+  if(dataptr == last_byte) {
+    t = (dataptr[0] << 8) + 0;
+    sum += t;
+    if(sum < t) {
+      sum++;
+    }
+  }
+  return sum;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill(uint8_t *p, int len)
+{
+  int i, kind;
+
+  /* All zeros and all ones are the corner cases of the carries. */
+  kind = rand() % 8;
+  for(i = 0; i < len; i++) {
+    p[i] = kind == 0 ? 0 : kind == 1 ? 0xff : rand();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_buffers(void)
+{
+  int i, len, offset;
+  uint16_t sum, ref;
+
+  for(i = 0; i < BUFFERS; i++) {
+    len = rand() % (MAX_LEN + 1);
+    offset = rand() % 8;
+    fill(buf + offset, len);
+    sum = uip_chksum((uint16_t *)(buf + offset), len);
+    ref = uip_htons(ref_chksum(0, buf + offset, len));
+    if(sum != ref) {
+      if(errors++ < 10) {
+        printf("len %d offset %d: 0x%04x, expected 0x%04x\n",
+               len, offset, sum, ref);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_packets(void)
+{
+  int i, len;
+  uint16_t sum, ref;
+
+  for(i = 0; i < BUFFERS; i++) {
+    len = rand() % (UIP_BUFSIZE - UIP_LLIPH_LEN + 1);
+    fill(&uip_buf[UIP_LLH_LEN], UIP_IPH_LEN + len);
+    UIP_IP_BUF->len[0] = len >> 8;
+    UIP_IP_BUF->len[1] = len & 0xff;
+    uip_ext_len = 0;
+    sum = uip_icmp6chksum();
+
+    ref = len + UIP_PROTO_ICMP6;
+    ref = ref_chksum(ref, (uint8_t *)&UIP_IP_BUF->srcipaddr,
+                     2 * sizeof(uip_ipaddr_t));
+    ref = ref_chksum(ref, &uip_buf[UIP_LLIPH_LEN], len);
+    ref = (ref == 0) ? 0xffff : uip_htons(ref);
+    if(sum != ref) {
+      if(errors++ < 10) {
+        printf("packet len %d: 0x%04x, expected 0x%04x\n", len, sum, ref);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(chksum_bench_process, "Checksum benchmark");
+AUTOSTART_PROCESSES(&chksum_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(chksum_bench_process, ev, data)
+{
+  static const int sizes[] = { 40, 127, 1280 };
+  volatile uint16_t sink;
+  uint64_t start, uip_cost, ref_cost;
+  int i, s;
+
+  PROCESS_BEGIN();
+
+  srand(1);
+  check_buffers();
+  check_packets();
+  printf("checksum check: %d errors over %d buffers and %d packets\n",
+         errors, BUFFERS, BUFFERS);
+
+  printf("%s checksum:\n",
+#if UIP_ARCH_CHKSUM_ADD
+#if defined(__AVX2__)
+         "AVX2"
+#elif defined(__SSE2__)
+         "SSE2"
+#else
+         "native"
+#endif
+#else /* UIP_ARCH_CHKSUM_ADD */
+         "generic"
+#endif /* UIP_ARCH_CHKSUM_ADD */
+         );
+  fill(buf, MAX_LEN);
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    start = now_cycles();
+    for(i = 0; i < ROUNDS; i++) {
+      sink = uip_chksum((uint16_t *)buf, sizes[s]);
+    }
+    uip_cost = now_cycles() - start;
+
+    start = now_cycles();
+    for(i = 0; i < ROUNDS; i++) {
+      sink = ref_chksum(0, buf, sizes[s]);
+    }
+    ref_cost = now_cycles() - start;
+    (void)sink;
+
+    printf("  %4d bytes: %5.2f cycles/byte, byte loop %5.2f cycles/byte\n",
+           sizes[s], (double)uip_cost / ROUNDS / sizes[s],
+           (double)ref_cost / ROUNDS / sizes[s]);
+  }
+
+  exit(errors == 0 ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
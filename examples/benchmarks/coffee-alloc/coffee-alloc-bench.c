@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native benchmark of Coffee allocation and file opens on a
+ *         simulated flash image. Files of random sizes are created
+ *         and removed until the garbage collector has run many
+ *         times, and the contents and ends of all files are checked
+ *         along the way, also after a reboot.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "lib/random.h"
+#include "sim-xmem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILES        40
+#define CHURN        2000
+#define MAX_LENGTH   12000
+
+/* The length of each file, or 0 if it does not exist */
+static unsigned length[FILES];
+/*---------------------------------------------------------------------------*/
+static void
+file_name(char *name, unsigned n)
+{
+  sprintf(name, "file-%02u", n);
+}
+/*---------------------------------------------------------------------------*/
+/* File contents are never zero, so that Coffee finds their ends. */
+static unsigned char
+pattern(unsigned n, unsigned offset)
+{
+  return 1 + (n * 31 + offset) % 251;
+}
+/*---------------------------------------------------------------------------*/
+static int
+create(unsigned n, unsigned len)
+{
+  unsigned char buf[256];
+  char name[16];
+  unsigned offset, i, chunk;
+  int fd;
+
+  /* Leave room for the file to grow, as applications do. */
+  file_name(name, n);
+  if(cfs_coffee_reserve(name, 2 * len) < 0) {
+    return 0;
+  }
+  fd = cfs_open(name, CFS_WRITE);
+  if(fd < 0) {
+    return 0;
+  }
+  for(offset = 0; offset < len; offset += chunk) {
+    chunk = len - offset < sizeof(buf) ? len - offset : sizeof(buf);
+    for(i = 0; i < chunk; i++) {
+      buf[i] = pattern(n, offset + i);
+    }
+    if(cfs_write(fd, buf, chunk) != chunk) {
+      cfs_close(fd);
+      return 0;
+    }
+  }
+  cfs_close(fd);
+  length[n] = len;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+verify(unsigned n)
+{
+  unsigned char buf[16];
+  char name[16];
+  unsigned i;
+  int fd, ok;
+
+  file_name(name, n);
+  fd = cfs_open(name, CFS_READ);
+  if(length[n] == 0) {
+    if(fd >= 0) {
+      cfs_close(fd);
+      return 0;
+    }
+    return 1;
+  }
+  if(fd < 0) {
+    return 0;
+  }
+
+  /* The end of the file and the data at both ends */
+  ok = cfs_seek(fd, 0, CFS_SEEK_END) == length[n] &&
+    cfs_seek(fd, 0, CFS_SEEK_SET) == 0 &&
+    cfs_read(fd, buf, sizeof(buf)) == sizeof(buf);
+  for(i = 0; ok && i < sizeof(buf); i++) {
+    ok = buf[i] == pattern(n, i);
+  }
+  ok = ok && cfs_seek(fd, length[n] - sizeof(buf), CFS_SEEK_SET) >= 0 &&
+    cfs_read(fd, buf, sizeof(buf)) == sizeof(buf);
+  for(i = 0; ok && i < sizeof(buf); i++) {
+    ok = buf[i] == pattern(n, length[n] - sizeof(buf) + i);
+  }
+  cfs_close(fd);
+  return ok;
+}
+/*---------------------------------------------------------------------------*/
+static int
+verify_all(void)
+{
+  unsigned n;
+
+  for(n = 0; n < FILES; n++) {
+    if(!verify(n)) {
+      printf("file %u is wrong\n", n);
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(coffee_alloc_bench_process, "Coffee allocation benchmark");
+AUTOSTART_PROCESSES(&coffee_alloc_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_alloc_bench_process, ev, data)
+{
+  unsigned long create_reads, open_reads, reads;
+  unsigned creates, opens, failed;
+  unsigned mem_size;
+  void *mem;
+  char name[16];
+  unsigned n;
+  int i, ok;
+
+  PROCESS_BEGIN();
+
+  cfs_coffee_format();
+  random_init(1);
+
+  ok = 1;
+  creates = opens = failed = 0;
+  create_reads = open_reads = 0;
+  for(i = 0; i < CHURN && ok; i++) {
+    n = random_rand() % FILES;
+    if(length[n] > 0) {
+      file_name(name, n);
+      ok = cfs_remove(name) == 0;
+      length[n] = 0;
+    }
+
+    reads = sim_xmem_reads;
+    if(create(n, 16 + random_rand() % MAX_LENGTH)) {
+      creates++;
+      create_reads += sim_xmem_reads - reads;
+    } else {
+      /* The flash is full until the next collection. */
+      failed++;
+    }
+
+    /* Open a file that is probably not cached. */
+    n = random_rand() % FILES;
+    reads = sim_xmem_reads;
+    ok = ok && verify(n);
+    if(length[n] > 0) {
+      opens++;
+      open_reads += sim_xmem_reads - reads;
+    }
+
+    if(i == CHURN / 2) {
+      /* A reboot loses the RAM state of Coffee but not the flash. */
+      ok = ok && verify_all();
+      mem = cfs_coffee_get_protected_mem(&mem_size);
+      memset(mem, 0, mem_size);
+      ok = ok && verify_all();
+    }
+  }
+  ok = ok && verify_all();
+
+  printf("Coffee allocation, free map %s, %u creates (%u failed), "
+         "%lu erases\n", COFFEE_FREE_MAP ? "on" : "off",
+         creates, failed, sim_xmem_erases);
+  printf("flash reads per create %lu, per open %lu\n",
+         creates ? (create_reads + creates / 2) / creates : 0,
+         opens ? (open_reads + opens / 2) / opens : 0);
+  printf("coffee allocation check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native benchmark of the Coffee page cache on a simulated
+ *         flash that counts its transfers. A table is appended one
+ *         row at a time, scanned with a seek and a read per row as
+ *         Antelope does, and opened many times. With the cache, each
+ *         of these must take well under one transfer per row or
+ *         open. The rows are checked again after a reboot.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "sim-xmem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROW          24
+#define ROWS         1000
+#define OPENS        200
+
+/*---------------------------------------------------------------------------*/
+static unsigned long
+transfers(void)
+{
+  return sim_xmem_reads + sim_xmem_writes;
+}
+/*---------------------------------------------------------------------------*/
+/* Row contents are never zero, so that Coffee finds the file end. */
+static void
+make_row(unsigned char *row, unsigned n)
+{
+  unsigned i;
+
+  for(i = 0; i < ROW; i++) {
+    row[i] = 1 + (n * 13 + i) % 251;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+append_rows(void)
+{
+  unsigned char row[ROW];
+  unsigned n;
+  int fd, ok;
+
+  if(cfs_coffee_reserve("table", (cfs_offset_t)ROW * ROWS) < 0) {
+    return 0;
+  }
+  fd = cfs_open("table", CFS_WRITE | CFS_APPEND);
+  if(fd < 0) {
+    return 0;
+  }
+  ok = 1;
+  for(n = 0; ok && n < ROWS; n++) {
+    make_row(row, n);
+    ok = cfs_write(fd, row, ROW) == ROW;
+  }
+  cfs_close(fd);
+  return ok;
+}
+/*---------------------------------------------------------------------------*/
+static int
+scan_rows(void)
+{
+  unsigned char row[ROW], expected[ROW];
+  unsigned n;
+  int fd, ok;
+
+  fd = cfs_open("table", CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  ok = 1;
+  for(n = 0; ok && n < ROWS; n++) {
+    make_row(expected, n);
+    ok = cfs_seek(fd, (cfs_offset_t)n * ROW, CFS_SEEK_SET) ==
+      (cfs_offset_t)n * ROW &&
+      cfs_read(fd, row, ROW) == ROW && memcmp(row, expected, ROW) == 0;
+  }
+  ok = ok && cfs_read(fd, row, 1) == 0;
+  cfs_close(fd);
+  return ok;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(coffee_cache_bench_process, "Coffee cache benchmark");
+AUTOSTART_PROCESSES(&coffee_cache_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_cache_bench_process, ev, data)
+{
+  unsigned long start, append, scan, opens;
+  unsigned char *mem;
+  unsigned mem_size;
+  int i, fd, ok, rebooted;
+
+  PROCESS_BEGIN();
+
+  cfs_coffee_format();
+
+  start = transfers();
+  ok = append_rows();
+  append = transfers() - start;
+  if(!ok) {
+    printf("the rows could not be appended\n");
+  }
+
+  start = transfers();
+  ok = ok && scan_rows();
+  scan = transfers() - start;
+
+  start = transfers();
+  for(i = 0; ok && i < OPENS; i++) {
+    fd = cfs_open("table", CFS_READ);
+    ok = fd >= 0;
+    cfs_close(fd);
+  }
+  opens = transfers() - start;
+
+  /* Forget everything in RAM and read the rows from the flash. */
+  mem = cfs_coffee_get_protected_mem(&mem_size);
+  memset(mem, 0, mem_size);
+  rebooted = scan_rows();
+
+  printf("%d rows of %d bytes with %d cached pages\n",
+         ROWS, ROW, COFFEE_PAGE_CACHE);
+  printf("transfers: %lu to append, %lu to scan, %lu for %d opens\n",
+         append, scan, opens, OPENS);
+  printf("rows %s, after reboot %s\n",
+         ok ? "ok" : "corrupt", rebooted ? "ok" : "corrupt");
+
+  ok = ok && rebooted && append < ROWS / 3 && scan < ROWS / 4 &&
+    opens < OPENS / 4;
+  printf("coffee cache check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
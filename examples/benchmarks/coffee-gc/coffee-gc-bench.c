@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native benchmark of the Coffee garbage collection stalls. A
+ *         logger appends records to a ring of files on a simulated
+ *         flash whose sector erases take ERASE_TIME clock ticks, while
+ *         a radio process wants to run every RADIO_PERIOD. With the
+ *         background collection, the writers must not wait for
+ *         erases and the radio must never be late by more than one
+ *         erase. The files in the ring are checked at the end.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "sim-xmem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECORD        1024
+#define RECORDS_PER_FILE 8
+#define RING          8
+#define RECORDS       3000
+#define LOG_PERIOD    2
+#define RADIO_PERIOD  10
+#define ERASE_TIME    20
+#define WATERMARK     (2 * 64 * 1024UL)
+
+static clock_time_t longest_write;
+static clock_time_t radio_late;
+static int done;
+/*---------------------------------------------------------------------------*/
+static void
+file_name(char *name, unsigned n)
+{
+  sprintf(name, "log-%u", n);
+}
+/*---------------------------------------------------------------------------*/
+/* Record contents are never zero, so that Coffee finds the file ends. */
+static unsigned char
+pattern(unsigned record, unsigned offset)
+{
+  return 1 + (record * 7 + offset) % 251;
+}
+/*---------------------------------------------------------------------------*/
+/* Append a record, starting a new file and dropping the oldest as needed. */
+static int
+log_record(unsigned record)
+{
+  static int fd = -1;
+  unsigned char buf[RECORD];
+  char name[16];
+  unsigned file, i;
+
+  file = record / RECORDS_PER_FILE;
+  if(record % RECORDS_PER_FILE == 0) {
+    if(fd >= 0) {
+      cfs_close(fd);
+    }
+    if(file >= RING) {
+      file_name(name, file - RING);
+      cfs_remove(name);
+    }
+    file_name(name, file);
+    if(cfs_coffee_reserve(name, RECORD * RECORDS_PER_FILE) < 0) {
+      return 0;
+    }
+    fd = cfs_open(name, CFS_WRITE);
+    if(fd < 0) {
+      return 0;
+    }
+  }
+  for(i = 0; i < RECORD; i++) {
+    buf[i] = pattern(record, i);
+  }
+  if(cfs_write(fd, buf, RECORD) != RECORD) {
+    return 0;
+  }
+  if(record % RECORDS_PER_FILE == RECORDS_PER_FILE - 1) {
+    cfs_close(fd);
+    fd = -1;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+verify(unsigned file)
+{
+  unsigned char buf[RECORD];
+  char name[16];
+  unsigned record, i;
+  int fd, ok;
+
+  file_name(name, file);
+  fd = cfs_open(name, CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  ok = 1;
+  for(record = file * RECORDS_PER_FILE;
+      ok && record < (file + 1) * RECORDS_PER_FILE; record++) {
+    ok = cfs_read(fd, buf, RECORD) == RECORD;
+    for(i = 0; ok && i < RECORD; i++) {
+      ok = buf[i] == pattern(record, i);
+    }
+  }
+  ok = ok && cfs_read(fd, buf, 1) == 0;
+  cfs_close(fd);
+  return ok;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(radio_process, "Radio");
+PROCESS(coffee_gc_bench_process, "Coffee GC benchmark");
+AUTOSTART_PROCESSES(&coffee_gc_bench_process, &radio_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(radio_process, ev, data)
+{
+  static struct etimer et;
+  clock_time_t late;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&et, RADIO_PERIOD);
+  while(!done) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    late = clock_time() - (et.timer.start + et.timer.interval);
+    if(late > radio_late) {
+      radio_late = late;
+    }
+    etimer_set(&et, RADIO_PERIOD);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_gc_bench_process, ev, data)
+{
+  static struct etimer et;
+  static unsigned record;
+  const struct cfs_coffee_gc_stats *stats;
+  clock_time_t start, t;
+  unsigned file;
+  int ok;
+
+  PROCESS_BEGIN();
+
+  sim_xmem_erase_time = ERASE_TIME;
+  cfs_coffee_format();
+  cfs_coffee_set_gc_watermark(WATERMARK);
+
+  ok = 1;
+  for(record = 0; ok && record < RECORDS; record++) {
+    etimer_set(&et, LOG_PERIOD);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    start = clock_time();
+    ok = log_record(record);
+    t = clock_time() - start;
+    if(t > longest_write) {
+      longest_write = t;
+    }
+  }
+  done = 1;
+  if(!ok) {
+    printf("record %u could not be written\n", record - 1);
+  }
+
+  for(file = RECORDS / RECORDS_PER_FILE - RING;
+      ok && file < RECORDS / RECORDS_PER_FILE; file++) {
+    ok = verify(file);
+    if(!ok) {
+      printf("file %u is corrupt\n", file);
+    }
+  }
+
+  stats = cfs_coffee_get_gc_stats();
+  printf("%d records of %d bytes: %lu erases, %u in the background\n",
+         RECORDS, RECORD, sim_xmem_erases, stats->background_erases);
+  printf("%u stalls erasing %u sectors, longest %lu ticks\n",
+         stats->stalls, stats->stall_erases,
+         (unsigned long)stats->longest_stall);
+  printf("longest write %lu ticks, radio late by up to %lu ticks "
+         "(erase %d ticks)\n",
+         (unsigned long)longest_write, (unsigned long)radio_late, ERASE_TIME);
+
+  ok = ok && stats->stall_erases == 0 && longest_write < ERASE_TIME &&
+    radio_late < 2 * ERASE_TIME;
+  printf("coffee gc check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
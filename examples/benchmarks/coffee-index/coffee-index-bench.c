@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native benchmark of Coffee file lookups on a simulated flash
+ *         image. Counts the flash reads done by cfs_open() for files
+ *         that exist and for files that do not, and checks that every
+ *         file is still found after removals, log merges and a reboot.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "sim-xmem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FILES        48
+#define OPENS        2000
+
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static void
+file_name(char *name, const char *prefix, unsigned n)
+{
+  sprintf(name, "%s-%02u", prefix, n);
+}
+/*---------------------------------------------------------------------------*/
+static int
+create(unsigned n)
+{
+  char name[16], tag[16];
+  int fd;
+
+  file_name(name, "data", n);
+  file_name(tag, "tag", n);
+  if(cfs_coffee_reserve(name, 64) < 0) {
+    return 0;
+  }
+  fd = cfs_open(name, CFS_WRITE);
+  if(fd < 0) {
+    return 0;
+  }
+  cfs_write(fd, tag, strlen(tag));
+  cfs_close(fd);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* The file opens and starts with its own tag. */
+static int
+verify(unsigned n)
+{
+  char name[16], tag[16], buf[16];
+  int fd, r;
+
+  file_name(name, "data", n);
+  file_name(tag, "tag", n);
+  fd = cfs_open(name, CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  r = cfs_read(fd, buf, sizeof(buf));
+  cfs_close(fd);
+  return r >= strlen(tag) && memcmp(buf, tag, strlen(tag)) == 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+absent(const char *prefix, unsigned n)
+{
+  char name[16];
+  int fd;
+
+  file_name(name, prefix, n);
+  fd = cfs_open(name, CFS_READ);
+  if(fd >= 0) {
+    cfs_close(fd);
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_all(void)
+{
+  unsigned n;
+
+  for(n = 0; n < FILES; n++) {
+    if(n % 4 == 1 ? !absent("data", n) : !verify(n)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Flash reads and nanoseconds per open of an existing or missing file */
+static void
+measure(int hit, double *reads, double *ns)
+{
+  char name[16];
+  unsigned long start_reads;
+  uint64_t start;
+  unsigned n;
+  int i, fd;
+
+  start_reads = sim_xmem_reads;
+  start = now_ns();
+  for(i = 0; i < OPENS; i++) {
+    n = (i * 7) % FILES;
+    if(hit && n % 4 == 1) {
+      n++;
+    }
+    file_name(name, hit ? "data" : "none", n);
+    fd = cfs_open(name, CFS_READ);
+    if(fd >= 0) {
+      cfs_close(fd);
+    }
+  }
+  *ns = (double)(now_ns() - start) / OPENS;
+  *reads = (double)(sim_xmem_reads - start_reads) / OPENS;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(coffee_index_bench_process, "Coffee index benchmark");
+AUTOSTART_PROCESSES(&coffee_index_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_index_bench_process, ev, data)
+{
+  static char buf[600];
+  double hit_reads, hit_ns, miss_reads, miss_ns;
+  unsigned mem_size;
+  void *mem;
+  unsigned n;
+  int fd, ok;
+
+  PROCESS_BEGIN();
+
+  cfs_coffee_format();
+
+  ok = 1;
+  for(n = 0; n < FILES && ok; n++) {
+    ok = create(n);
+  }
+
+  /* Remove every fourth file and grow the first one, which makes
+     Coffee move it to larger extents. */
+  for(n = 1; n < FILES; n += 4) {
+    char name[16];
+
+    file_name(name, "data", n);
+    ok = ok && cfs_remove(name) == 0;
+  }
+  fd = cfs_open("data-00", CFS_WRITE | CFS_APPEND);
+  memset(buf, 'x', sizeof(buf));
+  ok = ok && fd >= 0 && cfs_write(fd, buf, sizeof(buf)) == sizeof(buf);
+  cfs_close(fd);
+  ok = ok && check_all();
+  printf("files and removals: %s\n", ok ? "ok" : "FAILED");
+
+  measure(1, &hit_reads, &hit_ns);
+  measure(0, &miss_reads, &miss_ns);
+  printf("Coffee open, %d files, index size %d\n", FILES, COFFEE_INDEX_SIZE);
+  printf("%8s %12s %10s\n", "", "reads/open", "ns/open");
+  printf("%8s %12.1f %10.0f\n", "hit", hit_reads, hit_ns);
+  printf("%8s %12.1f %10.0f\n", "miss", miss_reads, miss_ns);
+
+  /* A reboot loses the RAM state of Coffee but not the flash. */
+  mem = cfs_coffee_get_protected_mem(&mem_size);
+  memset(mem, 0, mem_size);
+  ok = ok && check_all();
+  printf("after reboot: %s\n", ok ? "ok" : "FAILED");
+
+  if(COFFEE_INDEX_SIZE >= FILES) {
+    ok = ok && hit_reads <= 4 && miss_reads <= 1;
+  }
+  printf("coffee index check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         A simulated flash for the native benchmarks
+ */
+
+#include "contiki.h"
+#include "dev/xmem.h"
+#include "sim-xmem.h"
+
+#include <string.h>
+
+static unsigned char flash[SIM_XMEM_SIZE];
+
+unsigned long sim_xmem_reads;
+unsigned long sim_xmem_writes;
+unsigned long sim_xmem_erases;
+clock_time_t sim_xmem_erase_time;
+/*---------------------------------------------------------------------------*/
+int
+xmem_pwrite(const void *buf, int size, unsigned long offset)
+{
+  sim_xmem_writes++;
+  memcpy(&flash[offset], buf, size);
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_pread(void *buf, int size, unsigned long offset)
+{
+  sim_xmem_reads++;
+  memcpy(buf, &flash[offset], size);
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_erase(long nbytes, unsigned long offset)
+{
+  clock_time_t start;
+
+  start = clock_time();
+  while(clock_time() - start < sim_xmem_erase_time);
+  sim_xmem_erases++;
+  memset(&flash[offset], 0, nbytes);
+  return nbytes;
+}
+/*---------------------------------------------------------------------------*/
+void
+xmem_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
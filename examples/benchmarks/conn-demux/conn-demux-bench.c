@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native check and benchmark of how uip6.c finds the UDP and
+ *         TCP connection of an incoming packet. Every UDP connection
+ *         is bound to a port of its own, and packets to random ports
+ *         must reach the right connection; overlapping bindings must
+ *         resolve as a scan of uip_udp_conns would. SYNs to listening
+ *         ports must open one connection per remote port.
+ */
+
+#include "contiki.h"
+#include "net/tcpip.h"
+#include "net/uip.h"
+#include "net/uip-ds6.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PACKETS      100000
+#define BASE_PORT    20000
+#define LISTEN_PORTS 8
+#define SYN_SOURCES  2
+
+#define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF  ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+#define UIP_TCP_BUF  ((struct uip_tcp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+
+static struct uip_udp_conn *conns[UIP_UDP_CONNS];
+static struct uip_udp_conn *delivered;
+static uip_ipaddr_t local, remote;
+static int errors;
+
+PROCESS(sink_process, "UDP sink");
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+static void
+ip_header(uint8_t proto, int len)
+{
+  memset(UIP_IP_BUF, 0, UIP_IPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->len[0] = len >> 8;
+  UIP_IP_BUF->len[1] = len & 0xff;
+  UIP_IP_BUF->proto = proto;
+  UIP_IP_BUF->ttl = 64;
+  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &remote);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &local);
+  uip_len = UIP_IPH_LEN + len;
+  uip_ext_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Process a UDP packet and return the connection it was given to. */
+static struct uip_udp_conn *
+input_udp(uint16_t srcport, uint16_t destport)
+{
+  ip_header(UIP_PROTO_UDP, UIP_UDPH_LEN + 4);
+  UIP_UDP_BUF->srcport = UIP_HTONS(srcport);
+  UIP_UDP_BUF->destport = UIP_HTONS(destport);
+  UIP_UDP_BUF->udplen = UIP_HTONS(UIP_UDPH_LEN + 4);
+  /* No checksum */
+  UIP_UDP_BUF->udpchksum = 0;
+  memcpy(&uip_buf[UIP_LLIPH_LEN + UIP_UDPH_LEN], "ping", 4);
+
+  delivered = NULL;
+  uip_input();
+  return delivered;
+}
+/*---------------------------------------------------------------------------*/
+/* Process a TCP SYN and return the flags of the answer. */
+static uint8_t
+input_syn(uint16_t srcport, uint16_t destport)
+{
+  ip_header(UIP_PROTO_TCP, UIP_TCPH_LEN);
+  memset(UIP_TCP_BUF, 0, UIP_TCPH_LEN);
+  UIP_TCP_BUF->srcport = UIP_HTONS(srcport);
+  UIP_TCP_BUF->destport = UIP_HTONS(destport);
+  UIP_TCP_BUF->seqno[3] = 1;
+  UIP_TCP_BUF->tcpoffset = 5 << 4;
+  UIP_TCP_BUF->flags = 0x02; /* SYN */
+  UIP_TCP_BUF->wnd[0] = 1;
+  UIP_TCP_BUF->tcpchksum = ~(uip_tcpchksum());
+
+  uip_input();
+  return uip_len > 0 ? UIP_TCP_BUF->flags : 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(int ok, const char *what)
+{
+  if(!ok && errors++ < 10) {
+    printf("%s\n", what);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The UDP connections all belong to this process. */
+PROCESS_THREAD(sink_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_YIELD();
+    if(ev == tcpip_event) {
+      delivered = data;
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(demux_bench_process, "Connection demultiplexing benchmark");
+AUTOSTART_PROCESSES(&demux_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(demux_bench_process, ev, data)
+{
+  uint64_t start, cost;
+  int i, n, p, open;
+
+  PROCESS_BEGIN();
+
+  uip_ip6addr(&local, 0xaaaa, 0, 0, 0, 0, 0, 0, 0x99);
+  uip_ip6addr(&remote, 0xaaaa, 0, 0, 0, 0, 0, 0, 1);
+  uip_ds6_addr_add(&local, 0, ADDR_MANUAL);
+
+  /* One connection per port, as a CoAP gateway has per client */
+  process_start(&sink_process, NULL);
+  for(n = 0; n < UIP_UDP_CONNS; n++) {
+    conns[n] = uip_udp_new(NULL, 0);
+    if(conns[n] == NULL) {
+      break;
+    }
+    conns[n]->appstate.p = &sink_process;
+    conns[n]->appstate.state = conns[n];
+    uip_udp_bind(conns[n], UIP_HTONS(BASE_PORT + n));
+  }
+  check(n == UIP_UDP_CONNS, "could not allocate all connections");
+
+  srand(1);
+  for(i = 0; i < PACKETS / 10; i++) {
+    p = rand() % n;
+    check(input_udp(1000 + p, BASE_PORT + p) == conns[p],
+          "UDP packet given to the wrong connection");
+  }
+
+  /* Overlapping bindings: the first connection in the table wins. */
+  uip_udp_remove(conns[10]);
+  check(input_udp(1000, BASE_PORT + 10) == NULL,
+        "UDP packet given to a removed connection");
+  conns[20]->rport = UIP_HTONS(1000);
+  uip_udp_bind(conns[10], UIP_HTONS(BASE_PORT + 20));
+  check(input_udp(1000, BASE_PORT + 20) == conns[10],
+        "UDP packet not given to the first matching connection");
+  uip_udp_remove(conns[10]);
+  check(input_udp(1000, BASE_PORT + 20) == conns[20],
+        "UDP packet not given to the connection bound to its port");
+  check(input_udp(1001, BASE_PORT + 20) == NULL,
+        "UDP packet given to a connection bound to another remote port");
+  uip_udp_bind(conns[10], UIP_HTONS(BASE_PORT + 10));
+  conns[20]->rport = 0;
+
+  /* TCP: one new connection per SYN source, none for duplicates */
+  for(p = 0; p < LISTEN_PORTS; p++) {
+    uip_listen(UIP_HTONS(80 + p));
+  }
+  uip_unlisten(UIP_HTONS(80));
+  for(i = 0; i < 2; i++) {
+    for(p = 1; p < LISTEN_PORTS; p++) {
+      for(n = 0; n < SYN_SOURCES; n++) {
+        check(input_syn(5000 + n, 80 + p) == (0x02 | 0x10),
+              "no SYNACK for a SYN to a listening port");
+      }
+    }
+  }
+  check(input_syn(5000, 80) & 0x04, "no RST for a SYN to a closed port");
+  open = 0;
+  for(i = 0; i < UIP_CONNS; i++) {
+    if(uip_conns[i].tcpstateflags != UIP_CLOSED) {
+      open++;
+    }
+  }
+  check(open == (LISTEN_PORTS - 1) * SYN_SOURCES,
+        "wrong number of TCP connections opened");
+
+  /* Time the demultiplexing of UDP packets to random connections. */
+  start = now_cycles();
+  for(i = 0; i < PACKETS; i++) {
+    p = rand() % UIP_UDP_CONNS;
+    if(input_udp(1000 + p, BASE_PORT + p) != conns[p]) {
+      errors++;
+    }
+  }
+  cost = now_cycles() - start;
+
+  printf("%d UDP connections, %d hash buckets: %lu cycles per packet\n",
+         UIP_UDP_CONNS, UIP_CONN_HASH_SIZE, (unsigned long)(cost / PACKETS));
+  printf("demultiplexing check: %s\n", errors == 0 ? "ok" : "FAILED");
+
+  exit(errors == 0 ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native check of the adaptive ContikiMAC channel check rate.
+ *         A neighbor sends to this node every 50 ms for two seconds,
+ *         advertising a fast rate of its own, then goes quiet. The
+ *         channel check interval must shrink under the load and come
+ *         back once idle, and the phase entry of the neighbor must
+ *         follow its advertised rate.
+ */
+
+#include "contiki.h"
+#include "net/mac/contikimac.h"
+#include "net/mac/mac.h"
+#include "net/mac/phase.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/rime/rimeaddr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SENDER_SHIFT 2
+#define PAYLOAD_LEN  20
+
+static int delivered;
+/*---------------------------------------------------------------------------*/
+/* A MAC driver that counts what ContikiMAC passes up. */
+static void
+count_send(mac_callback_t sent, void *ptr)
+{
+  mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+count_input(void)
+{
+  delivered++;
+}
+/*---------------------------------------------------------------------------*/
+static int
+count_on(void)
+{
+  return NETSTACK_RDC.on();
+}
+/*---------------------------------------------------------------------------*/
+static int
+count_off(int keep_radio_on)
+{
+  return NETSTACK_RDC.off(keep_radio_on);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+count_channel_check_interval(void)
+{
+  return NETSTACK_RDC.channel_check_interval();
+}
+/*---------------------------------------------------------------------------*/
+static void
+count_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+const struct mac_driver count_mac_driver = {
+  "count",
+  count_init,
+  count_send,
+  count_input,
+  count_on,
+  count_off,
+  count_channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+/* Frame a packet from sender to this node the way ContikiMAC does,
+   and hand it to ContikiMAC as if the radio had received it. */
+static void
+input_frame(const rimeaddr_t *sender, uint8_t shift)
+{
+  uint8_t frame[PACKETBUF_SIZE];
+  rimeaddr_t self;
+  uint8_t *hdr;
+  int len;
+
+  /* The framer takes the source address from rimeaddr_node_addr. */
+  rimeaddr_copy(&self, &rimeaddr_node_addr);
+  rimeaddr_copy(&rimeaddr_node_addr, sender);
+
+  packetbuf_clear();
+  memset(packetbuf_dataptr(), 0x5a, PAYLOAD_LEN);
+  packetbuf_set_datalen(PAYLOAD_LEN);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &self);
+  packetbuf_hdralloc(2);
+  hdr = packetbuf_hdrptr();
+  hdr[0] = shift << 4;
+  hdr[1] = PAYLOAD_LEN;
+  len = NETSTACK_FRAMER.create();
+  rimeaddr_copy(&rimeaddr_node_addr, &self);
+  if(len < 0) {
+    return;
+  }
+  packetbuf_compact();
+  len = packetbuf_totlen();
+  memcpy(frame, packetbuf_hdrptr(), len);
+
+  packetbuf_clear();
+  memcpy(packetbuf_dataptr(), frame, len);
+  packetbuf_set_datalen(len);
+  NETSTACK_RDC.input();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(adapt_bench_process, "ContikiMAC adaptive cycle benchmark");
+AUTOSTART_PROCESSES(&adapt_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(adapt_bench_process, ev, data)
+{
+  static struct etimer et;
+  static rimeaddr_t sender;
+  static unsigned short base, busy, idle;
+  static uint8_t shift_learned, shift_after_noack;
+  static int i;
+  int ok;
+
+  PROCESS_BEGIN();
+
+  memset(&sender, 0, sizeof(sender));
+  sender.u8[0] = 7;
+  /* We have sent to the neighbor before, so its phase is known. */
+  phase_update(&sender, RTIMER_NOW(), MAC_TX_OK);
+
+  base = NETSTACK_RDC.channel_check_interval();
+
+  for(i = 0; i < 40; i++) {
+    input_frame(&sender, SENDER_SHIFT);
+    etimer_set(&et, CLOCK_SECOND / 20);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  }
+  busy = NETSTACK_RDC.channel_check_interval();
+  shift_learned = phase_cycle_shift(&sender);
+
+  etimer_set(&et, 2 * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  idle = NETSTACK_RDC.channel_check_interval();
+
+  /* A missed ACK makes us assume the base rate again. */
+  phase_update(&sender, RTIMER_NOW(), MAC_TX_NOACK);
+  shift_after_noack = phase_cycle_shift(&sender);
+
+  printf("%d of 40 packets delivered\n", delivered);
+  printf("channel check interval: %u ticks at start, %u under load, "
+         "%u when idle\n", base, busy, idle);
+  printf("neighbor cycle shift: %u advertised, %u after a missed ACK\n",
+         shift_learned, shift_after_noack);
+
+  ok = delivered == 40 && busy < base && idle == base &&
+    shift_learned == SENDER_SHIFT && shift_after_noack == 0;
+  printf("adaptive cycle check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+#ifndef __PROJECT_CONF_H__
+#define __PROJECT_CONF_H__
+
+#undef NETSTACK_CONF_RDC
+#define NETSTACK_CONF_RDC contikimac_driver
+
+/* Count the packets ContikiMAC delivers instead of parsing them. */
+#undef NETSTACK_CONF_MAC
+#define NETSTACK_CONF_MAC count_mac_driver
+
+/* ContikiMAC drops duplicates by the 802.15.4 sequence number. */
+#undef NETSTACK_CONF_FRAMER
+#define NETSTACK_CONF_FRAMER framer_802154
+
+#ifndef CONTIKIMAC_CONF_ADAPTIVE_CYCLE
+#define CONTIKIMAC_CONF_ADAPTIVE_CYCLE 1
+#endif /* CONTIKIMAC_CONF_ADAPTIVE_CYCLE */
+
+/* Measure the load four times per second to keep the run short. */
+#define CONTIKIMAC_CONF_ADAPT_INTERVAL (CLOCK_SECOND / 4)
+
+#endif /* __PROJECT_CONF_H__ */
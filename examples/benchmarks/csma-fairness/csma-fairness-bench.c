@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native check of CSMA fairness between neighbors. One
+ *         neighbor is flooded with packets just before three others
+ *         get one packet each. The flood may only use its share of
+ *         the queue buffers, and every other neighbor must get its
+ *         turn before the flooded one sends its second packet. A
+ *         fifth neighbor never acknowledges, and must show up in the
+ *         per-neighbor statistics as backed off and dropped.
+ */
+
+#include "contiki.h"
+#include "net/mac/csma.h"
+#include "net/mac/mac.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/rime/rimeaddr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLOOD       12
+#define FLOODED     1
+#define OTHERS      3
+#define LOSSY       (FLOODED + OTHERS + 1)
+#define TOTAL       (FLOOD + OTHERS + 1)
+#define MAX_FRAMES  32
+
+/* Neighbor number of every frame handed to the RDC layer, in order */
+static uint8_t frames[MAX_FRAMES];
+static int frame_count;
+static int callbacks;
+/*---------------------------------------------------------------------------*/
+static void
+set_addr(rimeaddr_t *addr, int neighbor)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->u8[0] = neighbor;
+}
+/*---------------------------------------------------------------------------*/
+/* An RDC driver that notes who each frame is for, and acknowledges
+   every frame except those for the lossy neighbor. */
+static void
+capture_send(mac_callback_t sent, void *ptr)
+{
+  int neighbor;
+
+  neighbor = packetbuf_addr(PACKETBUF_ADDR_RECEIVER)->u8[0];
+  if(frame_count < MAX_FRAMES) {
+    frames[frame_count++] = neighbor;
+  }
+  mac_call_sent_callback(sent, ptr,
+                         neighbor == LOSSY ? MAC_TX_NOACK : MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+capture_send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *list)
+{
+  if(list != NULL) {
+    queuebuf_to_packetbuf(list->buf);
+    capture_send(sent, ptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+capture_input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static int
+capture_on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+capture_off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+capture_channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+capture_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver capture_rdc_driver = {
+  "capture",
+  capture_init,
+  capture_send,
+  capture_send_list,
+  capture_input,
+  capture_on,
+  capture_off,
+  capture_channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+static void
+packet_done(void *ptr, int status, int num_tx)
+{
+  callbacks++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_to(int neighbor)
+{
+  rimeaddr_t addr;
+
+  set_addr(&addr, neighbor);
+  packetbuf_clear();
+  memset(packetbuf_dataptr(), neighbor, 20);
+  packetbuf_set_datalen(20);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &addr);
+  NETSTACK_MAC.send(packet_done, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static const struct csma_stats *
+stats_of(int neighbor)
+{
+  rimeaddr_t addr;
+
+  set_addr(&addr, neighbor);
+  return csma_neighbor_stats(&addr);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(csma_bench_process, "CSMA fairness benchmark");
+AUTOSTART_PROCESSES(&csma_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(csma_bench_process, ev, data)
+{
+  static struct etimer et;
+  static int waited;
+  const struct csma_stats *s;
+  int i, n, second_flooded, served, ok;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < FLOOD; i++) {
+    send_to(FLOODED);
+  }
+  for(n = FLOODED + 1; n <= LOSSY; n++) {
+    send_to(n);
+  }
+
+  /* Let CSMA drain its queues, retransmissions included. */
+  for(waited = 0; callbacks < TOTAL && waited < 10 * CLOCK_SECOND;
+      waited += CLOCK_SECOND / 20) {
+    etimer_set(&et, CLOCK_SECOND / 20);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  }
+
+  printf("%d frames sent for %d packets:", frame_count, TOTAL);
+  for(i = 0; i < frame_count; i++) {
+    printf(" %u", frames[i]);
+  }
+  printf("\n");
+
+  /* Every other neighbor must have been served before the flooded
+     neighbor got its second turn. */
+  second_flooded = frame_count;
+  for(i = 0, n = 0; i < frame_count; i++) {
+    if(frames[i] == FLOODED && ++n == 2) {
+      second_flooded = i;
+      break;
+    }
+  }
+  served = 0;
+  for(n = FLOODED + 1; n < LOSSY; n++) {
+    for(i = 0; i < second_flooded; i++) {
+      if(frames[i] == n) {
+        served++;
+        break;
+      }
+    }
+  }
+
+  ok = callbacks == TOTAL && served == OTHERS;
+  for(n = FLOODED; n <= LOSSY; n++) {
+    s = stats_of(n);
+    if(s == NULL) {
+      ok = 0;
+      continue;
+    }
+    printf("neighbor %d: sent %u, dropped %u, backoffs %u\n",
+           n, s->sent, s->dropped, s->backoffs);
+  }
+  s = stats_of(FLOODED);
+  ok = ok && s != NULL && s->sent == CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR &&
+    s->dropped == FLOOD - CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR;
+  s = stats_of(LOSSY);
+  ok = ok && s != NULL && s->sent == 0 && s->dropped == 1 &&
+    s->backoffs > 0;
+  printf("fairness check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
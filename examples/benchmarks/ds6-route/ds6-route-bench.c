@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \file
+ *         Native benchmark of uip_ds6_route_lookup() on a routing table
+ *         shaped like that of an RPL root: one host route per node of
+ *         the DAG, plus a few shorter prefixes. Lookups are checked
+ *         against a walk of the whole table.
+ */
+
+#include "contiki.h"
+#include "net/uip-ds6.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOOKUPS   200000
+#define NEXTHOPS  16
+
+static uip_ipaddr_t nexthops[NEXTHOPS];
+static volatile uintptr_t sink;
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+static void
+node_addr(uip_ipaddr_t *addr, unsigned n)
+{
+  uip_ip6addr(addr, 0xaaaa, 0, 0, 0, 0x0212, 0x7400, n >> 8, n & 0xff);
+}
+/*---------------------------------------------------------------------------*/
+/* The longest-prefix match, found the way it was done before the index. */
+static uip_ds6_route_t *
+reference_lookup(uip_ipaddr_t *addr)
+{
+  uip_ds6_route_t *r, *found;
+  uint8_t longest;
+
+  found = NULL;
+  longest = 0;
+  for(r = uip_ds6_route_head(); r != NULL; r = uip_ds6_route_next(r)) {
+    if(r->length >= longest &&
+       uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
+      longest = r->length;
+      found = r;
+    }
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static double
+measure(unsigned count, int hit)
+{
+  uip_ipaddr_t addrs[64];
+  uint64_t start, end;
+  long i;
+
+  for(i = 0; i < 64; i++) {
+    node_addr(&addrs[i], hit ? 1 + (i * 37) % count : 0x8000 + i);
+  }
+  start = now_cycles();
+  for(i = 0; i < LOOKUPS; i++) {
+    sink = (uintptr_t)uip_ds6_route_lookup(&addrs[i & 63]);
+  }
+  end = now_cycles();
+  return (double)(end - start) / LOOKUPS;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check(unsigned count)
+{
+  uip_ipaddr_t addr;
+  unsigned n;
+
+  for(n = 0; n < count + 64; n++) {
+    node_addr(&addr, n);
+    if(uip_ds6_route_lookup(&addr) != reference_lookup(&addr)) {
+      return 0;
+    }
+  }
+  uip_ip6addr(&addr, 0xbbbb, 0, 0, 0, 0, 0, 0, 1);
+  return uip_ds6_route_lookup(&addr) == reference_lookup(&addr);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(ds6_route_bench_process, "Route lookup benchmark");
+AUTOSTART_PROCESSES(&ds6_route_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(ds6_route_bench_process, ev, data)
+{
+  uip_lladdr_t lladdr;
+  uip_ipaddr_t addr;
+  uip_ds6_route_t *r;
+  unsigned n, size;
+  int i, ok;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < NEXTHOPS; i++) {
+    uip_ip6addr(&nexthops[i], 0xfe80, 0, 0, 0, 0x0212, 0x7400, 0, i + 1);
+    memset(&lladdr, 0, sizeof(lladdr));
+    lladdr.addr[sizeof(lladdr) - 1] = i + 1;
+    uip_ds6_nbr_add(&nexthops[i], &lladdr, 1, NBR_REACHABLE);
+  }
+
+  printf("uip_ds6_route_lookup, %s, %s/lookup\n",
+         UIP_DS6_ROUTE_INDEX ? "index" : "list walk",
+#if defined(__i386__) || defined(__x86_64__)
+         "cycles"
+#else
+         "ns"
+#endif
+         );
+  printf("%8s %8s %8s\n", "routes", "hit", "miss");
+  n = 0;
+  ok = 1;
+  for(size = 16; size <= UIP_DS6_ROUTE_NB; size *= 2) {
+    while(n < size) {
+      n++;
+      node_addr(&addr, n);
+      if(uip_ds6_route_add(&addr, 128, &nexthops[n % NEXTHOPS]) == NULL) {
+        ok = 0;
+      }
+    }
+    printf("%8u %8.1f %8.1f\n", size, measure(size, 1), measure(size, 0));
+    ok = ok && check(size);
+  }
+
+  /* Prefix routes must be matched longest first, and host routes must
+     still be found after others are removed. */
+  uip_ds6_route_rm(uip_ds6_route_lookup(&addr));
+  uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_route_add(&addr, 64, &nexthops[1]);
+  uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0x0212, 0x7400, 0x0100, 0);
+  uip_ds6_route_add(&addr, 120, &nexthops[2]);
+  uip_ip6addr(&addr, 0xbbbb, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_route_add(&addr, 16, &nexthops[3]);
+  ok = ok && check(size / 2);
+  for(n = 1; n < size / 2; n += 3) {
+    node_addr(&addr, n);
+    r = uip_ds6_route_lookup(&addr);
+    if(r != NULL && r->length == 128) {
+      uip_ds6_route_rm(r);
+    }
+  }
+  ok = ok && check(size / 2);
+  printf("route check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
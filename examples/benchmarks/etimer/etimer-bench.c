@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \file
+ *         Native benchmark of the event timer backend: cost of setting
+ *         a timer and of finding the next expiration time, as a
+ *         function of the number of pending timers. Then checks that
+ *         a mix of short timers, some of them stopped or restarted,
+ *         all expire, never early, and that the next expiration time
+ *         is always right.
+ */
+
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TIMERS   160
+#define ROUNDS   100000
+
+static struct etimer timers[TIMERS];
+static struct etimer probe;
+static char pending[TIMERS];
+static volatile clock_time_t sink;
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/* Time from now until t, 0 if t has passed. */
+static clock_time_t
+until(clock_time_t t, clock_time_t now)
+{
+  return (long)(t - now) < 0 ? 0 : t - now;
+}
+/*---------------------------------------------------------------------------*/
+/* The next expiration cannot be later than that of any pending timer
+   of ours, found by looking at each of them. Other processes may have
+   earlier timers. */
+static int
+next_expiration_ok(void)
+{
+  clock_time_t now, dist, best;
+  int i, found;
+
+  now = clock_time();
+  found = 0;
+  best = 0;
+  for(i = 0; i < TIMERS; i++) {
+    /* Skip the timers whose event is already on its way. */
+    if(pending[i] && !etimer_expired(&timers[i])) {
+      dist = until(etimer_expiration_time(&timers[i]), now);
+      if(!found || dist < best) {
+        best = dist;
+        found = 1;
+      }
+    }
+  }
+  return !found || (etimer_pending() &&
+                    until(etimer_next_expiration_time(), now) <= best);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(etimer_bench_process, "Event timer benchmark");
+AUTOSTART_PROCESSES(&etimer_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(etimer_bench_process, ev, data)
+{
+  static int i, n, size, fired, ok, left;
+  uint64_t start, set_cost, next_cost;
+  struct etimer *t;
+
+  PROCESS_BEGIN();
+
+  printf("etimer, %s, %s/operation\n",
+         ETIMER_HEAP_SIZE ? "heap" : "list",
+#if defined(__i386__) || defined(__x86_64__)
+         "cycles"
+#else
+         "ns"
+#endif
+         );
+  printf("%8s %8s %8s\n", "timers", "set", "next");
+  n = 0;
+  for(size = 8; size <= 128; size *= 2) {
+    while(n < size) {
+      etimer_set(&timers[n], 60 * CLOCK_SECOND + n * 7 % 13);
+      n++;
+    }
+    start = now_cycles();
+    for(i = 0; i < ROUNDS; i++) {
+      etimer_set(&probe, 30 * CLOCK_SECOND + (i & 63));
+      etimer_stop(&probe);
+    }
+    set_cost = now_cycles() - start;
+    start = now_cycles();
+    for(i = 0; i < ROUNDS; i++) {
+      sink = etimer_next_expiration_time();
+    }
+    next_cost = now_cycles() - start;
+    printf("%8d %8.1f %8.1f\n", size, (double)set_cost / ROUNDS / 2,
+           (double)next_cost / ROUNDS);
+  }
+  for(i = 0; i < n; i++) {
+    etimer_stop(&timers[i]);
+  }
+
+  /* Short timers; a third is stopped and a third restarted later. */
+  srand(1);
+  ok = 1;
+  for(i = 0; i < TIMERS; i++) {
+    etimer_set(&timers[i], 1 + rand() % 200);
+    pending[i] = 1;
+    ok = ok && next_expiration_ok();
+  }
+  for(i = 0; i < TIMERS; i += 3) {
+    etimer_stop(&timers[i]);
+    pending[i] = 0;
+    ok = ok && next_expiration_ok();
+  }
+  for(i = 1; i < TIMERS; i += 3) {
+    etimer_set(&timers[i], 50 + rand() % 200);
+    ok = ok && next_expiration_ok();
+  }
+
+  fired = 0;
+  left = TIMERS - (TIMERS + 2) / 3;
+  while(ok && fired < left) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+    t = data;
+    i = t - timers;
+    if(i < 0 || i >= TIMERS || !pending[i] || !timer_expired(&t->timer)) {
+      ok = 0;
+    }
+    pending[i] = 0;
+    fired++;
+    ok = ok && next_expiration_ok();
+  }
+  ok = ok && fired == left;
+  printf("expiry check: %d timers, %s\n", fired, ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
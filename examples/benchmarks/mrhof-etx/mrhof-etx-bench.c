@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \file
+ *         Native micro-benchmark of the per-packet MRHOF link metric
+ *         update: the original divide-based moving average against the
+ *         shift-based RPL_ETX_EWMA() pipeline.
+ */
+
+#include "contiki.h"
+#include "net/rpl/rpl-private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ROUNDS   2000000
+#define SAMPLES  256
+
+/* The moving average that MRHOF used before RPL_ETX_EWMA(). */
+#define OLD_ETX_SCALE   100
+#define OLD_ETX_ALPHA   90
+
+static uint16_t samples[SAMPLES];
+static volatile uint16_t sink;
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+update_old(uint16_t recorded, uint16_t packet_etx, uint16_t tx, uint16_t rank)
+{
+  uint16_t new_etx;
+  uint16_t temp;
+
+  new_etx = ((uint32_t)recorded * OLD_ETX_ALPHA +
+             (uint32_t)packet_etx * (OLD_ETX_SCALE - OLD_ETX_ALPHA)) / OLD_ETX_SCALE;
+  temp = new_etx / RPL_DAG_MC_ETX_DIVISOR;
+  temp = temp * RPL_DAG_MC_ETX_DIVISOR;
+  sink = temp;
+  sink = rank + tx * new_etx;
+  return new_etx;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+update_new(uint16_t recorded, uint16_t packet_etx, uint16_t tx, uint16_t rank)
+{
+  uint16_t new_etx;
+
+  new_etx = RPL_ETX_EWMA(recorded, packet_etx);
+  sink = RPL_ETX_FLOOR(new_etx);
+  sink = rank + tx * new_etx;
+  return new_etx;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(const char *name,
+    uint16_t (*update)(uint16_t, uint16_t, uint16_t, uint16_t))
+{
+  uint64_t start, end;
+  uint16_t etx;
+  long i;
+
+  etx = RPL_INIT_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
+  start = now_cycles();
+  for(i = 0; i < ROUNDS; i++) {
+    etx = update(etx, samples[i & (SAMPLES - 1)], 10, 512);
+  }
+  end = now_cycles();
+  printf("%-10s %6.2f %s/callback (final etx %u)\n", name,
+         (double)(end - start) / ROUNDS,
+#if defined(__i386__) || defined(__x86_64__)
+         "cycles",
+#else
+         "ns",
+#endif
+         etx);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(mrhof_etx_bench_process, "MRHOF ETX benchmark");
+AUTOSTART_PROCESSES(&mrhof_etx_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mrhof_etx_bench_process, ev, data)
+{
+  uint16_t old_etx, new_etx;
+  int i;
+
+  PROCESS_BEGIN();
+
+  /* Mostly first-try deliveries with some retransmissions and losses. */
+  srand(1);
+  for(i = 0; i < SAMPLES; i++) {
+    int r = rand() % 16;
+    samples[i] = (r < 10 ? 1 : r < 14 ? 2 : r < 15 ? 3 : 10) *
+      RPL_DAG_MC_ETX_DIVISOR;
+  }
+
+  run("divide", update_old);
+  run("shift", update_new);
+
+  /* Both averages must settle on a perfect link. */
+  old_etx = new_etx = 5 * RPL_DAG_MC_ETX_DIVISOR;
+  for(i = 0; i < 100; i++) {
+    old_etx = update_old(old_etx, RPL_DAG_MC_ETX_DIVISOR, 1, 0);
+    new_etx = update_new(new_etx, RPL_DAG_MC_ETX_DIVISOR, 1, 0);
+  }
+  printf("settled etx: divide %u, shift %u (expected %u)\n",
+         old_etx, new_etx, RPL_DAG_MC_ETX_DIVISOR);
+
+  exit(new_etx == RPL_DAG_MC_ETX_DIVISOR ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \file
+ *         Native benchmark of neighbor table lookups by link-layer
+ *         address, as a function of the number of neighbors. Also
+ *         checks lookups while neighbors are evicted and replaced.
+ */
+
+#include "contiki.h"
+#include "net/nbr-table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOOKUPS 1000000
+
+struct entry {
+  rimeaddr_t lladdr;
+};
+NBR_TABLE(struct entry, entries);
+
+static rimeaddr_t added[NBR_TABLE_MAX_NEIGHBORS];
+static volatile uintptr_t sink;
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_lladdr(rimeaddr_t *lladdr, unsigned n)
+{
+  /* EUI-64 like addresses sharing a common prefix. */
+  memset(lladdr, 0, sizeof(rimeaddr_t));
+  lladdr->u8[0] = 0x02;
+  lladdr->u8[RIMEADDR_SIZE - 2] = n >> 8;
+  lladdr->u8[RIMEADDR_SIZE - 1] = n;
+}
+/*---------------------------------------------------------------------------*/
+static struct entry *
+add(unsigned n)
+{
+  rimeaddr_t lladdr;
+  struct entry *e;
+
+  make_lladdr(&lladdr, n);
+  e = nbr_table_add_lladdr(entries, &lladdr);
+  if(e != NULL) {
+    rimeaddr_copy(&e->lladdr, &lladdr);
+  }
+  return e;
+}
+/*---------------------------------------------------------------------------*/
+static double
+measure(int count, int hit)
+{
+  rimeaddr_t misses[16];
+  uint64_t start, end;
+  long i;
+
+  for(i = 0; i < 16; i++) {
+    make_lladdr(&misses[i], 0x8000 + i);
+  }
+  start = now_cycles();
+  for(i = 0; i < LOOKUPS; i++) {
+    sink = (uintptr_t)nbr_table_get_from_lladdr(entries,
+               hit ? &added[(i * 7) % count] : &misses[i & 15]);
+  }
+  end = now_cycles();
+  return (double)(end - start) / LOOKUPS;
+}
+/*---------------------------------------------------------------------------*/
+/* Every entry is found at its own address and nothing else is found. */
+static int
+check(unsigned next)
+{
+  struct entry *e;
+  rimeaddr_t lladdr;
+  unsigned n;
+  int count;
+
+  count = 0;
+  for(e = nbr_table_head(entries); e != NULL; e = nbr_table_next(entries, e)) {
+    if(nbr_table_get_from_lladdr(entries, &e->lladdr) != e ||
+       !rimeaddr_cmp(nbr_table_get_lladdr(entries, e), &e->lladdr)) {
+      return 0;
+    }
+    count++;
+  }
+  /* Recently evicted addresses must be gone. */
+  for(n = next > 2 * NBR_TABLE_MAX_NEIGHBORS ? next - 2 * NBR_TABLE_MAX_NEIGHBORS : 1;
+      n + NBR_TABLE_MAX_NEIGHBORS < next; n++) {
+    make_lladdr(&lladdr, n);
+    if(nbr_table_get_from_lladdr(entries, &lladdr) != NULL) {
+      return 0;
+    }
+  }
+  return count == NBR_TABLE_MAX_NEIGHBORS;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(nbr_table_bench_process, "Neighbor table benchmark");
+AUTOSTART_PROCESSES(&nbr_table_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(nbr_table_bench_process, ev, data)
+{
+  unsigned n, size;
+  int ok;
+
+  PROCESS_BEGIN();
+
+  nbr_table_register(entries, NULL);
+
+  printf("nbr_table lookups, %s, %s/lookup\n",
+         NBR_TABLE_HASH ? "hash index" : "linear scan",
+#if defined(__i386__) || defined(__x86_64__)
+         "cycles"
+#else
+         "ns"
+#endif
+         );
+  printf("%10s %8s %8s\n", "neighbors", "hit", "miss");
+  n = 0;
+  for(size = 4; size <= NBR_TABLE_MAX_NEIGHBORS; size *= 2) {
+    while(n < size) {
+      n++;
+      add(n);
+      make_lladdr(&added[n - 1], n);
+    }
+    printf("%10u %8.1f %8.1f\n", size, measure(size, 1), measure(size, 0));
+  }
+
+  /* Keep adding neighbors; the oldest ones are replaced. */
+  ok = 1;
+  for(n++; n < 8 * NBR_TABLE_MAX_NEIGHBORS && ok; n++) {
+    ok = add(n) != NULL && check(n + 1);
+  }
+  printf("replacement check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native check of the packet queues used during address
+ *         resolution: several packets per neighbor come out in the
+ *         order they were queued, neighbors share the pool within
+ *         their own limit, timed out packets are dropped, and the
+ *         counters add up.
+ */
+
+#include "contiki.h"
+#include "net/uip.h"
+#include "net/uip-packetqueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NBRS     3
+#define LIFETIME (CLOCK_SECOND / 10)
+
+static struct uip_packetqueue_handle queues[NBRS];
+static uint8_t next_seqno[NBRS];
+static int ok = 1;
+/*---------------------------------------------------------------------------*/
+static void
+check(int cond, const char *what)
+{
+  if(!cond) {
+    printf("FAILED: %s\n", what);
+    ok = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Put a packet for neighbor n in uip_buf and queue it. */
+static int
+push(int n, uint8_t seqno)
+{
+  uip_len = 40 + seqno;
+  memset(&uip_buf[UIP_LLH_LEN], seqno, uip_len);
+  uip_buf[UIP_LLH_LEN] = n;
+  return uip_packetqueue_push(&queues[n], LIFETIME);
+}
+/*---------------------------------------------------------------------------*/
+/* Send everything queued for neighbor n, checking the order. */
+static int
+drain(int n)
+{
+  int count;
+  uint8_t seqno;
+
+  count = 0;
+  while(uip_packetqueue_pop(&queues[n])) {
+    seqno = uip_buf[UIP_LLH_LEN + 1];
+    check(uip_buf[UIP_LLH_LEN] == n, "packet of another neighbor");
+    check(seqno == next_seqno[n], "packets out of order");
+    check(uip_len == 40 + seqno, "wrong length");
+    next_seqno[n] = seqno + 1;
+    count++;
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(nd6_queue_bench_process, "ND6 queue benchmark");
+AUTOSTART_PROCESSES(&nd6_queue_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(nd6_queue_bench_process, ev, data)
+{
+  static struct etimer et;
+  int i, n, queued;
+
+  PROCESS_BEGIN();
+
+  for(n = 0; n < NBRS; n++) {
+    uip_packetqueue_new(&queues[n]);
+  }
+
+  /* A burst for one neighbor is limited by the per neighbor limit. */
+  queued = 0;
+  for(i = 0; i < 10; i++) {
+    queued += push(0, i);
+  }
+  check(queued == UIP_PACKETQUEUE_MAX_PER_NBR, "per neighbor limit");
+  check(uip_packetqueue_len(&queues[0]) == queued, "queue length");
+
+  /* The others share what is left of the pool. */
+  queued = 0;
+  for(i = 0; i < 10; i++) {
+    queued += push(1 + i % 2, i / 2);
+  }
+  check(queued == UIP_PACKETQUEUE_NUM - UIP_PACKETQUEUE_MAX_PER_NBR,
+        "shared pool");
+
+  check(drain(0) == UIP_PACKETQUEUE_MAX_PER_NBR, "drain neighbor 0");
+  check(drain(1) + drain(2) == queued, "drain neighbors 1 and 2");
+  check(drain(0) == 0, "queue empty after drain");
+
+  /* Timed out packets are dropped, also to make room for others. */
+  next_seqno[1] = 0;
+  for(i = 0; i < UIP_PACKETQUEUE_MAX_PER_NBR; i++) {
+    push(1, i);
+  }
+  etimer_set(&et, LIFETIME + 1);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  next_seqno[0] = 0;
+  queued = 0;
+  for(i = 0; i < UIP_PACKETQUEUE_NUM; i++) {
+    queued += push(0, i);
+  }
+  check(queued == UIP_PACKETQUEUE_MAX_PER_NBR, "pool reclaimed");
+  check(drain(1) == 0, "timed out packets dropped");
+  check(drain(0) == queued, "packets after aging");
+
+  /* Removing a neighbor drops its queue. */
+  push(2, 0);
+  push(2, 1);
+  uip_packetqueue_free(&queues[2]);
+  check(uip_packetqueue_len(&queues[2]) == 0, "free");
+
+  printf("queued %u dropped %u flushed %u\n",
+         uip_stat.nd6.queued, uip_stat.nd6.queue_drop, uip_stat.nd6.flushed);
+  check(uip_stat.nd6.queued ==
+        uip_stat.nd6.flushed + UIP_PACKETQUEUE_MAX_PER_NBR + 2,
+        "queued packets are either flushed or dropped");
+  printf("nd6 queue check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
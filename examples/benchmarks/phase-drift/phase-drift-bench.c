@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native check of the phase lock with a drifting neighbor. The
+ *         neighbor wakes up every CYCLE + 1 rtimer ticks while we
+ *         expect CYCLE. A packet is sent to it about once a second,
+ *         and the time from the start of the strobe to the next
+ *         wake-up of the neighbor is the strobe length. With the
+ *         drift fitted over several wake-ups, the strobes must stay
+ *         short. One in ten may be late, for the host can stall
+ *         the process past a wake-up. The drift must also have been
+ *         saved to CFS.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "lib/random.h"
+#include "net/mac/mac.h"
+#include "net/mac/phase.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/rime/rimeaddr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CYCLE        125
+#define PERIOD       (CYCLE + 1)
+#define GUARD        4
+#define ROUNDS       30
+#define WARMUP       4
+
+static rimeaddr_t neighbor;
+static unsigned long first_wakeup;
+static unsigned long strobe_sum;
+static int strobes;
+static int tight;
+static int misses;
+static int sent;
+/*---------------------------------------------------------------------------*/
+/* The first wake-up of the neighbor at or after t */
+static unsigned long
+next_wakeup(unsigned long t)
+{
+  if(t <= first_wakeup) {
+    return first_wakeup;
+  }
+  return first_wakeup + (t - first_wakeup + PERIOD - 1) / PERIOD * PERIOD;
+}
+/*---------------------------------------------------------------------------*/
+/* An RDC driver that waits for the phase of the receiver like
+   ContikiMAC does, and then measures the strobe it would need. */
+static void
+strobe_send(mac_callback_t sent_callback, void *ptr)
+{
+  unsigned long now, wakeup;
+
+  if(phase_wait(&neighbor, CYCLE, GUARD, sent_callback, ptr, NULL) ==
+     PHASE_DEFERRED) {
+    return;
+  }
+  now = clock_time();
+  wakeup = next_wakeup(now);
+  if(sent >= WARMUP) {
+    strobe_sum += wakeup - now;
+    if(wakeup - now <= 2 * GUARD) {
+      tight++;
+    }
+    if(wakeup - now > CYCLE / 2) {
+      /* The neighbor had just gone back to sleep */
+      misses++;
+    }
+    strobes++;
+  }
+  sent++;
+  phase_update(&neighbor, (rtimer_clock_t)wakeup, MAC_TX_OK);
+  mac_call_sent_callback(sent_callback, ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+strobe_send_list(mac_callback_t sent_callback, void *ptr,
+                 struct rdc_buf_list *list)
+{
+  if(list != NULL) {
+    queuebuf_to_packetbuf(list->buf);
+    strobe_send(sent_callback, ptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+strobe_input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static int
+strobe_on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+strobe_off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+strobe_channel_check_interval(void)
+{
+  return CYCLE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+strobe_init(void)
+{
+  phase_init();
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver strobe_rdc_driver = {
+  "strobe",
+  strobe_init,
+  strobe_send,
+  strobe_send_list,
+  strobe_input,
+  strobe_on,
+  strobe_off,
+  strobe_channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+static void
+packet_done(void *ptr, int status, int num_tx)
+{
+}
+/*---------------------------------------------------------------------------*/
+/* The drift saved for the neighbor, or 0 */
+static int32_t
+saved_drift(void)
+{
+  rimeaddr_t addr;
+  int32_t drift;
+  int fd;
+
+  fd = cfs_open("phase", CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  while(cfs_read(fd, &addr, sizeof(addr)) == sizeof(addr) &&
+        cfs_read(fd, &drift, sizeof(drift)) == sizeof(drift)) {
+    if(rimeaddr_cmp(&addr, &neighbor)) {
+      cfs_close(fd);
+      return drift;
+    }
+  }
+  cfs_close(fd);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(phase_bench_process, "Phase drift benchmark");
+AUTOSTART_PROCESSES(&phase_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(phase_bench_process, ev, data)
+{
+  static struct etimer et;
+  static int i;
+  int32_t drift;
+  int ok;
+
+  PROCESS_BEGIN();
+
+  memset(&neighbor, 0, sizeof(neighbor));
+  neighbor.u8[0] = 9;
+  first_wakeup = clock_time() + 10;
+  cfs_remove("phase");
+
+  /* The first packet reaches the neighbor at its first wake-up. */
+  phase_update(&neighbor, (rtimer_clock_t)first_wakeup, MAC_TX_OK);
+
+  for(i = 0; i < ROUNDS; i++) {
+    etimer_set(&et, CLOCK_SECOND / 2 + random_rand() % CLOCK_SECOND);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    packetbuf_clear();
+    packetbuf_set_datalen(10);
+    packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &neighbor);
+    NETSTACK_RDC.send(packet_done, NULL);
+  }
+  /* Let the last deferred packet go out. */
+  etimer_set(&et, CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+  drift = saved_drift();
+  printf("%d samples per neighbor: %d strobes, average %lu ticks, "
+         "%d within twice the guard, %d missed wake-ups "
+         "(guard %d, cycle %d)\n",
+         PHASE_CONF_SAMPLES, strobes, strobes ? strobe_sum / strobes : 0,
+         tight, misses, GUARD, CYCLE);
+  printf("saved drift %ld / 65536 (true %ld / 65536)\n",
+         (long)drift, (long)(65536L / CYCLE));
+
+  ok = strobes == ROUNDS - WARMUP && tight >= strobes - strobes / 10 &&
+    drift > 65536L / CYCLE / 2 && drift < 2 * 65536L / CYCLE;
+  printf("phase drift check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
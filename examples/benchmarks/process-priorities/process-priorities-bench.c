@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \file
+ *         Native benchmark of the delay that a backlog of application
+ *         events imposes on a high priority process, counted in events
+ *         dispatched between posting an event and handling it, and of
+ *         the poll queue.
+ */
+
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROUNDS      1000
+#define BACKLOG     (PROCESS_CONF_NUMEVENTS - 4)
+#define POLLERS     4
+
+static unsigned long dispatched;
+static unsigned long posted_at;
+static unsigned long total_delay, max_delay;
+static unsigned rounds, polls;
+
+PROCESS(flood_process, "Flood");
+PROCESS(urgent_process, "Urgent");
+PROCESS(poller_process0, "Poller 0");
+PROCESS(poller_process1, "Poller 1");
+PROCESS(poller_process2, "Poller 2");
+PROCESS(poller_process3, "Poller 3");
+PROCESS(process_priorities_bench_process, "Process priority benchmark");
+AUTOSTART_PROCESSES(&process_priorities_bench_process);
+
+static struct process *pollers[POLLERS] = {
+  &poller_process0, &poller_process1, &poller_process2, &poller_process3
+};
+/*---------------------------------------------------------------------------*/
+/* Handles its own events, keeping about BACKLOG of them queued. Every
+   few events it posts to the urgent process and polls the pollers. */
+PROCESS_THREAD(flood_process, ev, data)
+{
+  static int i;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < BACKLOG; i++) {
+    process_post(PROCESS_CURRENT(), PROCESS_EVENT_CONTINUE, NULL);
+  }
+  while(rounds < ROUNDS) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_CONTINUE);
+    dispatched++;
+    if(dispatched % 8 == 0 && posted_at == 0) {
+      posted_at = dispatched;
+      process_post(&urgent_process, PROCESS_EVENT_MSG, NULL);
+      for(i = 0; i < POLLERS; i++) {
+        process_poll(pollers[i]);
+      }
+    }
+    process_post(PROCESS_CURRENT(), PROCESS_EVENT_CONTINUE, NULL);
+  }
+  process_post(&process_priorities_bench_process, PROCESS_EVENT_CONTINUE, NULL);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(urgent_process, ev, data)
+{
+  unsigned long delay;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_MSG);
+    delay = dispatched - posted_at;
+    total_delay += delay;
+    if(delay > max_delay) {
+      max_delay = delay;
+    }
+    posted_at = 0;
+    rounds++;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+#define POLLER(n)                                       \
+  PROCESS_THREAD(poller_process##n, ev, data)           \
+  {                                                     \
+    PROCESS_BEGIN();                                    \
+    while(1) {                                          \
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL); \
+      polls++;                                          \
+    }                                                   \
+    PROCESS_END();                                      \
+  }
+POLLER(0)
+POLLER(1)
+POLLER(2)
+POLLER(3)
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(process_priorities_bench_process, ev, data)
+{
+  int i;
+
+  PROCESS_BEGIN();
+
+  process_set_priority(&urgent_process, PROCESS_PRIORITY_HIGH);
+  process_start(&urgent_process, NULL);
+  for(i = 0; i < POLLERS; i++) {
+    process_start(pollers[i], NULL);
+  }
+  process_start(&flood_process, NULL);
+
+  PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_CONTINUE);
+
+  printf("%s, backlog %d events\n",
+         PROCESS_CONF_PRIORITIES ? "priority classes" : "single FIFO",
+         BACKLOG);
+  printf("urgent event delay: mean %lu.%02lu max %lu events\n",
+         total_delay / rounds, total_delay * 100 / rounds % 100, max_delay);
+  printf("polls handled: %u of %u\n", polls, rounds * POLLERS);
+  printf("queue high-water mark: %u", process_maxevents);
+#if PROCESS_CONF_PRIORITIES
+  printf(" (high %u normal %u low %u), polls %u",
+         process_maxevents_class[PROCESS_PRIORITY_HIGH],
+         process_maxevents_class[PROCESS_PRIORITY_NORMAL],
+         process_maxevents_class[PROCESS_PRIORITY_LOW],
+         process_maxpolls);
+#endif /* PROCESS_CONF_PRIORITIES */
+  printf("\n");
+
+  exit(polls == rounds * POLLERS &&
+       (!PROCESS_CONF_PRIORITIES || max_delay == 0) ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native benchmark of the transmission of a queued packet, as
+ *         done by the RDC layer on every retransmission: move the
+ *         queuebuf to the packetbuf, add a MAC header, and hand the
+ *         frame to the radio. Then checks that the queued packet is
+ *         never modified by this, and that a queuebuf freed while the
+ *         packetbuf is attached to it stays readable and is reclaimed.
+ */
+
+#include "contiki.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS     100000
+#define MAC_HDRLEN 21
+
+static uint8_t payload[PACKETBUF_SIZE];
+static uint8_t radio[PACKETBUF_SIZE + PACKETBUF_HDR_SIZE];
+static volatile int sink;
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+static struct queuebuf *
+queue_packet(int len)
+{
+  packetbuf_copyfrom(payload, len);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, len);
+  return queuebuf_new_from_packetbuf();
+}
+/*---------------------------------------------------------------------------*/
+/* What an RDC layer does to transmit a queued packet once. */
+static void
+transmit(struct queuebuf *q, int nocopy)
+{
+  if(nocopy) {
+    queuebuf_to_packetbuf_nocopy(q);
+  } else {
+    queuebuf_to_packetbuf(q);
+  }
+  packetbuf_hdralloc(MAC_HDRLEN);
+  memset(packetbuf_hdrptr(), 0xa5, MAC_HDRLEN);
+  packetbuf_compact();
+  memcpy(radio, packetbuf_hdrptr(), packetbuf_totlen());
+  sink = packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
+  packetbuf_hdr_remove(MAC_HDRLEN);
+}
+/*---------------------------------------------------------------------------*/
+static int
+frame_ok(int len)
+{
+  int i;
+
+  for(i = 0; i < MAC_HDRLEN; i++) {
+    if(radio[i] != 0xa5) {
+      return 0;
+    }
+  }
+  return memcmp(radio + MAC_HDRLEN, payload, len) == 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(queuebuf_bench_process, "Queuebuf benchmark");
+AUTOSTART_PROCESSES(&queuebuf_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(queuebuf_bench_process, ev, data)
+{
+  static struct queuebuf *q[QUEUEBUF_NUM];
+  struct queuebuf *held;
+  uint64_t start, copy_cost, nocopy_cost;
+  int i, len, ok;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < sizeof(payload); i++) {
+    payload[i] = i * 7 + 3;
+  }
+
+  printf("queuebuf, zero copy %s, %s/transmission\n",
+         QUEUEBUF_ZERO_COPY ? "on" : "off",
+#if defined(__i386__) || defined(__x86_64__)
+         "cycles"
+#else
+         "ns"
+#endif
+         );
+  printf("%8s %8s %8s\n", "bytes", "copy", "nocopy");
+  ok = 1;
+  for(len = 20; len <= PACKETBUF_SIZE - MAC_HDRLEN; len += 40) {
+    held = queue_packet(len);
+    start = now_cycles();
+    for(i = 0; i < ROUNDS; i++) {
+      transmit(held, 0);
+    }
+    copy_cost = now_cycles() - start;
+    ok = ok && frame_ok(len);
+    start = now_cycles();
+    for(i = 0; i < ROUNDS; i++) {
+      transmit(held, 1);
+    }
+    nocopy_cost = now_cycles() - start;
+    ok = ok && frame_ok(len);
+    ok = ok && memcmp(queuebuf_dataptr(held), payload, len) == 0;
+    packetbuf_clear();
+    queuebuf_free(held);
+    printf("%8d %8.1f %8.1f\n", len, (double)copy_cost / ROUNDS,
+           (double)nocopy_cost / ROUNDS);
+  }
+
+  /* Free a queuebuf while transmitting from it, as the MAC layer does
+     from its sent callback. The packet must stay in the packetbuf. */
+  len = 80;
+  held = queue_packet(len);
+  transmit(held, 1);
+  queuebuf_to_packetbuf_nocopy(held);
+  queuebuf_free(held);
+  ok = ok && memcmp(packetbuf_dataptr(), payload, len) == 0 &&
+    packetbuf_datalen() == len;
+
+  /* All queuebufs must still be available, and allocating them must
+     not disturb the packet in the packetbuf. */
+  for(i = 0; i < QUEUEBUF_NUM; i++) {
+    q[i] = queuebuf_new_from_packetbuf();
+    ok = ok && q[i] != NULL;
+  }
+  ok = ok && memcmp(packetbuf_dataptr(), payload, len) == 0;
+  for(i = 0; i < QUEUEBUF_NUM; i++) {
+    if(q[i] != NULL) {
+      ok = ok && memcmp(queuebuf_dataptr(q[i]), payload, len) == 0;
+      queuebuf_free(q[i]);
+    }
+  }
+  packetbuf_clear();
+  printf("lending check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
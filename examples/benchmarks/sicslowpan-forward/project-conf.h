@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+#ifndef __PROJECT_CONF_H__
+#define __PROJECT_CONF_H__
+
+#undef SICSLOWPAN_CONF_STATS
+#define SICSLOWPAN_CONF_STATS 1
+
+#ifndef SICSLOWPAN_CONF_FRAG_FORWARD
+#define SICSLOWPAN_CONF_FRAG_FORWARD 1
+#endif /* SICSLOWPAN_CONF_FRAG_FORWARD */
+
+#if SICSLOWPAN_CONF_FRAG_FORWARD
+/* Forwarded packets must not need a reassembly context, so the one
+   that most platforms have is enough. */
+#undef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_CONF_REASS_CONTEXTS 1
+#endif /* SICSLOWPAN_CONF_FRAG_FORWARD */
+
+/* Capture the forwarded frames instead of sending them. */
+#undef NETSTACK_CONF_MAC
+#define NETSTACK_CONF_MAC capture_mac_driver
+
+#endif /* __PROJECT_CONF_H__ */
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native check of 6LoWPAN fragment forwarding. Two senders
+ *         send fragmented packets through this node at the same
+ *         time. With fragment forwarding, every fragment must leave
+ *         as soon as it has arrived, without taking a reassembly
+ *         buffer, so that a packet for this node that is being
+ *         reassembled meanwhile still gets through. The frames sent
+ *         are then fed back to this node, which must get every packet
+ *         intact, one hop older.
+ */
+
+#include "contiki.h"
+#include "net/mac/mac.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/rime.h"
+#include "net/sicslowpan.h"
+#include "net/uip.h"
+#include "net/uip-ds6.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SENDERS     2
+#define ROUNDS      20
+#define PACKET_LEN  (UIP_IPH_LEN + 360)
+#define FRAG_DATA   48
+#define FRAGS       (1 + (PACKET_LEN - UIP_IPH_LEN - 1) / FRAG_DATA)
+#define MAX_FRAMES  (2 * SENDERS * ROUNDS * FRAGS)
+/* The packet for this node that comes in with the forwarded ones */
+#define LOCAL       SENDERS
+
+#define UIP_IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+static uint8_t packets[SENDERS + 1][PACKET_LEN];
+static int delivered[SENDERS + 1];
+static int corrupt;
+static int checking;
+
+static uint8_t frames[MAX_FRAMES][PACKETBUF_SIZE];
+static uint8_t frame_len[MAX_FRAMES];
+static int frame_count;
+static rimeaddr_t frame_dest;
+static int frame_dest_error;
+/*---------------------------------------------------------------------------*/
+/* A MAC driver that keeps what it is given to send. */
+static void
+capture_send(mac_callback_t sent, void *ptr)
+{
+  if(frame_count < MAX_FRAMES) {
+    frame_len[frame_count] = packetbuf_datalen();
+    memcpy(frames[frame_count], packetbuf_dataptr(), packetbuf_datalen());
+    frame_count++;
+  }
+  if(!rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &frame_dest)) {
+    frame_dest_error++;
+  }
+  mac_call_sent_callback(sent, ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+capture_input(void)
+{
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+static int
+capture_on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+capture_off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+capture_channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+capture_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+const struct mac_driver capture_mac_driver = {
+  "capture",
+  capture_init,
+  capture_send,
+  capture_input,
+  capture_on,
+  capture_off,
+  capture_channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+static void
+sniff_input(void)
+{
+  int n;
+
+  n = UIP_IP_BUF->srcipaddr.u8[15] - 1;
+  if(n == LOCAL && uip_len == PACKET_LEN &&
+     memcmp(UIP_IP_BUF, packets[n], PACKET_LEN) == 0) {
+    delivered[n]++;
+    uip_len = 0;
+    return;
+  }
+  if(!checking) {
+    return;
+  }
+  if(n < 0 || n >= SENDERS || uip_len != PACKET_LEN) {
+    corrupt++;
+    return;
+  }
+  /* Only the hop limit may have changed on the way. */
+  UIP_IP_BUF->ttl++;
+  if(memcmp(UIP_IP_BUF, packets[n], PACKET_LEN) != 0) {
+    corrupt++;
+    return;
+  }
+  delivered[n]++;
+  /* Keep the IP stack from answering. */
+  uip_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniff_output(int mac_status)
+{
+  /* 6LoWPAN calls this for every frame sent. */
+}
+RIME_SNIFFER(sniffer, sniff_input, sniff_output);
+/*---------------------------------------------------------------------------*/
+static void
+make_packet(int n)
+{
+  struct uip_ip_hdr *ip;
+  struct uip_udp_hdr *udp;
+  int i;
+
+  ip = (struct uip_ip_hdr *)packets[n];
+  memset(ip, 0, UIP_IPH_LEN);
+  ip->vtc = 0x60;
+  ip->len[0] = (PACKET_LEN - UIP_IPH_LEN) >> 8;
+  ip->len[1] = (PACKET_LEN - UIP_IPH_LEN) & 0xff;
+  ip->proto = UIP_PROTO_UDP;
+  ip->ttl = 64;
+  uip_ip6addr(&ip->srcipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, n + 1);
+  uip_ip6addr(&ip->destipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0,
+              n == LOCAL ? 0x01 : 0x99);
+  for(i = UIP_IPH_LEN; i < PACKET_LEN; i++) {
+    packets[n][i] = n * 31 + i;
+  }
+  /* The UDP length is elided when the header is compressed. */
+  udp = (struct uip_udp_hdr *)&packets[n][UIP_IPH_LEN];
+  udp->udplen = UIP_HTONS(PACKET_LEN - UIP_IPH_LEN);
+}
+/*---------------------------------------------------------------------------*/
+static void
+input_frame(const uint8_t *frame, int len, const rimeaddr_t *sender)
+{
+  packetbuf_clear();
+  packetbuf_copyfrom(frame, len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, sender);
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+/* Feed fragment number frag of sender n's packet to 6LoWPAN. */
+static void
+input_fragment(int n, int frag, uint16_t tag)
+{
+  uint8_t frame[128];
+  rimeaddr_t sender;
+  int offset, len, hdr;
+
+  if(frag == 0) {
+    /* FRAG1 with an uncompressed IPv6 header */
+    frame[0] = SICSLOWPAN_DISPATCH_FRAG1 | (PACKET_LEN >> 8);
+    frame[4] = SICSLOWPAN_DISPATCH_IPV6;
+    hdr = 5;
+    offset = 0;
+    len = UIP_IPH_LEN + FRAG_DATA;
+  } else {
+    frame[0] = SICSLOWPAN_DISPATCH_FRAGN | (PACKET_LEN >> 8);
+    offset = UIP_IPH_LEN + frag * FRAG_DATA;
+    frame[4] = offset >> 3;
+    hdr = 5;
+    len = FRAG_DATA;
+  }
+  frame[1] = PACKET_LEN & 0xff;
+  frame[2] = tag >> 8;
+  frame[3] = tag & 0xff;
+  if(offset + len > PACKET_LEN) {
+    len = PACKET_LEN - offset;
+  }
+  memcpy(frame + hdr, packets[n] + offset, len);
+
+  memset(&sender, 0, sizeof(sender));
+  sender.u8[0] = n + 1;
+  input_frame(frame, hdr + len, &sender);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(forward_bench_process, "6LoWPAN fragment forwarding benchmark");
+AUTOSTART_PROCESSES(&forward_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(forward_bench_process, ev, data)
+{
+  static uip_ipaddr_t nexthop, dest, local;
+  uip_lladdr_t lladdr;
+  int i, j, n, frag, total, early, round_start, forwarded, ok;
+
+  PROCESS_BEGIN();
+
+  for(n = 0; n <= LOCAL; n++) {
+    make_packet(n);
+  }
+  rime_sniffer_add(&sniffer);
+
+  /* aaaa::99 is reached through the neighbor fe80::2. */
+  memset(&lladdr, 0, sizeof(lladdr));
+  lladdr.addr[0] = 0x02;
+  lladdr.addr[sizeof(lladdr) - 1] = 0x02;
+  memcpy(&frame_dest, &lladdr, sizeof(frame_dest));
+  uip_ip6addr(&nexthop, 0xfe80, 0, 0, 0, 0, 0, 0, 2);
+  uip_ip6addr(&dest, 0xaaaa, 0, 0, 0, 0, 0, 0, 0x99);
+  uip_ds6_nbr_add(&nexthop, &lladdr, 0, NBR_REACHABLE);
+  uip_ds6_route_add(&dest, 128, &nexthop);
+  uip_ip6addr(&local, 0xaaaa, 0, 0, 0, 0, 0, 0, 0x01);
+  uip_ds6_addr_add(&local, 0, ADDR_MANUAL);
+
+  /* A packet for this node is being reassembled all along. */
+  input_fragment(LOCAL, 0, ROUNDS);
+  early = 0;
+  for(i = 0; i < ROUNDS; i++) {
+    round_start = frame_count;
+    /* Both senders send at once, one fragment each in turn. */
+    for(frag = 0; frag < FRAGS; frag++) {
+      if(frag == FRAGS - 1) {
+        /* Frames that left before any packet of the round was whole */
+        early += frame_count - round_start;
+      }
+      for(n = 0; n < SENDERS; n++) {
+        input_fragment(n, frag, i);
+      }
+    }
+  }
+  for(frag = 1; frag < FRAGS; frag++) {
+    input_fragment(LOCAL, frag, ROUNDS);
+  }
+  forwarded = frame_count;
+
+  printf("fragment forwarding %s: %d frames sent, %d of them before "
+         "any packet was complete\n",
+         SICSLOWPAN_CONF_FRAG_FORWARD ? "on" : "off", forwarded, early);
+  printf("fragments in %u, forwarded %u, reassembled %u, out %u\n",
+         sicslowpan_stats.frags_in, sicslowpan_stats.frags_forwarded,
+         sicslowpan_stats.reassembled, sicslowpan_stats.frags_out);
+  printf("packet for this node %s, %d reassembly context(s)\n",
+         delivered[LOCAL] ? "delivered" : "lost", SICSLOWPAN_REASS_CONTEXTS);
+
+  /* Now be the next hop, and take in everything that was sent, one
+     packet after the other. */
+  checking = 1;
+  uip_ds6_addr_add(&dest, 0, ADDR_MANUAL);
+  for(i = 0; i < forwarded; i++) {
+    if((frames[i][0] & 0xf8) != SICSLOWPAN_DISPATCH_FRAG1) {
+      continue;
+    }
+    for(j = i; j < forwarded; j++) {
+      if(frames[j][2] == frames[i][2] && frames[j][3] == frames[i][3]) {
+        input_frame(frames[j], frame_len[j], &frame_dest);
+      }
+    }
+  }
+
+  total = 0;
+  for(n = 0; n < SENDERS; n++) {
+    total += delivered[n];
+  }
+  printf("%d of %d packets delivered at the next hop\n",
+         total, SENDERS * ROUNDS);
+
+  ok = corrupt == 0 && frame_dest_error == 0 && total == SENDERS * ROUNDS;
+  if(SICSLOWPAN_CONF_FRAG_FORWARD) {
+    ok = ok && early > 0 && sicslowpan_stats.frags_forwarded == forwarded &&
+      delivered[LOCAL] == 1;
+  }
+  printf("forwarding check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native check of 6LoWPAN reassembly when several senders
+ *         send fragmented packets at the same time. The fragments of
+ *         all senders are interleaved, and every packet must be
+ *         delivered intact as long as there are enough reassembly
+ *         contexts.
+ */
+
+#include "contiki.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/rime.h"
+#include "net/sicslowpan.h"
+#include "net/uip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SENDERS     4
+#define ROUNDS      50
+#define PACKET_LEN  (UIP_IPH_LEN + 360)
+#define FRAG_DATA   80
+
+#define UIP_IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+static uint8_t packets[SENDERS][PACKET_LEN];
+static int delivered[SENDERS];
+static int corrupt;
+/*---------------------------------------------------------------------------*/
+static void
+sniff_input(void)
+{
+  int n;
+
+  n = UIP_IP_BUF->srcipaddr.u8[15];
+  if(n >= SENDERS || uip_len != PACKET_LEN ||
+     memcmp(UIP_IP_BUF, packets[n], PACKET_LEN) != 0) {
+    corrupt++;
+    return;
+  }
+  delivered[n]++;
+  /* Keep the IP stack from answering. */
+  uip_len = 0;
+}
+RIME_SNIFFER(sniffer, sniff_input, NULL);
+/*---------------------------------------------------------------------------*/
+static void
+make_packet(int n)
+{
+  struct uip_ip_hdr *ip;
+  int i;
+
+  ip = (struct uip_ip_hdr *)packets[n];
+  memset(ip, 0, UIP_IPH_LEN);
+  ip->vtc = 0x60;
+  ip->len[0] = (PACKET_LEN - UIP_IPH_LEN) >> 8;
+  ip->len[1] = (PACKET_LEN - UIP_IPH_LEN) & 0xff;
+  ip->proto = UIP_PROTO_UDP;
+  ip->ttl = 64;
+  uip_ip6addr(&ip->srcipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, n);
+  uip_ip6addr(&ip->destipaddr, 0xff02, 0, 0, 0, 0, 0, 0, 0x1a);
+  for(i = UIP_IPH_LEN; i < PACKET_LEN; i++) {
+    packets[n][i] = n * 31 + i;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Feed fragment number frag of sender n's packet to 6LoWPAN. */
+static void
+input_fragment(int n, int frag, uint16_t tag)
+{
+  uint8_t frame[128];
+  rimeaddr_t sender;
+  int offset, len, hdr;
+
+  if(frag == 0) {
+    /* FRAG1 with an uncompressed IPv6 header */
+    frame[0] = SICSLOWPAN_DISPATCH_FRAG1 | (PACKET_LEN >> 8);
+    frame[4] = SICSLOWPAN_DISPATCH_IPV6;
+    hdr = 5;
+    offset = 0;
+    len = UIP_IPH_LEN + FRAG_DATA;
+  } else {
+    frame[0] = SICSLOWPAN_DISPATCH_FRAGN | (PACKET_LEN >> 8);
+    offset = UIP_IPH_LEN + frag * FRAG_DATA;
+    frame[4] = offset >> 3;
+    hdr = 5;
+    len = FRAG_DATA;
+  }
+  frame[1] = PACKET_LEN & 0xff;
+  frame[2] = tag >> 8;
+  frame[3] = tag & 0xff;
+  if(offset + len > PACKET_LEN) {
+    len = PACKET_LEN - offset;
+  }
+  memcpy(frame + hdr, packets[n] + offset, len);
+
+  memset(&sender, 0, sizeof(sender));
+  sender.u8[0] = n + 1;
+  packetbuf_clear();
+  packetbuf_copyfrom(frame, hdr + len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &sender);
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(reass_bench_process, "6LoWPAN reassembly benchmark");
+AUTOSTART_PROCESSES(&reass_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(reass_bench_process, ev, data)
+{
+  int i, n, frag, frags, total, ok;
+
+  PROCESS_BEGIN();
+
+  for(n = 0; n < SENDERS; n++) {
+    make_packet(n);
+  }
+  rime_sniffer_add(&sniffer);
+
+  frags = 1 + (PACKET_LEN - UIP_IPH_LEN - 1) / FRAG_DATA;
+  for(i = 0; i < ROUNDS; i++) {
+    /* All senders send at once, one fragment each in turn. */
+    for(frag = 0; frag < frags; frag++) {
+      for(n = 0; n < SENDERS; n++) {
+        input_fragment(n, frag, i);
+      }
+    }
+  }
+
+  total = 0;
+  for(n = 0; n < SENDERS; n++) {
+    total += delivered[n];
+  }
+  printf("%d senders, %d reassembly contexts: %d of %d packets delivered\n",
+         SENDERS, SICSLOWPAN_REASS_CONTEXTS, total, SENDERS * ROUNDS);
+  printf("fragments in %u dropped %u, reassembled %u, timed out %u, given up %u\n",
+         sicslowpan_stats.frags_in, sicslowpan_stats.frags_dropped,
+         sicslowpan_stats.reassembled, sicslowpan_stats.reass_timeout,
+         sicslowpan_stats.reass_dropped);
+
+  ok = corrupt == 0 && sicslowpan_stats.reassembled == total;
+  if(SICSLOWPAN_REASS_CONTEXTS >= SENDERS) {
+    ok = ok && total == SENDERS * ROUNDS;
+  }
+  printf("reassembly check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Native benchmark of the SLIP codec shared by tunslip6 and the
+ *         native border router, against the byte at a time loops it
+ *         replaced. Packets with many SLIP_END and SLIP_ESC bytes are
+ *         encoded back to back and decoded from chunks of random size,
+ *         as read() returns them, and must come out unchanged.
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "slip-codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PACKETS    64
+#define MAX_LEN    1280
+#define ROUNDS     200
+
+static unsigned char packets[PACKETS][MAX_LEN];
+static int lengths[PACKETS];
+static unsigned char stream[PACKETS * SLIP_ENCODED_MAX(MAX_LEN)];
+static int stream_len;
+static unsigned char frame[MAX_LEN];
+static int received;
+static int errors;
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_frame(const unsigned char *buf, int len)
+{
+  int n;
+
+  n = received++ % PACKETS;
+  if(len != lengths[n] || memcmp(buf, packets[n], len) != 0) {
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The encoder loop that tunslip6 used before. */
+static int
+encode_bytewise(unsigned char *out, const unsigned char *p, int len)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < len; i++) {
+    switch(p[i]) {
+    case SLIP_END:
+      out[n++] = SLIP_ESC;
+      out[n++] = SLIP_ESC_END;
+      break;
+    case SLIP_ESC:
+      out[n++] = SLIP_ESC;
+      out[n++] = SLIP_ESC_ESC;
+      break;
+    default:
+      out[n++] = p[i];
+      break;
+    }
+  }
+  out[n++] = SLIP_END;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+/* The decoder loop that tunslip6 used before, without the stdio. */
+static void
+decode_bytewise(const unsigned char *data, int len)
+{
+  static int inbufptr, esc;
+  unsigned char c;
+  int i;
+
+  for(i = 0; i < len; i++) {
+    c = data[i];
+    if(esc) {
+      esc = 0;
+      if(c == SLIP_ESC_END) {
+        c = SLIP_END;
+      } else if(c == SLIP_ESC_ESC) {
+        c = SLIP_ESC;
+      }
+    } else if(c == SLIP_ESC) {
+      esc = 1;
+      continue;
+    } else if(c == SLIP_END) {
+      if(inbufptr > 0) {
+        check_frame(frame, inbufptr);
+        inbufptr = 0;
+      }
+      continue;
+    }
+    if(inbufptr < sizeof(frame)) {
+      frame[inbufptr++] = c;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+decode_codec(const unsigned char *data, int len)
+{
+  static struct slip_decoder decoder;
+  int used;
+
+  if(decoder.buf == NULL) {
+    slip_decoder_init(&decoder, frame, sizeof(frame));
+  }
+  while(len > 0) {
+    used = slip_decode(&decoder, data, len);
+    if(decoder.frame_len > 0) {
+      check_frame(frame, decoder.frame_len);
+    } else if(decoder.frame_len == SLIP_FRAME_DROPPED) {
+      errors++;
+    }
+    data += used;
+    len -= used;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+encode_all(int codec)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < PACKETS; i++) {
+    if(codec) {
+      n += slip_encode(stream + n, packets[i], lengths[i]);
+    } else {
+      n += encode_bytewise(stream + n, packets[i], lengths[i]);
+    }
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+decode_all(int codec)
+{
+  int i, chunk;
+
+  random_init(1);
+  for(i = 0; i < stream_len; i += chunk) {
+    /* Serial reads return anything from one byte to a full buffer. */
+    chunk = 1 + random_rand() % 512;
+    if(chunk > stream_len - i) {
+      chunk = stream_len - i;
+    }
+    if(codec) {
+      decode_codec(stream + i, chunk);
+    } else {
+      decode_bytewise(stream + i, chunk);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(slip_bench_process, "SLIP benchmark");
+AUTOSTART_PROCESSES(&slip_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(slip_bench_process, ev, data)
+{
+  uint64_t start, cost[2][2];
+  int i, j, codec, ok;
+
+  PROCESS_BEGIN();
+
+  /* One byte in 16 needs escaping, like compressed IPv6 headers and
+     payload bytes that happen to be 0xc0 or 0xdb. */
+  random_init(0);
+  for(i = 0; i < PACKETS; i++) {
+    lengths[i] = 1 + random_rand() % MAX_LEN;
+    for(j = 0; j < lengths[i]; j++) {
+      switch(random_rand() % 32) {
+      case 0:
+        packets[i][j] = SLIP_END;
+        break;
+      case 1:
+        packets[i][j] = SLIP_ESC;
+        break;
+      default:
+        packets[i][j] = random_rand();
+        break;
+      }
+    }
+  }
+
+  ok = 1;
+  for(codec = 0; codec <= 1; codec++) {
+    start = now_cycles();
+    for(i = 0; i < ROUNDS; i++) {
+      stream_len = encode_all(codec);
+    }
+    cost[codec][0] = now_cycles() - start;
+
+    received = errors = 0;
+    start = now_cycles();
+    for(i = 0; i < ROUNDS; i++) {
+      decode_all(codec);
+    }
+    cost[codec][1] = now_cycles() - start;
+    ok = ok && errors == 0 && received == ROUNDS * PACKETS;
+  }
+
+  printf("slip, %d packets of 1-%d bytes, %s/byte\n", PACKETS, MAX_LEN,
+#if defined(__i386__) || defined(__x86_64__)
+         "cycles"
+#else
+         "ns"
+#endif
+         );
+  printf("%10s %8s %8s\n", "", "encode", "decode");
+  for(codec = 0; codec <= 1; codec++) {
+    printf("%10s %8.2f %8.2f\n", codec ? "codec" : "bytewise",
+           (double)cost[codec][0] / ROUNDS / stream_len,
+           (double)cost[codec][1] / ROUNDS / stream_len);
+  }
+  printf("round trip check: %s\n", ok ? "ok" : "FAILED");
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
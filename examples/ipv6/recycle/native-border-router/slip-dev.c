@@ -55,6 +55,7 @@
 #include "net/packetbuf.h"
 #include "cmd.h"
 #include "border-router-cmds.h"
+#include "slip-codec.h"
 
 extern int slip_config_verbose;
 extern int slip_config_flowcontrol;
@@ -72,8 +73,6 @@ extern speed_t slip_config_b_rate;
 
 int devopen(const char *dev, int flags);
 
-static FILE *inslip;
-
 /* for statistics */
 long slip_sent = 0;
 long slip_received = 0;
@@ -83,11 +82,6 @@ int slipfd = 0;
 //#define PROGRESS(s) fprintf(stderr, s)
 #define PROGRESS(s) do { } while(0)
 
-#define SLIP_END     0300
-#define SLIP_ESC     0333
-#define SLIP_ESC_END 0334
-#define SLIP_ESC_ESC 0335
-
 /*---------------------------------------------------------------------------*/
 static void *
 get_in_addr(struct sockaddr *sa)
@@ -169,138 +163,132 @@ slip_packet_input(unsigned char *data, int len)
   NETSTACK_RDC.input();
 }
 /*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+static void
+frame_input(unsigned char *inbuf, int inbufptr)
+{
+  int i;
+
+  if(inbuf[0] == '!') {
+    command_context = CMD_CONTEXT_RADIO;
+    cmd_input(inbuf, inbufptr);
+  } else if(inbuf[0] == '?') {
+#define DEBUG_LINE_MARKER '\r'
+  } else if(inbuf[0] == DEBUG_LINE_MARKER) {
+    fwrite(inbuf + 1, inbufptr - 1, 1, stdout);
+  } else if(is_sensible_string(inbuf, inbufptr)) {
+    if(slip_config_verbose == 1) {   /* strings already echoed below for verbose>1 */
+      fwrite(inbuf, inbufptr, 1, stdout);
+    }
+  } else {
+    if(slip_config_verbose > 2) {
+      printf("Packet from SLIP of length %d - write TUN\n", inbufptr);
+      if(slip_config_verbose > 4) {
+#if WIRESHARK_IMPORT_FORMAT
+        printf("0000");
+        for(i = 0; i < inbufptr; i++) printf(" %02x", inbuf[i]);
+#else
+        printf("         ");
+        for(i = 0; i < inbufptr; i++) {
+          printf("%02x", inbuf[i]);
+          if((i & 3) == 3) printf(" ");
+          if((i & 15) == 15) printf("\n         ");
+        }
+#endif
+        printf("\n");
+      }
+    }
+    slip_packet_input(inbuf, inbufptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
 /*
- * Read from serial, when we have a packet call slip_packet_input. No output
- * buffering, input buffered by stdio.
+ * Read from serial, when we have a packet call slip_packet_input. Each
+ * read() takes whatever the serial port has, which may be several
+ * packets, and the decoder copies whole runs of bytes at a time.
  */
 void
-serial_input(FILE *inslip)
+serial_input(int fd)
 {
   static unsigned char inbuf[2048];
-  static int inbufptr = 0;
-  int ret,i;
+  static struct slip_decoder decoder;
+  unsigned char readbuf[2048];
   unsigned char c;
+  int ret, i, used, step, prev;
 
-#ifdef linux
-  ret = fread(&c, 1, 1, inslip);
-  if(ret == -1 || ret == 0) err(1, "serial_input: read");
-  goto after_fread;
-#endif
+  if(decoder.buf == NULL) {
+    slip_decoder_init(&decoder, inbuf, sizeof(inbuf));
+  }
 
- read_more:
-  if(inbufptr >= sizeof(inbuf)) {
-     fprintf(stderr, "*** dropping large %d byte packet\n", inbufptr);
-     inbufptr = 0;
+  ret = read(fd, readbuf, sizeof(readbuf));
+  if(ret == -1 && (errno == EAGAIN || errno == EINTR)) {
+    return;
   }
-  ret = fread(&c, 1, 1, inslip);
-#ifdef linux
- after_fread:
-#endif
-  if(ret == -1) {
+  if(ret <= 0) {
     err(1, "serial_input: read");
   }
-  if(ret == 0) {
-    clearerr(inslip);
-    return;
-  }
-  slip_received++;
-  switch(c) {
-  case SLIP_END:
-    if(inbufptr > 0) {
-      if(inbuf[0] == '!') {
-	command_context = CMD_CONTEXT_RADIO;
-	cmd_input(inbuf, inbufptr);
-      } else if(inbuf[0] == '?') {
-#define DEBUG_LINE_MARKER '\r'
-      } else if(inbuf[0] == DEBUG_LINE_MARKER) {
-	fwrite(inbuf + 1, inbufptr - 1, 1, stdout);
-      } else if(is_sensible_string(inbuf, inbufptr)) {
-        if(slip_config_verbose == 1) {   /* strings already echoed below for verbose>1 */
-          fwrite(inbuf, inbufptr, 1, stdout);
+  slip_received += ret;
+
+  /* The verbose modes that echo text as it is received need to look
+     at every byte. */
+  step = slip_config_verbose >= 2 ? 1 : ret;
+  for(i = 0; i < ret; i += used) {
+    prev = decoder.frame_len != 0 ? 0 : decoder.len;
+    used = slip_decode(&decoder, readbuf + i, ret - i < step ? ret - i : step);
+    if(decoder.frame_len > 0) {
+      frame_input(inbuf, decoder.frame_len);
+    } else if(decoder.frame_len == SLIP_FRAME_DROPPED) {
+      fprintf(stderr, "*** dropping large packet\n");
+    } else if(decoder.len > prev) {
+      c = inbuf[decoder.len - 1];
+      /* Echo lines as they are received for verbose=2,3,5+ */
+      /* Echo all printable characters for verbose==4 */
+      if(slip_config_verbose == 4) {
+        if(c == 0 || c == '\r' || c == '\n' || c == '\t' || (c >= ' ' && c <= '~')) {
+          fwrite(&c, 1, 1, stdout);
         }
-      } else {
-        if(slip_config_verbose > 2) {
-          printf("Packet from SLIP of length %d - write TUN\n", inbufptr);
-          if(slip_config_verbose > 4) {
-#if WIRESHARK_IMPORT_FORMAT
-            printf("0000");
-	    for(i = 0; i < inbufptr; i++) printf(" %02x", inbuf[i]);
-#else
-            printf("         ");
-            for(i = 0; i < inbufptr; i++) {
-              printf("%02x", inbuf[i]);
-              if((i & 3) == 3) printf(" ");
-              if((i & 15) == 15) printf("\n         ");
-            }
-#endif
-            printf("\n");
-          }
+      } else if(slip_config_verbose >= 2) {
+        if(c == '\n' && is_sensible_string(inbuf, decoder.len)) {
+          fwrite(inbuf, decoder.len, 1, stdout);
+          decoder.len = 0;
         }
-	slip_packet_input(inbuf, inbufptr);
       }
-      inbufptr = 0;
-    }
-    break;
-
-  case SLIP_ESC:
-    if(fread(&c, 1, 1, inslip) != 1) {
-      clearerr(inslip);
-      /* Put ESC back and give up! */
-      ungetc(SLIP_ESC, inslip);
-      return;
     }
-
-    switch(c) {
-    case SLIP_ESC_END:
-      c = SLIP_END;
-      break;
-    case SLIP_ESC_ESC:
-      c = SLIP_ESC;
-      break;
-    }
-    /* FALLTHROUGH */
-  default:
-    inbuf[inbufptr++] = c;
-
-    /* Echo lines as they are received for verbose=2,3,5+ */
-    /* Echo all printable characters for verbose==4 */
-    if(slip_config_verbose == 4) {
-      if(c == 0 || c == '\r' || c == '\n' || c == '\t' || (c >= ' ' && c <= '~')) {
-	fwrite(&c, 1, 1, stdout);
-      }
-    } else if(slip_config_verbose >= 2) {
-      if(c == '\n' && is_sensible_string(inbuf, inbufptr)) {
-        fwrite(inbuf, inbufptr, 1, stdout);
-        inbufptr = 0;
-      }
-    }
-    break;
   }
-
-  goto read_more;
 }
 
 unsigned char slip_buf[2048];
 int slip_end, slip_begin, slip_packet_end, slip_packet_count;
-static struct timer send_delay_timer;
+/* The ctimer wakes up the main loop when the delay is over. */
+static struct ctimer send_delay_timer;
 /* delay between slip packets */
 static clock_time_t send_delay = SEND_DELAY;
 /*---------------------------------------------------------------------------*/
+/* Queue one packet, escaped and followed by SLIP_END. */
 static void
-slip_send(int fd, unsigned char c)
+slip_send_packet(const uint8_t *data, int len)
 {
-  if(slip_end >= sizeof(slip_buf)) {
-    err(1, "slip_send overflow");
-  }
-  slip_buf[slip_end] = c;
-  slip_end++;
-  slip_sent++;
-  if(c == SLIP_END) {
-    /* Full packet received. */
-    slip_packet_count++;
-    if(slip_packet_end == 0) {
-      slip_packet_end = slip_end;
+  static unsigned char scratch[SLIP_ENCODED_MAX(sizeof(slip_buf))];
+  int n;
+
+  if(slip_end + SLIP_ENCODED_MAX(len) <= sizeof(slip_buf)) {
+    n = slip_encode(slip_buf + slip_end, data, len);
+  } else {
+    /* The worst case does not fit, but the packet may. */
+    if(len > sizeof(slip_buf)) {
+      err(1, "slip_send overflow");
+    }
+    n = slip_encode(scratch, data, len);
+    if(slip_end + n > sizeof(slip_buf)) {
+      err(1, "slip_send overflow");
     }
+    memcpy(slip_buf + slip_end, scratch, n);
+  }
+  slip_end += n;
+  slip_sent += n;
+  slip_packet_count++;
+  if(slip_packet_end == 0) {
+    slip_packet_end = slip_end;
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -313,13 +301,16 @@ slip_empty()
 void
 slip_flushbuf(int fd)
 {
+  unsigned char *next;
   int n;
 
   if(slip_empty()) {
     return;
   }
 
-  n = write(fd, slip_buf + slip_begin, slip_packet_end - slip_begin);
+  /* Without a delay between packets, write all of them at once. */
+  n = write(fd, slip_buf + slip_begin,
+            (send_delay > 0 ? slip_packet_end : slip_end) - slip_begin);
 
   if(n == -1 && errno != EAGAIN) {
     err(1, "slip_flushbuf write failed");
@@ -327,27 +318,24 @@ slip_flushbuf(int fd)
     PROGRESS("Q");		/* Outqueue is full! */
   } else {
     slip_begin += n;
-    if(slip_begin == slip_packet_end) {
+    while(slip_packet_end > 0 && slip_begin >= slip_packet_end) {
       slip_packet_count--;
-      if(slip_end > slip_packet_end) {
-        memcpy(slip_buf, slip_buf + slip_packet_end,
-               slip_end - slip_packet_end);
+      /* Find end of next slip packet */
+      next = memchr(slip_buf + slip_packet_end, SLIP_END,
+                    slip_end - slip_packet_end);
+      slip_packet_end = next == NULL ? 0 : next - slip_buf + 1;
+      /* a delay between slip packets to avoid losing data */
+      if(slip_packet_end > 0 && send_delay > 0) {
+        ctimer_set(&send_delay_timer, send_delay, NULL, NULL);
       }
-      slip_end -= slip_packet_end;
-      slip_begin = slip_packet_end = 0;
-      if(slip_end > 0) {
-        /* Find end of next slip packet */
-        for(n = 1; n < slip_end; n++) {
-          if(slip_buf[n] == SLIP_END) {
-            slip_packet_end = n + 1;
-            break;
-          }
-        }
-        /* a delay between slip packets to avoid losing data */
-        if(send_delay > 0) {
-          timer_set(&send_delay_timer, send_delay);
-        }
+    }
+    if(slip_begin > 0) {
+      memmove(slip_buf, slip_buf + slip_begin, slip_end - slip_begin);
+      slip_end -= slip_begin;
+      if(slip_packet_end > 0) {
+        slip_packet_end -= slip_begin;
       }
+      slip_begin = 0;
     }
   }
 }
@@ -383,24 +371,7 @@ write_to_serial(int outfd, const uint8_t *inbuf, int len)
   /* It would be ``nice'' to send a SLIP_END here but it's not
    * really necessary.
    */
-  /* slip_send(outfd, SLIP_END); */
-
-  for(i = 0; i < len; i++) {
-    switch(p[i]) {
-    case SLIP_END:
-      slip_send(outfd, SLIP_ESC);
-      slip_send(outfd, SLIP_ESC_END);
-      break;
-    case SLIP_ESC:
-      slip_send(outfd, SLIP_ESC);
-      slip_send(outfd, SLIP_ESC_ESC);
-      break;
-    default:
-      slip_send(outfd, p[i]);
-      break;
-    }
-  }
-  slip_send(outfd, SLIP_END);
+  slip_send_packet(p, len);
   PROGRESS("t");
 }
 /*---------------------------------------------------------------------------*/
@@ -463,7 +434,7 @@ static int
 set_fd(fd_set *rset, fd_set *wset)
 {
   /* Anything to flush? */
-  if(!slip_empty() && (send_delay == 0 || timer_expired(&send_delay_timer))) {
+  if(!slip_empty() && (send_delay == 0 || ctimer_expired(&send_delay_timer))) {
     FD_SET(slipfd, wset);
   }
 
@@ -475,7 +446,7 @@ static void
 handle_fd(fd_set *rset, fd_set *wset)
 {
   if(FD_ISSET(slipfd, rset)) {
-    serial_input(inslip);
+    serial_input(slipfd);
   }
 
   if(FD_ISSET(slipfd, wset)) {
@@ -536,11 +507,6 @@ slip_init(void)
     stty_telos(slipfd);
   }
 
-  timer_set(&send_delay_timer, 0);
-  slip_send(slipfd, SLIP_END);
-  inslip = fdopen(slipfd, "r");
-  if(inslip == NULL) {
-    err(1, "main: fdopen");
-  }
+  slip_send_packet(NULL, 0);
 }
 /*---------------------------------------------------------------------------*/
@@ -114,6 +114,9 @@ typedef unsigned short uip_stats_t;
 #define SICSLOWPAN_CONF_FRAG                    1
 #define SICSLOWPAN_CONF_MAXAGE                  8
 #endif /* SICSLOWPAN_CONF_FRAG */
+#ifndef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_CONF_REASS_CONTEXTS          4
+#endif /* SICSLOWPAN_CONF_REASS_CONTEXTS */
 #define SICSLOWPAN_CONF_CONVENTIONAL_MAC	1
 #define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS       2
 #ifndef SICSLOWPAN_CONF_MAX_MAC_TRANSMISSIONS
@@ -127,6 +130,12 @@ typedef unsigned short uip_stats_t;
 #define UIP_CONF_ND6_MAX_PREFIXES     3
 #define UIP_CONF_ND6_MAX_DEFROUTERS   2
 #define UIP_CONF_ICMP6           1
+#ifndef UIP_ARCH_CHKSUM_ADD
+#define UIP_ARCH_CHKSUM_ADD      1
+#endif /* UIP_ARCH_CHKSUM_ADD */
+#ifndef UIP_CONF_CONN_HASH_SIZE
+#define UIP_CONF_CONN_HASH_SIZE  32
+#endif /* UIP_CONF_CONN_HASH_SIZE */
 
 /* configure number of neighbors and routes */
 #ifndef NBR_TABLE_CONF_MAX_NEIGHBORS
@@ -33,6 +33,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/select.h>
 
@@ -66,9 +67,43 @@
 #define SELECT_MAX 8
 #endif
 
+/* The main loop sleeps until the next event timer expires or a file
+   descriptor is ready, but no longer than this. Callbacks that wait
+   for a struct timer before they want to write rely on this bound. */
+#ifdef SELECT_CONF_MAX_SLEEP
+#define SELECT_MAX_SLEEP SELECT_CONF_MAX_SLEEP
+#else
+#define SELECT_MAX_SLEEP CLOCK_SECOND
+#endif
+
+/* With epoll, file descriptors are registered once and only the ready
+   ones are handled, instead of rebuilding and scanning the fd sets on
+   every turn of the main loop. */
+#ifdef SELECT_CONF_EPOLL
+#define SELECT_EPOLL SELECT_CONF_EPOLL
+#elif defined(__linux__)
+#define SELECT_EPOLL 1
+#else
+#define SELECT_EPOLL 0
+#endif
+
+#if SELECT_EPOLL
+#include <sys/epoll.h>
+#endif /* SELECT_EPOLL */
+
 static const struct select_callback *select_callback[SELECT_MAX];
 static int select_max = 0;
 
+#if SELECT_EPOLL
+static int epoll_fd = -1;
+/* The registered file descriptors, and the events they wait for. */
+static int fds[SELECT_MAX];
+static int num_fds;
+static uint32_t fd_events[SELECT_MAX];
+/* epoll refuses regular files, which select() reports as always ready. */
+#define ALWAYS_READY 0xffffffff
+#endif /* SELECT_EPOLL */
+
 SENSORS(&pir_sensor, &vib_sensor, &button_sensor);
 
 static uint8_t serial_id[] = {0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08};
@@ -85,6 +120,40 @@ select_set_callback(int fd, const struct select_callback *callback)
       callback = NULL;
     }
 
+#if SELECT_EPOLL
+    if(select_callback[fd] == NULL && callback != NULL) {
+      struct epoll_event ev;
+
+      if(epoll_fd < 0) {
+        epoll_fd = epoll_create(SELECT_MAX);
+        if(epoll_fd < 0) {
+          perror("epoll_create");
+          return 0;
+        }
+      }
+      /* The events are set by the main loop from set_fd(). */
+      memset(&ev, 0, sizeof(ev));
+      ev.data.fd = fd;
+      fd_events[fd] = 0;
+      if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        if(errno != EPERM) {
+          perror("epoll_ctl");
+          return 0;
+        }
+        fd_events[fd] = ALWAYS_READY;
+      }
+      fds[num_fds++] = fd;
+    } else if(select_callback[fd] != NULL && callback == NULL) {
+      if(fd_events[fd] != ALWAYS_READY) {
+        /* Fails harmlessly if the fd was closed first. */
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+      }
+      for(i = 0; fds[i] != fd; i++) {
+      }
+      fds[i] = fds[--num_fds];
+    }
+#endif /* SELECT_EPOLL */
+
     select_callback[fd] = callback;
 
     /* Update fd max */
@@ -106,6 +175,139 @@ select_set_callback(int fd, const struct select_callback *callback)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+/* Time left until the next event timer expires, 0 if it has. */
+static clock_time_t
+timer_left(void)
+{
+  clock_time_t left;
+
+  left = etimer_next_expiration_time() - clock_time();
+  return left > (clock_time_t)~0 / 2 ? 0 : left;
+}
+/*---------------------------------------------------------------------------*/
+/* How long the main loop may sleep, in milliseconds. */
+static int
+sleep_time(void)
+{
+  clock_time_t left;
+
+  left = etimer_pending() ? timer_left() : SELECT_MAX_SLEEP;
+  if(left > SELECT_MAX_SLEEP) {
+    left = SELECT_MAX_SLEEP;
+  }
+  return (left * 1000 + CLOCK_SECOND - 1) / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+#if SELECT_EPOLL
+static void
+wait_fds(int timeout)
+{
+  struct epoll_event events[SELECT_MAX];
+  struct epoll_event ev;
+  fd_set fdr, fdw;
+  uint32_t want;
+  int i, fd, n;
+
+  /* Ask every callback what it waits for, and pass on the changes. */
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  for(i = 0; i < num_fds; i++) {
+    select_callback[fds[i]]->set_fd(&fdr, &fdw);
+  }
+  for(i = 0; i < num_fds; i++) {
+    fd = fds[i];
+    want = (FD_ISSET(fd, &fdr) ? EPOLLIN : 0) |
+      (FD_ISSET(fd, &fdw) ? EPOLLOUT : 0);
+    if(fd_events[fd] == ALWAYS_READY) {
+      if(want != 0) {
+        timeout = 0;
+      }
+    } else if(want != fd_events[fd]) {
+      memset(&ev, 0, sizeof(ev));
+      ev.events = want;
+      ev.data.fd = fd;
+      if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0) {
+        fd_events[fd] = want;
+      }
+    }
+  }
+
+  if(epoll_fd < 0) {
+    /* Nothing was ever registered. */
+    usleep(timeout * 1000);
+    return;
+  }
+  n = epoll_wait(epoll_fd, events, SELECT_MAX, timeout);
+  if(n < 0) {
+    if(errno != EINTR) {
+      perror("epoll_wait");
+    }
+    return;
+  }
+
+  /* Hand every ready descriptor to its callback, as select() would. */
+  for(i = 0; i < num_fds; i++) {
+    fd = fds[i];
+    if(fd_events[fd] != ALWAYS_READY) {
+      FD_CLR(fd, &fdr);
+      FD_CLR(fd, &fdw);
+    }
+  }
+  for(i = 0; i < n; i++) {
+    fd = events[i].data.fd;
+    if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+      FD_SET(fd, &fdr);
+    }
+    if(events[i].events & (EPOLLOUT | EPOLLERR)) {
+      FD_SET(fd, &fdw);
+    }
+  }
+  for(i = 0; i < num_fds; i++) {
+    fd = fds[i];
+    if(FD_ISSET(fd, &fdr) || FD_ISSET(fd, &fdw)) {
+      select_callback[fd]->handle_fd(&fdr, &fdw);
+    }
+  }
+}
+#else /* SELECT_EPOLL */
+static void
+wait_fds(int timeout)
+{
+  fd_set fdr;
+  fd_set fdw;
+  int maxfd;
+  int i;
+  int retval;
+  struct timeval tv;
+
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = (timeout % 1000) * 1000;
+
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  maxfd = 0;
+  for(i = 0; i <= select_max; i++) {
+    if(select_callback[i] != NULL && select_callback[i]->set_fd(&fdr, &fdw)) {
+      maxfd = i;
+    }
+  }
+
+  retval = select(maxfd + 1, &fdr, &fdw, NULL, &tv);
+  if(retval < 0) {
+    if(errno != EINTR) {
+      perror("select");
+    }
+  } else if(retval > 0) {
+    /* timeout => retval == 0 */
+    for(i = 0; i <= maxfd; i++) {
+      if(select_callback[i] != NULL) {
+        select_callback[i]->handle_fd(&fdr, &fdw);
+      }
+    }
+  }
+}
+#endif /* SELECT_EPOLL */
+/*---------------------------------------------------------------------------*/
 static int
 stdin_set_fd(fd_set *rset, fd_set *wset)
 {
@@ -116,9 +318,14 @@ static void
 stdin_handle_fd(fd_set *rset, fd_set *wset)
 {
   char c;
+  int len;
   if(FD_ISSET(STDIN_FILENO, rset)) {
-    if(read(STDIN_FILENO, &c, 1) > 0) {
+    len = read(STDIN_FILENO, &c, 1);
+    if(len > 0) {
       serial_line_input_byte(c);
+    } else if(len == 0) {
+      /* At end of file, stop waking up for stdin. */
+      select_set_callback(STDIN_FILENO, NULL);
     }
   }
 }
@@ -190,6 +397,7 @@ main(int argc, char **argv)
   process_init();
   process_start(&etimer_process, NULL);
   ctimer_init();
+  rtimer_init();
 
 #if WITH_GUI
   process_start(&ctk_process, NULL);
@@ -236,41 +444,13 @@ main(int argc, char **argv)
 
   select_set_callback(STDIN_FILENO, &stdin_fd);
   while(1) {
-    fd_set fdr;
-    fd_set fdw;
-    int maxfd;
-    int i;
-    int retval;
-    struct timeval tv;
-
-    retval = process_run();
-
-    tv.tv_sec = 0;
-    tv.tv_usec = retval ? 1 : 1000;
+    /* Only sleep when there are no more events to process. */
+    wait_fds(process_run() ? 0 : sleep_time());
 
-    FD_ZERO(&fdr);
-    FD_ZERO(&fdw);
-    maxfd = 0;
-    for(i = 0; i <= select_max; i++) {
-      if(select_callback[i] != NULL && select_callback[i]->set_fd(&fdr, &fdw)) {
-        maxfd = i;
-      }
-    }
-
-    retval = select(maxfd + 1, &fdr, &fdw, NULL, &tv);
-    if(retval < 0) {
-      perror("select");
-    } else if(retval > 0) {
-      /* timeout => retval == 0 */
-      for(i = 0; i <= maxfd; i++) {
-        if(select_callback[i] != NULL) {
-          select_callback[i]->handle_fd(&fdr, &fdw);
-        }
-      }
+    if(etimer_pending() && timer_left() == 0) {
+      etimer_request_poll();
     }
 
-    etimer_request_poll();
-
 #if WITH_GUI
     if(console_resize()) {
        ctk_restore();
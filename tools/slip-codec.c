@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         SLIP framing for the host side of a serial link.
+ */
+
+#include "slip-codec.h"
+
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+void
+slip_decoder_init(struct slip_decoder *d, unsigned char *buf, int size)
+{
+  d->buf = buf;
+  d->size = size;
+  d->len = 0;
+  d->frame_len = 0;
+  d->esc = 0;
+  d->dropping = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put(struct slip_decoder *d, const unsigned char *data, int len)
+{
+  if(d->dropping) {
+    return;
+  }
+  if(d->len + len > d->size) {
+    /* Keep dropping until the frame ends. */
+    d->dropping = 1;
+    return;
+  }
+  memcpy(d->buf + d->len, data, len);
+  d->len += len;
+}
+/*---------------------------------------------------------------------------*/
+int
+slip_decode(struct slip_decoder *d, const unsigned char *data, int len)
+{
+  const unsigned char *p, *end, *stop, *esc;
+  unsigned char c;
+
+  if(d->frame_len != 0) {
+    d->frame_len = 0;
+    d->len = 0;
+  }
+
+  p = data;
+  end = data + len;
+  /* The next SLIP_END, or end. Searched again only once p is past it. */
+  stop = NULL;
+  while(p < end) {
+    if(d->esc) {
+      /* As before, an unknown escape, SLIP_END included, is kept as is. */
+      d->esc = 0;
+      c = *p++;
+      if(c == SLIP_ESC_END) {
+        c = SLIP_END;
+      } else if(c == SLIP_ESC_ESC) {
+        c = SLIP_ESC;
+      }
+      put(d, &c, 1);
+      continue;
+    }
+
+    if(stop == NULL || stop < p) {
+      stop = memchr(p, SLIP_END, end - p);
+      if(stop == NULL) {
+        stop = end;
+      }
+    }
+    /* Copy the run up to the next escape or the end of the frame. */
+    esc = memchr(p, SLIP_ESC, stop - p);
+    if(esc != NULL) {
+      put(d, p, esc - p);
+      d->esc = 1;
+      p = esc + 1;
+      continue;
+    }
+    put(d, p, stop - p);
+    p = stop;
+
+    if(p < end) {
+      /* SLIP_END */
+      p++;
+      if(d->dropping) {
+        d->dropping = 0;
+        d->frame_len = SLIP_FRAME_DROPPED;
+        return p - data;
+      } else if(d->len > 0) {
+        d->frame_len = d->len;
+        return p - data;
+      }
+    }
+  }
+  return p - data;
+}
+/*---------------------------------------------------------------------------*/
+int
+slip_encode(unsigned char *out, const unsigned char *data, int len)
+{
+  const unsigned char *p, *end, *next_end, *next_esc, *next;
+  unsigned char *o;
+
+  p = data;
+  end = data + len;
+  o = out;
+  next_end = memchr(p, SLIP_END, len);
+  next_esc = memchr(p, SLIP_ESC, len);
+  while(next_end != NULL || next_esc != NULL) {
+    if(next_esc == NULL || (next_end != NULL && next_end < next_esc)) {
+      next = next_end;
+    } else {
+      next = next_esc;
+    }
+    memcpy(o, p, next - p);
+    o += next - p;
+    *o++ = SLIP_ESC;
+    p = next + 1;
+    if(next == next_end) {
+      *o++ = SLIP_ESC_END;
+      next_end = memchr(p, SLIP_END, end - p);
+    } else {
+      *o++ = SLIP_ESC_ESC;
+      next_esc = memchr(p, SLIP_ESC, end - p);
+    }
+  }
+  memcpy(o, p, end - p);
+  o += end - p;
+  *o++ = SLIP_END;
+  return o - out;
+}
+/*---------------------------------------------------------------------------*/
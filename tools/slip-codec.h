@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2013, the Contiki project contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         SLIP framing for the host side of a serial link, shared by
+ *         tunslip6 and the native border router.
+ *
+ *         The decoder takes whatever a read() returned and the encoder
+ *         a whole packet. Both copy the runs between SLIP_END and
+ *         SLIP_ESC bytes with memchr() and memcpy() instead of
+ *         handling one byte at a time.
+ */
+
+#ifndef __SLIP_CODEC_H__
+#define __SLIP_CODEC_H__
+
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+/* The most bytes slip_encode() writes for a packet of len bytes. */
+#define SLIP_ENCODED_MAX(len) (2 * (len) + 1)
+
+/* frame_len of a frame that did not fit in the decoder buffer. */
+#define SLIP_FRAME_DROPPED -1
+
+struct slip_decoder {
+  unsigned char *buf;
+  int size;
+  /* Number of bytes decoded into buf for the current frame. A caller
+     that consumes the data before the frame ends may reset it. */
+  int len;
+  /* Length of the frame that ended in the last call to slip_decode(),
+     0 if none ended, or SLIP_FRAME_DROPPED. The frame is in buf until
+     the next call. */
+  int frame_len;
+  unsigned char esc;
+  unsigned char dropping;
+};
+
+void slip_decoder_init(struct slip_decoder *d, unsigned char *buf, int size);
+
+/**
+ * Decode SLIP data into the decoder buffer, stopping after the first
+ * frame that ends. Empty frames are skipped. Returns the number of
+ * bytes of data used; call again with the rest.
+ */
+int slip_decode(struct slip_decoder *d, const unsigned char *data, int len);
+
+/**
+ * Escape len bytes of data into out, followed by SLIP_END. out must
+ * have room for SLIP_ENCODED_MAX(len) bytes. Returns the number of
+ * bytes written.
+ */
+int slip_encode(unsigned char *out, const unsigned char *data, int len);
+
+#endif /* __SLIP_CODEC_H__ */
@@ -56,6 +56,8 @@
 
 #include <err.h>
 
+#include "slip-codec.h"
+
 int verbose = 1;
 const char *ipaddr;
 const char *netmask;
@@ -68,8 +70,7 @@ int ssystem(const char *fmt, ...)
      __attribute__((__format__ (__printf__, 1, 2)));
 void write_to_serial(int outfd, void *inbuf, int len);
 
-void slip_send(int fd, unsigned char c);
-void slip_send_char(int fd, unsigned char c);
+void slip_send_packet(const unsigned char *data, int len);
 
 //#define PROGRESS(s) fprintf(stderr, s)
 #define PROGRESS(s) do { } while (0)
@@ -92,11 +93,6 @@ ssystem(const char *fmt, ...)
   return system(cmd);
 }
 
-#define SLIP_END     0300
-#define SLIP_ESC     0333
-#define SLIP_ESC_END 0334
-#define SLIP_ESC_ESC 0335
-
 
 /* get sockaddr, IPv4 or IPv6: */
 void *
@@ -151,53 +147,22 @@ is_sensible_string(const unsigned char *s, int len)
 }
 
 /*
- * Read from serial, when we have a packet write it to tun. No output
- * buffering, input buffered by stdio.
+ * Handle a packet received from serial: configuration replies, debug
+ * output, or an IP packet that is written to tun.
  */
-void
-serial_to_tun(FILE *inslip, int outfd)
+static void
+frame_to_tun(unsigned char *inbuf, int inbufptr, int outfd)
 {
-  static union {
-    unsigned char inbuf[2000];
-  } uip;
-  static int inbufptr = 0;
-  int ret,i;
-  unsigned char c;
-
-#ifdef linux
-  ret = fread(&c, 1, 1, inslip);
-  if(ret == -1 || ret == 0) err(1, "serial_to_tun: read");
-  goto after_fread;
-#endif
+  int i;
 
- read_more:
-  if(inbufptr >= sizeof(uip.inbuf)) {
-     if(timestamp) stamptime();
-     fprintf(stderr, "*** dropping large %d byte packet\n",inbufptr);
-	 inbufptr = 0;
-  }
-  ret = fread(&c, 1, 1, inslip);
-#ifdef linux
- after_fread:
-#endif
-  if(ret == -1) {
-    err(1, "serial_to_tun: read");
-  }
-  if(ret == 0) {
-    clearerr(inslip);
-    return;
-  }
-  /*  fprintf(stderr, ".");*/
-  switch(c) {
-  case SLIP_END:
     if(inbufptr > 0) {
-      if(uip.inbuf[0] == '!') {
-	if(uip.inbuf[1] == 'M') {
+      if(inbuf[0] == '!') {
+	if(inbuf[1] == 'M') {
 	  /* Read gateway MAC address and autoconfigure tap0 interface */
 	  char macs[24];
 	  int i, pos;
 	  for(i = 0, pos = 0; i < 16; i++) {
-	    macs[pos++] = uip.inbuf[2 + i];
+	    macs[pos++] = inbuf[2 + i];
 	    if((i & 1) == 1 && i < 14) {
 	      macs[pos++] = ':';
 	    }
@@ -213,11 +178,11 @@ serial_to_tun(FILE *inslip, int outfd)
           if (timestamp) stamptime();
 	  ssystem("ifconfig %s up", tundev);
 	}
-      } else if(uip.inbuf[0] == '?') {
-	if(uip.inbuf[1] == 'P') {
+      } else if(inbuf[0] == '?') {
+	if(inbuf[1] == 'P') {
           /* Prefix info requested */
           struct in6_addr addr;
-	  int i;
+	  unsigned char reply[10];
 	  char *s = strchr(ipaddr, '/');
 	  if(s != NULL) {
 	    *s = '\0';
@@ -231,21 +196,19 @@ serial_to_tun(FILE *inslip, int outfd)
 		 addr.s6_addr[2], addr.s6_addr[3],
 		 addr.s6_addr[4], addr.s6_addr[5],
 		 addr.s6_addr[6], addr.s6_addr[7]);
-	  slip_send(slipfd, '!');
-	  slip_send(slipfd, 'P');
-	  for(i = 0; i < 8; i++) {
-	    /* need to call the slip_send_char for stuffing */
-	    slip_send_char(slipfd, addr.s6_addr[i]);
-	  }
-	  slip_send(slipfd, SLIP_END);
+	  reply[0] = '!';
+	  reply[1] = 'P';
+	  memcpy(&reply[2], addr.s6_addr, 8);
+	  /* slip_send_packet() does the stuffing */
+	  slip_send_packet(reply, sizeof(reply));
         }
 #define DEBUG_LINE_MARKER '\r'
-      } else if(uip.inbuf[0] == DEBUG_LINE_MARKER) {    
-	fwrite(uip.inbuf + 1, inbufptr - 1, 1, stdout);
-      } else if(is_sensible_string(uip.inbuf, inbufptr)) {
+      } else if(inbuf[0] == DEBUG_LINE_MARKER) {    
+	fwrite(inbuf + 1, inbufptr - 1, 1, stdout);
+      } else if(is_sensible_string(inbuf, inbufptr)) {
         if(verbose==1) {   /* strings already echoed below for verbose>1 */
           if (timestamp) stamptime();
-          fwrite(uip.inbuf, inbufptr, 1, stdout);
+          fwrite(inbuf, inbufptr, 1, stdout);
         }
       } else {
         if(verbose>2) {
@@ -254,11 +217,11 @@ serial_to_tun(FILE *inslip, int outfd)
           if (verbose>4) {
 #if WIRESHARK_IMPORT_FORMAT
             printf("0000");
-	        for(i = 0; i < inbufptr; i++) printf(" %02x",uip.inbuf[i]);
+	        for(i = 0; i < inbufptr; i++) printf(" %02x",inbuf[i]);
 #else
             printf("         ");
             for(i = 0; i < inbufptr; i++) {
-              printf("%02x", uip.inbuf[i]);
+              printf("%02x", inbuf[i]);
               if((i & 3) == 3) printf(" ");
               if((i & 15) == 15) printf("\n         ");
             }
@@ -266,86 +229,97 @@ serial_to_tun(FILE *inslip, int outfd)
             printf("\n");
           }
         }
-	if(write(outfd, uip.inbuf, inbufptr) != inbufptr) {
+	if(write(outfd, inbuf, inbufptr) != inbufptr) {
 	  err(1, "serial_to_tun: write");
 	}
       }
-      inbufptr = 0;
     }
-    break;
+}
 
-  case SLIP_ESC:
-    if(fread(&c, 1, 1, inslip) != 1) {
-      clearerr(inslip);
-      /* Put ESC back and give up! */
-      ungetc(SLIP_ESC, inslip);
-      return;
-    }
+/*
+ * Read from serial, when we have a packet write it to tun. No output
+ * buffering. Each read() takes whatever the serial port has, which may
+ * be several packets, and the decoder copies whole runs of bytes at a
+ * time.
+ */
+void
+serial_to_tun(int infd, int outfd)
+{
+  static unsigned char inbuf[2000];
+  static struct slip_decoder decoder;
+  unsigned char readbuf[2048];
+  unsigned char c;
+  int ret, i, used, step, prev;
 
-    switch(c) {
-    case SLIP_ESC_END:
-      c = SLIP_END;
-      break;
-    case SLIP_ESC_ESC:
-      c = SLIP_ESC;
-      break;
-    }
-    /* FALLTHROUGH */
-  default:
-    uip.inbuf[inbufptr++] = c;
+  if(decoder.buf == NULL) {
+    slip_decoder_init(&decoder, inbuf, sizeof(inbuf));
+  }
 
-    /* Echo lines as they are received for verbose=2,3,5+ */
-    /* Echo all printable characters for verbose==4 */
-    if((verbose==2) || (verbose==3) || (verbose>4)) {
-      if(c=='\n') {
-        if(is_sensible_string(uip.inbuf, inbufptr)) {
-          if (timestamp) stamptime();
-          fwrite(uip.inbuf, inbufptr, 1, stdout);
-          inbufptr=0;
+  ret = read(infd, readbuf, sizeof(readbuf));
+  if(ret == -1 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if(ret <= 0) {
+    err(1, "serial_to_tun: read");
+  }
+
+  /* The verbose modes that echo text as it is received need to look
+     at every byte. */
+  step = verbose >= 2 ? 1 : ret;
+  for(i = 0; i < ret; i += used) {
+    prev = decoder.frame_len != 0 ? 0 : decoder.len;
+    used = slip_decode(&decoder, readbuf + i, ret - i < step ? ret - i : step);
+    if(decoder.frame_len > 0) {
+      frame_to_tun(inbuf, decoder.frame_len, outfd);
+    } else if(decoder.frame_len == SLIP_FRAME_DROPPED) {
+      if(timestamp) stamptime();
+      fprintf(stderr, "*** dropping large packet\n");
+    } else if(decoder.len > prev) {
+      c = inbuf[decoder.len - 1];
+      /* Echo lines as they are received for verbose=2,3,5+ */
+      /* Echo all printable characters for verbose==4 */
+      if((verbose==2) || (verbose==3) || (verbose>4)) {
+        if(c=='\n') {
+          if(is_sensible_string(inbuf, decoder.len)) {
+            if (timestamp) stamptime();
+            fwrite(inbuf, decoder.len, 1, stdout);
+            decoder.len = 0;
+          }
+        }
+      } else if(verbose==4) {
+        if(c == 0 || c == '\r' || c == '\n' || c == '\t' || (c >= ' ' && c <= '~')) {
+          fwrite(&c, 1, 1, stdout);
+          if(c=='\n') if(timestamp) stamptime();
         }
-      }
-    } else if(verbose==4) {
-      if(c == 0 || c == '\r' || c == '\n' || c == '\t' || (c >= ' ' && c <= '~')) {
-	fwrite(&c, 1, 1, stdout);
-        if(c=='\n') if(timestamp) stamptime();
       }
     }
-    
-    break;
   }
-
-  goto read_more;
 }
 
 unsigned char slip_buf[2000];
 int slip_end, slip_begin;
 
+/* Queue one packet, escaped and followed by SLIP_END. */
 void
-slip_send_char(int fd, unsigned char c)
+slip_send_packet(const unsigned char *data, int len)
 {
-  switch(c) {
-  case SLIP_END:
-    slip_send(fd, SLIP_ESC);
-    slip_send(fd, SLIP_ESC_END);
-    break;
-  case SLIP_ESC:
-    slip_send(fd, SLIP_ESC);
-    slip_send(fd, SLIP_ESC_ESC);
-    break;
-  default:
-    slip_send(fd, c);
-    break;
-  }
-}
+  static unsigned char scratch[SLIP_ENCODED_MAX(sizeof(slip_buf))];
+  int n;
 
-void
-slip_send(int fd, unsigned char c)
-{
-  if(slip_end >= sizeof(slip_buf)) {
-    err(1, "slip_send overflow");
+  if(slip_end + SLIP_ENCODED_MAX(len) <= sizeof(slip_buf)) {
+    n = slip_encode(slip_buf + slip_end, data, len);
+  } else {
+    /* The worst case does not fit, but the packet may. */
+    if(len > sizeof(slip_buf)) {
+      err(1, "slip_send overflow");
+    }
+    n = slip_encode(scratch, data, len);
+    if(slip_end + n > sizeof(slip_buf)) {
+      err(1, "slip_send overflow");
+    }
+    memcpy(slip_buf + slip_end, scratch, n);
   }
-  slip_buf[slip_end] = c;
-  slip_end++;
+  slip_end += n;
 }
 
 int
@@ -405,24 +379,7 @@ write_to_serial(int outfd, void *inbuf, int len)
   /* It would be ``nice'' to send a SLIP_END here but it's not
    * really necessary.
    */
-  /* slip_send(outfd, SLIP_END); */
-
-  for(i = 0; i < len; i++) {
-    switch(p[i]) {
-    case SLIP_END:
-      slip_send(outfd, SLIP_ESC);
-      slip_send(outfd, SLIP_ESC_END);
-      break;
-    case SLIP_ESC:
-      slip_send(outfd, SLIP_ESC);
-      slip_send(outfd, SLIP_ESC_ESC);
-      break;
-    default:
-      slip_send(outfd, p[i]);
-      break;
-    }
-  }
-  slip_send(outfd, SLIP_END);
+  slip_send_packet(p, len);
   PROGRESS("t");
 }
 
@@ -692,7 +649,6 @@ main(int argc, char **argv)
   int tunfd, maxfd;
   int ret;
   fd_set rset, wset;
-  FILE *inslip;
   const char *siodev = NULL;
   const char *host = NULL;
   const char *port = NULL;
@@ -911,9 +867,7 @@ exit(1);
     fprintf(stderr, "********SLIP started on ``/dev/%s''\n", siodev);
     stty_telos(slipfd);
   }
-  slip_send(slipfd, SLIP_END);
-  inslip = fdopen(slipfd, "r");
-  if(inslip == NULL) err(1, "main: fdopen");
+  slip_send_packet(NULL, 0);
 
   tunfd = tun_alloc(tundev, tap);
   if(tunfd == -1) err(1, "main: open");
@@ -962,7 +916,7 @@ exit(1);
       err(1, "select");
     } else if(ret > 0) {
       if(FD_ISSET(slipfd, &rset)) {
-        serial_to_tun(inslip, tunfd);
+        serial_to_tun(slipfd, tunfd);
       }
       
       if(FD_ISSET(slipfd, &wset)) {